@@ -40,6 +40,21 @@ using namespace p44;
 #define DEFAULT_SENDING_EDGE_ADJUSTMENT 16 // one step (1/16th = 16/256th DALI bit time) delay of rising edge by default is probably better
 #define DEFAULT_SAMPLING_POINT_ADJUSTMENT 0
 
+// Number of responses allowed to be pending in the bridge before further commands are sent in sequence only.
+// Rx buf in bridge is 80 bytes = 40 answers, so 35 is the absolute max. The actual window adapts between
+// min and max: it is sized to cover the idle round trip time with commands (more does not increase throughput,
+// but only adds latency), and limited by a ceiling which is halved whenever responses get lost or out of sync.
+#define BRIDGE_WINDOW_MIN 2 // also: low watermark to restart sending
+#define BRIDGE_WINDOW_INITIAL 5 // until round trip times are known (conservative to prevent lockup)
+#define BRIDGE_WINDOW_MAX 35
+#define BRIDGE_WINDOW_RECOVERY 50 // number of clean responses needed to raise ceiling by one again
+#define BRIDGE_RTT_SMOOTHING 8 // smoothing factor for round trip and command time averages
+
+// Timeout for receiving bridge responses: base plus allowance for each response pending before
+#define BRIDGE_RESPONSE_TIMEOUT_BASE (5*Second)
+#define BRIDGE_RESPONSE_TIMEOUT_PER_PENDING (250*MilliSecond)
+#define BRIDGE_RESPONSE_TIMEOUT_MAX (20*Second)
+
 
 DaliComm::DaliComm(MainLoop &aMainLoop) :
 	inherited(aMainLoop),
@@ -49,8 +64,15 @@ DaliComm::DaliComm(MainLoop &aMainLoop) :
   expectedBridgeResponses(0),
   responsesInSequence(false),
   sendEdgeAdj(DEFAULT_SENDING_EDGE_ADJUSTMENT),
-  samplePointAdj(DEFAULT_SAMPLING_POINT_ADJUSTMENT)
+  samplePointAdj(DEFAULT_SAMPLING_POINT_ADJUSTMENT),
+  bridgeWindow(BRIDGE_WINDOW_INITIAL),
+  bridgeWindowCeiling(BRIDGE_WINDOW_MAX),
+  cleanResponses(0),
+  unloadedRTT(0),
+  commandTime(0),
+  lastResponseTime(Never)
 {
+  resetBusStatistics();
 }
 
 
@@ -113,10 +135,6 @@ bool DaliComm::isBusy()
 #define ACK_OVERLOAD 0x33 // bus overload (max current for longer period = possibly shortened)
 #define ACK_INVALIDCMD 0x39 // invalid command
 
-//#define BUFFERED_BRIDGE_RESPONSES_HIGH 35 // Rx buf in bridge is 80 bytes = 40 answers, only use 35 to make sure
-//#define BUFFERED_BRIDGE_RESPONSES_LOW 5 // low watermark to restart sending
-#define BUFFERED_BRIDGE_RESPONSES_HIGH 5 // Conservative to prevent lockup
-#define BUFFERED_BRIDGE_RESPONSES_LOW 2 // low watermark to restart sending
 
 
 static const char *bridgeCmdName(uint8_t aBridgeCmd)
@@ -157,10 +175,166 @@ void DaliComm::setConnectionSpecification(const char *aConnectionSpec, uint16_t
 }
 
 
-void DaliComm::bridgeResponseHandler(DaliBridgeResultCB aBridgeResultHandler, SerialOperationReceivePtr aOperation, ErrorPtr aError)
+// MARK: ===== adaptive bridge window and statistics
+
+DaliBusStatistics::DaliBusStatistics()
+{
+  reset();
+}
+
+
+void DaliBusStatistics::reset()
+{
+  commands = 0;
+  retries = 0;
+  collisions = 0;
+  busOverloads = 0;
+  timeouts = 0;
+  outOfSync = 0;
+  windowReductions = 0;
+  maxQueueDepth = 0;
+  for (int i=0; i<DALI_RTT_HISTOGRAM_BUCKETS; i++) rttHistogram[i] = 0;
+}
+
+
+MLMicroSeconds DaliBusStatistics::rttBucketLimit(int aBucket)
+{
+  static const MLMicroSeconds limits[DALI_RTT_HISTOGRAM_BUCKETS] = {
+    25*MilliSecond, 50*MilliSecond, 100*MilliSecond, 200*MilliSecond, 500*MilliSecond, 1*Second, 2*Second, Never
+  };
+  return limits[aBucket];
+}
+
+
+void DaliComm::resetBusStatistics()
+{
+  stats.reset();
+  for (int i=0; i<rateSlots; i++) commandsPerSlot[i] = 0;
+  rateSlot = 0;
+  rateSlotStart = MainLoop::now();
+}
+
+
+void DaliComm::advanceRateSlots()
+{
+  MLMicroSeconds now = MainLoop::now();
+  // advance slots (clearing those we skipped)
+  for (int n=0; n<rateSlots && now>=rateSlotStart+Second; n++) {
+    rateSlot = (rateSlot+1) % rateSlots;
+    commandsPerSlot[rateSlot] = 0;
+    rateSlotStart += Second;
+  }
+  if (now>=rateSlotStart+Second) rateSlotStart = now; // idle longer than all slots
+}
+
+
+double DaliComm::commandsPerSecond()
+{
+  advanceRateSlots();
+  // average over all completed slots
+  uint32_t total = 0;
+  for (int i=0; i<rateSlots; i++) {
+    if (i!=rateSlot) total += commandsPerSlot[i];
+  }
+  return (double)total/(rateSlots-1);
+}
+
+
+void DaliComm::updateWindow()
+{
+  int w = BRIDGE_WINDOW_INITIAL;
+  if (unloadedRTT>0 && commandTime>0) {
+    // enough commands in flight to keep the bus busy during a full round trip
+    w = (int)((unloadedRTT+commandTime-1)/commandTime)+1;
+  }
+  if (w>bridgeWindowCeiling) w = bridgeWindowCeiling;
+  if (w<BRIDGE_WINDOW_MIN) w = BRIDGE_WINDOW_MIN;
+  if (w!=bridgeWindow) {
+    FOCUSLOG("DALI bridge window changes from %d to %d (idle RTT=%lld mS, command time=%lld mS, ceiling=%d)", bridgeWindow, w, (long long)(unloadedRTT/MilliSecond), (long long)(commandTime/MilliSecond), bridgeWindowCeiling);
+    bridgeWindow = w;
+  }
+}
+
+
+void DaliComm::reduceWindow()
+{
+  // multiplicative decrease of the ceiling
+  bridgeWindowCeiling = bridgeWindow/2;
+  if (bridgeWindowCeiling<BRIDGE_WINDOW_MIN) bridgeWindowCeiling = BRIDGE_WINDOW_MIN;
+  cleanResponses = 0;
+  stats.windowReductions++;
+  LOG(LOG_NOTICE, "DALI bridge: lost or out-of-sync responses -> reducing in-flight window to %d", bridgeWindowCeiling);
+  updateWindow();
+}
+
+
+void DaliComm::recordResponse(uint8_t aCmd, uint8_t aResp1, uint8_t aResp2, MLMicroSeconds aQueuedAt, bool aQueuedIdle, ErrorPtr aError)
+{
+  MLMicroSeconds now = MainLoop::now();
+  bool trouble = false;
+  if (!Error::isOK(aError)) {
+    // no (complete) response at all
+    stats.timeouts++;
+    trouble = true;
+  }
+  else {
+    // round trip time
+    MLMicroSeconds rtt = now-aQueuedAt;
+    int b = 0;
+    while (b<DALI_RTT_HISTOGRAM_BUCKETS-1 && rtt>=DaliBusStatistics::rttBucketLimit(b)) b++;
+    stats.rttHistogram[b]++;
+    if (aQueuedIdle) {
+      unloadedRTT = unloadedRTT==0 ? rtt : unloadedRTT+(rtt-unloadedRTT)/BRIDGE_RTT_SMOOTHING;
+    }
+    if (lastResponseTime!=Never) {
+      // responses were pending since the last one, so bridge was busy all the time
+      MLMicroSeconds ct = now-lastResponseTime;
+      commandTime = commandTime==0 ? ct : commandTime+(ct-commandTime)/BRIDGE_RTT_SMOOTHING;
+    }
+    // response codes
+    if (aResp1==RESP_CODE_ACK_RETRIED || aResp1==RESP_CODE_DATA_RETRIED) stats.retries++;
+    if (aResp1==RESP_CODE_ACK || aResp1==RESP_CODE_ACK_RETRIED) {
+      switch (aResp2) {
+        case ACK_FRAME_ERR: stats.collisions++; break;
+        case ACK_OVERLOAD: stats.busOverloads++; break;
+        case ACK_TIMEOUT:
+          if (aCmd!=CMD_CODE_SEND16_REC8) {
+            // a send-only command cannot time out, response belongs to another command
+            stats.outOfSync++;
+            trouble = true;
+          }
+          break;
+      }
+    }
+    else if (aResp1!=RESP_CODE_DATA && aResp1!=RESP_CODE_DATA_RETRIED) {
+      // garbage
+      stats.outOfSync++;
+      trouble = true;
+    }
+  }
+  lastResponseTime = expectedBridgeResponses>0 ? now : Never; // only measure command time while busy
+  if (trouble) {
+    reduceWindow();
+  }
+  else if (++cleanResponses>=BRIDGE_WINDOW_RECOVERY) {
+    // additive increase of the ceiling
+    cleanResponses = 0;
+    if (bridgeWindowCeiling<BRIDGE_WINDOW_MAX) bridgeWindowCeiling++;
+  }
+  updateWindow();
+}
+
+
+void DaliComm::bridgeResponseHandler(DaliBridgeResultCB aBridgeResultHandler, SerialOperationReceivePtr aOperation, uint8_t aCmd, MLMicroSeconds aQueuedAt, bool aQueuedIdle, ErrorPtr aError)
 {
   if (expectedBridgeResponses>0) expectedBridgeResponses--;
-  if (expectedBridgeResponses<BUFFERED_BRIDGE_RESPONSES_LOW) {
+  if (Error::isOK(aError) && aOperation && aOperation->getDataSize()>=2) {
+    recordResponse(aCmd, aOperation->getDataP()[0], aOperation->getDataP()[1], aQueuedAt, aQueuedIdle, aError);
+  }
+  else {
+    recordResponse(aCmd, 0, 0, aQueuedAt, aQueuedIdle, Error::isOK(aError) ? ErrorPtr(new DaliCommError(DaliCommError::MissingData)) : aError);
+  }
+  if (expectedBridgeResponses<BRIDGE_WINDOW_MIN) {
     responsesInSequence = false; // allow buffered sends without waiting for answers again
   }
   // get received data
@@ -213,7 +387,16 @@ void DaliComm::sendBridgeCommand(uint8_t aCmd, uint8_t aDali1, uint8_t aDali2, D
   // prepare response reading operation
   SerialOperationReceivePtr recOp = SerialOperationReceivePtr(new SerialOperationReceive);
   recOp->setExpectedBytes(2); // expected 2 response bytes
+  // allow enough time for all responses pending before this one
+  MLMicroSeconds timeout = BRIDGE_RESPONSE_TIMEOUT_BASE+expectedBridgeResponses*BRIDGE_RESPONSE_TIMEOUT_PER_PENDING;
+  if (timeout>BRIDGE_RESPONSE_TIMEOUT_MAX) timeout = BRIDGE_RESPONSE_TIMEOUT_MAX;
+  if (aWithDelay>0) timeout += aWithDelay;
+  bool queuedIdle = expectedBridgeResponses==0;
   expectedBridgeResponses++;
+  stats.commands++;
+  if (expectedBridgeResponses>stats.maxQueueDepth) stats.maxQueueDepth = expectedBridgeResponses;
+  advanceRateSlots();
+  commandsPerSlot[rateSlot]++;
   if (aWithDelay>0) {
     // delayed sends must always be in sequence
     sendOp->setInitiationDelay(aWithDelay);
@@ -221,16 +404,16 @@ void DaliComm::sendBridgeCommand(uint8_t aCmd, uint8_t aDali1, uint8_t aDali2, D
   }
   else {
     // non-delayed sends may be sent before answer of previous commands have arrived as long as Rx buf in bridge does not overflow
-    if (expectedBridgeResponses>BUFFERED_BRIDGE_RESPONSES_HIGH) {
+    if (expectedBridgeResponses>bridgeWindow) {
       responsesInSequence = true; // prevent further sends without answers
     }
     recOp->inSequence = responsesInSequence;
     FOCUSLOG("DALI bridge command:  %s (%02X)      %02X %02X - %d pending responses - %s", bridgeCmdName(aCmd), aCmd, aDali1, aDali2, expectedBridgeResponses, responsesInSequence ? "sent when no more responses pending" : "sent as soon as possible");
   }
-  recOp->setTimeout(20*Second); // large timeout, because it can really take time until all expected answers are received
+  recOp->setTimeout(timeout);
   // set callback
   // - for recOp to obtain result or get error
-  recOp->setCompletionCallback(boost::bind(&DaliComm::bridgeResponseHandler, this, aResultCB, recOp, _1));
+  recOp->setCompletionCallback(boost::bind(&DaliComm::bridgeResponseHandler, this, aResultCB, recOp, aCmd, MainLoop::now(), queuedIdle, _1));
   // chain response op
   sendOp->setChainedOperation(recOp);
   // queue op
@@ -721,6 +904,91 @@ void DaliComm::daliBusScan(DaliBusScanCB aResultCB)
 
 
 
+// Verify known devices by querying the status of all short addresses once (returns list of short addresses)
+
+class DaliStatusScanner : public P44Obj
+{
+  DaliComm &daliComm;
+  DaliComm::DaliBusScanCB callback;
+  DaliAddress shortAddress;
+  DaliComm::ShortAddressListPtr activeDevicesPtr;
+  bool needFullScan;
+public:
+  static void statusScan(DaliComm &aDaliComm, DaliComm::DaliBusScanCB aResultCB)
+  {
+    // create new instance, deletes itself when finished
+    new DaliStatusScanner(aDaliComm, aResultCB);
+  };
+private:
+  DaliStatusScanner(DaliComm &aDaliComm, DaliComm::DaliBusScanCB aResultCB) :
+    callback(aResultCB),
+    daliComm(aDaliComm),
+    needFullScan(false),
+    activeDevicesPtr(new DaliComm::ShortAddressList)
+  {
+    daliComm.startProcedure();
+    LOG(LOG_INFO, "DaliComm: starting status scan (verifying known devices)");
+    // check if there are devices without short address
+    daliComm.daliSendQuery(DaliBroadcast, DALICMD_QUERY_MISSING_SHORT_ADDRESS, boost::bind(&DaliStatusScanner::handleMissingShortAddressResponse, this, _1, _2, _3));
+  }
+
+  void handleMissingShortAddressResponse(bool aNoOrTimeout, uint8_t aResponse, ErrorPtr aError)
+  {
+    if (DaliComm::isYes(aNoOrTimeout, aResponse, aError, true)) {
+      LOG(LOG_NOTICE, "Detected devices without short address on the bus (-> need full scan)");
+      needFullScan = true;
+      return completed(ErrorPtr());
+    }
+    shortAddress = 0;
+    daliComm.daliSendQuery(shortAddress, DALICMD_QUERY_STATUS, boost::bind(&DaliStatusScanner::handleStatusResponse, this, _1, _2, _3));
+  }
+
+  void handleStatusResponse(bool aNoOrTimeout, uint8_t aResponse, ErrorPtr aError)
+  {
+    if (Error::isError(aError, DaliCommError::domain(), DaliCommError::DALIFrame)) {
+      // framing error, more than one device answering
+      LOG(LOG_NOTICE, "Detected framing error for status response from short address %d - probably short address collision", shortAddress);
+      needFullScan = true;
+      return completed(ErrorPtr());
+    }
+    if (!Error::isOK(aError)) {
+      return completed(aError);
+    }
+    if (!aNoOrTimeout) {
+      activeDevicesPtr->push_back(shortAddress);
+      LOG(LOG_DEBUG, "- DALI device at short address %d answered status 0x%02X", shortAddress, aResponse);
+    }
+    shortAddress++;
+    if (shortAddress<DALI_MAXDEVICES) {
+      daliComm.daliSendQuery(shortAddress, DALICMD_QUERY_STATUS, boost::bind(&DaliStatusScanner::handleStatusResponse, this, _1, _2, _3));
+    }
+    else {
+      completed(ErrorPtr());
+    }
+  }
+
+  void completed(ErrorPtr aError)
+  {
+    if (needFullScan) {
+      aError = Error::err<DaliCommError>(DaliCommError::NeedFullScan, "Need full bus scan");
+    }
+    daliComm.endProcedure();
+    callback(activeDevicesPtr, DaliComm::ShortAddressListPtr(new DaliComm::ShortAddressList), aError);
+    // done, delete myself
+    delete this;
+  }
+
+};
+
+
+void DaliComm::daliStatusScan(DaliBusScanCB aResultCB)
+{
+  if (isBusy()) { aResultCB(ShortAddressListPtr(), ShortAddressListPtr(), DaliComm::busyError()); return; }
+  DaliStatusScanner::statusScan(*this, aResultCB);
+}
+
+
+
 
 // Scan DALI bus by random address
 
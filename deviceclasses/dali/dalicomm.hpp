@@ -123,6 +123,31 @@ namespace p44 {
 
   typedef boost::intrusive_ptr<DaliComm> DaliCommPtr;
 
+
+  #define DALI_RTT_HISTOGRAM_BUCKETS 8 ///< <25mS, <50mS, <100mS, <200mS, <500mS, <1S, <2S, longer
+
+  /// DALI bridge and bus usage statistics
+  class DaliBusStatistics
+  {
+  public:
+    DaliBusStatistics();
+    void reset();
+
+    uint64_t commands; ///< total bridge commands sent
+    uint64_t retries; ///< responses reporting that the bridge needed to retry
+    uint64_t collisions; ///< DALI frame errors (usually: more than one device answering)
+    uint64_t busOverloads; ///< bus overload reports
+    uint64_t timeouts; ///< bridge responses not received in time
+    uint64_t outOfSync; ///< bridge responses not matching the command (lost or overflowed responses)
+    uint64_t windowReductions; ///< number of times the in-flight window was reduced due to errors
+    int maxQueueDepth; ///< max number of responses pending at the same time
+    uint32_t rttHistogram[DALI_RTT_HISTOGRAM_BUCKETS]; ///< command round trip times (from queuing command to response)
+
+    /// @param aBucket index 0..DALI_RTT_HISTOGRAM_BUCKETS-1
+    /// @return upper limit of the bucket, Never for the last bucket
+    static MLMicroSeconds rttBucketLimit(int aBucket);
+  };
+
   /// A class providing low level access to the DALI bus
   class DaliComm : public SerialOperationQueue
   {
@@ -139,6 +164,25 @@ namespace p44 {
     int expectedBridgeResponses; ///< not yet received bridge responses
     bool responsesInSequence; ///< set when repsonses need to be in sequence with requests
 
+    /// @name adaptive in-flight window
+    /// @{
+    int bridgeWindow; ///< current max number of responses pending before sending in sequence
+    int bridgeWindowCeiling; ///< upper limit for bridgeWindow, reduced on errors, slowly recovering
+    int cleanResponses; ///< responses without error since last ceiling change
+    MLMicroSeconds unloadedRTT; ///< smoothed round trip time of commands sent with no other responses pending, 0 if unknown
+    MLMicroSeconds commandTime; ///< smoothed interval between responses while busy (time per command on the bus), 0 if unknown
+    MLMicroSeconds lastResponseTime; ///< time of last response if more responses were pending then, Never otherwise
+    /// @}
+
+    /// @name statistics
+    /// @{
+    DaliBusStatistics stats;
+    static const int rateSlots = 10; ///< seconds to average command rate over
+    uint32_t commandsPerSlot[rateSlots];
+    MLMicroSeconds rateSlotStart; ///< start of current rate slot
+    int rateSlot; ///< current rate slot
+    /// @}
+
     uint8_t sendEdgeAdj; ///< adjustment for sending rising edge - first param to CMD_CODE_EDGEADJ
     uint8_t samplePointAdj; ///< adjustment for sampling point - second param to CMD_CODE_EDGEADJ
 
@@ -185,6 +229,32 @@ namespace p44 {
     /// reset the communication with the bridge
     void reset(DaliCommandStatusCB aStatusCB);
 
+    /// @name bridge and bus usage statistics
+    /// @{
+
+    /// @return statistics counters
+    const DaliBusStatistics &busStatistics() const { return stats; };
+
+    /// reset statistics counters
+    void resetBusStatistics();
+
+    /// @return average number of bridge commands per second over the last few seconds
+    double commandsPerSecond();
+
+    /// @return number of bridge responses currently pending
+    int queueDepth() const { return expectedBridgeResponses; };
+
+    /// @return current number of responses allowed to be pending before sending in sequence
+    int inFlightWindow() const { return bridgeWindow; };
+
+    /// @return smoothed round trip time of a single command on an otherwise idle bridge, 0 if not yet known
+    MLMicroSeconds idleRoundTripTime() const { return unloadedRTT; };
+
+    /// @return smoothed time per command when bridge is busy, 0 if not yet known
+    MLMicroSeconds busCommandTime() const { return commandTime; };
+
+    /// @}
+
     /// Send two byte DALI bus command
     /// @param aDali1 first DALI byte
     /// @param aDali2 second DALI byte
@@ -276,6 +346,13 @@ namespace p44 {
     /// @param aResultCB callback receiving a list<int> of available short addresses on the bus
     void daliBusScan(DaliBusScanCB aResultCB);
 
+    /// Verify presence of devices by querying the status of every short address once
+    /// @param aResultCB callback receiving a list<int> of short addresses that answered
+    /// @note much quicker than daliBusScan(), but does not test data reliability. Meant for verifying a known
+    ///   bus setup. Returns a DaliCommError::NeedFullScan error when short address collisions or devices
+    ///   without short address are detected.
+    void daliStatusScan(DaliBusScanCB aResultCB);
+
     /// Scan the bus for devices by random address search
     /// @param aResultCB callback receiving a list<int> of available short addresses on the bus
     /// @param aFullScanOnlyIfNeeded
@@ -318,7 +395,11 @@ namespace p44 {
 
   private:
 
-    void bridgeResponseHandler(DaliBridgeResultCB aBridgeResultHandler, SerialOperationReceivePtr aOperation, ErrorPtr aError);
+    void bridgeResponseHandler(DaliBridgeResultCB aBridgeResultHandler, SerialOperationReceivePtr aOperation, uint8_t aCmd, MLMicroSeconds aQueuedAt, bool aQueuedIdle, ErrorPtr aError);
+    void recordResponse(uint8_t aCmd, uint8_t aResp1, uint8_t aResp2, MLMicroSeconds aQueuedAt, bool aQueuedIdle, ErrorPtr aError);
+    void reduceWindow();
+    void updateWindow();
+    void advanceRateSlots();
     void daliCommandStatusHandler(DaliCommandStatusCB aResultCB, uint8_t aResp1, uint8_t aResp2, ErrorPtr aError);
     void daliQueryResponseHandler(DaliQueryResultCB aResultCB, uint8_t aResp1, uint8_t aResp2, ErrorPtr aError);
     void connectionTimeout();
@@ -114,6 +114,7 @@
 
 // DALI memory banks
 #define DALIMEM_BANK0_MINBYTES 0x0F
+#define DALIMEM_BANK0_SERIAL_LSB 0x0E // least significant byte of the serial number
 #define DALIMEM_BANK1_MINBYTES 0x10
 
 
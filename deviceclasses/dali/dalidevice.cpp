@@ -135,6 +135,12 @@ void DaliBusDevice::deriveDsUid()
 
 void DaliBusDevice::getGroupMemberShip(DaliGroupsCB aDaliGroupsCB, DaliAddress aShortAddress)
 {
+  uint16_t groups;
+  if (daliVdc.getCachedGroups(aShortAddress, groups)) {
+    // known, no need to query the bus (but deliver via mainloop to avoid stacking up recursions)
+    MainLoop::currentMainLoop().executeOnce(boost::bind(aDaliGroupsCB, groups, ErrorPtr()));
+    return;
+  }
   daliVdc.daliComm->daliSendQuery(
     aShortAddress,
     DALICMD_QUERY_GROUPS_0_TO_7,
@@ -146,23 +152,26 @@ void DaliBusDevice::getGroupMemberShip(DaliGroupsCB aDaliGroupsCB, DaliAddress a
 void DaliBusDevice::queryGroup0to7Response(DaliGroupsCB aDaliGroupsCB, DaliAddress aShortAddress, bool aNoOrTimeout, uint8_t aResponse, ErrorPtr aError)
 {
   uint16_t groupBitMask = 0; // no groups yet
-  if (Error::isOK(aError) && !aNoOrTimeout) {
+  bool valid = Error::isOK(aError) && !aNoOrTimeout;
+  if (valid) {
     groupBitMask = aResponse;
   }
   // anyway, query other half
   daliVdc.daliComm->daliSendQuery(
     aShortAddress,
     DALICMD_QUERY_GROUPS_8_TO_15,
-    boost::bind(&DaliBusDevice::queryGroup8to15Response,this, aDaliGroupsCB, aShortAddress, groupBitMask, _1, _2, _3)
+    boost::bind(&DaliBusDevice::queryGroup8to15Response,this, aDaliGroupsCB, aShortAddress, groupBitMask, valid, _1, _2, _3)
   );
 }
 
 
-void DaliBusDevice::queryGroup8to15Response(DaliGroupsCB aDaliGroupsCB, DaliAddress aShortAddress, uint16_t aGroupBitMask, bool aNoOrTimeout, uint8_t aResponse, ErrorPtr aError)
+void DaliBusDevice::queryGroup8to15Response(DaliGroupsCB aDaliGroupsCB, DaliAddress aShortAddress, uint16_t aGroupBitMask, bool aValid, bool aNoOrTimeout, uint8_t aResponse, ErrorPtr aError)
 {
   // group 8..15 membership result
   if (Error::isOK(aError) && !aNoOrTimeout) {
     aGroupBitMask |= ((uint16_t)aResponse)<<8;
+    // remember if complete
+    if (aValid) daliVdc.setCachedGroups(aShortAddress, aGroupBitMask);
   }
   if (aDaliGroupsCB) aDaliGroupsCB(aGroupBitMask, aError);
 }
@@ -193,7 +202,7 @@ void DaliBusDevice::groupMembershipResponse(StatusCB aCompletedCB, uint16_t aUse
       if (aUsedGroupsMask & aGroups & (1<<g)) {
         // single device is member of a group in use -> remove it
         LOG(LOG_INFO, "- removing single DALI bus device with shortaddr %d from group %d", aShortAddress, g);
-        daliVdc.daliComm->daliSendConfigCommand(aShortAddress, DALICMD_REMOVE_FROM_GROUP|g);
+        daliVdc.changeGroupMembership(aShortAddress, g, false);
       }
     }
   }
@@ -223,7 +232,14 @@ void DaliBusDevice::queryActualLevelResponse(StatusCB aCompletedCB, bool aNoOrTi
     currentBrightness = arcpowerToBrightness(aResponse);
     LOG(LOG_DEBUG, "DaliBusDevice: retrieved current dimming level: arc power = %d, brightness = %0.1f", aResponse, currentBrightness);
   }
-  // next: query the minimum dimming level
+  // next: get the minimum dimming level
+  uint8_t minLevel;
+  if (daliVdc.getCachedMinLevel(addressForQuery(), minLevel)) {
+    // known from previous query
+    minBrightness = arcpowerToBrightness(minLevel);
+    aCompletedCB(aError);
+    return;
+  }
   daliVdc.daliComm->daliSendQuery(
     addressForQuery(),
     DALICMD_QUERY_MIN_LEVEL,
@@ -239,6 +255,7 @@ void DaliBusDevice::queryMinLevelResponse(StatusCB aCompletedCB, bool aNoOrTimeo
     isPresent = true; // answering a query means presence
     // this is my current arc power, save it as brightness for dS system side queries
     minBrightness = arcpowerToBrightness(aResponse);
+    daliVdc.setCachedMinLevel(addressForQuery(), aResponse);
     LOG(LOG_DEBUG, "DaliBusDevice: retrieved minimum dimming level: arc power = %d, brightness = %0.1f", aResponse, minBrightness);
   }
   // done updating parameters
@@ -308,7 +325,14 @@ void DaliBusDevice::setBrightness(Brightness aBrightness)
     currentBrightness = aBrightness;
     uint8_t power = brightnessToArcpower(aBrightness);
     LOG(LOG_INFO, "Dali dimmer at shortaddr=%d: setting new brightness = %0.2f, arc power = %d", (int)deviceInfo->shortAddress, aBrightness, (int)power);
-    daliVdc.daliComm->daliSendDirectPower(deviceInfo->shortAddress, power);
+    if (isGrouped()) {
+      // already a group command
+      daliVdc.daliComm->daliSendDirectPower(deviceInfo->shortAddress, power);
+    }
+    else {
+      // let vdc combine with other ballasts changing in the same mainloop cycle
+      daliVdc.queueDirectPower(deviceInfo->shortAddress, power, currentFadeTime);
+    }
   }
 }
 
@@ -317,6 +341,7 @@ void DaliBusDevice::setDefaultBrightness(Brightness aBrightness)
 {
   if (isDummy) return;
   if (aBrightness<0) aBrightness = currentBrightness; // use current brightness
+  daliVdc.sendPendingPower(); // make sure ballast has the level before storing
   uint8_t power = brightnessToArcpower(aBrightness);
   LOG(LOG_INFO, "Dali dimmer at shortaddr=%d: setting default/failure brightness = %0.2f, arc power = %d", (int)deviceInfo->shortAddress, aBrightness, (int)power);
   daliVdc.daliComm->daliSendDtrAndConfigCommand(deviceInfo->shortAddress, DALICMD_STORE_DTR_AS_POWER_ON_LEVEL, power);
@@ -348,6 +373,7 @@ void DaliBusDevice::dim(VdcDimMode aDimMode, double aDimPerMS)
 {
   if (isDummy) return;
   MainLoop::currentMainLoop().cancelExecutionTicket(dimRepeaterTicket); // stop any previous dimming activity
+  daliVdc.sendPendingPower(); // queued level changes must not overtake dimming commands
   // Use DALI UP/DOWN dimming commands
   if (aDimMode==dimmode_stop) {
     // stop dimming - send MASK
@@ -445,7 +471,7 @@ void DaliBusDeviceGroup::groupMembershipResponse(StatusCB aCompletedCB, DaliComm
   if ((aGroups & (1<<groupNo))==0) {
     // is not yet member of this group -> add it
     LOG(LOG_INFO, "- making DALI bus device with shortaddr %d member of group %d", *aNextMember, groupNo);
-    daliVdc.daliComm->daliSendConfigCommand(*aNextMember, DALICMD_ADD_TO_GROUP|groupNo);
+    daliVdc.changeGroupMembership(*aNextMember, groupNo, true);
   }
   // remove from all other groups
   aGroups &= ~(1<<groupNo); // do not remove again from target group
@@ -453,7 +479,7 @@ void DaliBusDeviceGroup::groupMembershipResponse(StatusCB aCompletedCB, DaliComm
     if (aGroups & (1<<groupNo)) {
       // device is member of a group it shouldn't be in -> remove it
       LOG(LOG_INFO, "- removing DALI bus device with shortaddr %d from group %d", *aNextMember, groupNo);
-      daliVdc.daliComm->daliSendConfigCommand(*aNextMember, DALICMD_REMOVE_FROM_GROUP|groupNo);
+      daliVdc.changeGroupMembership(*aNextMember, groupNo, false);
     }
   }
   // done adding this member to group
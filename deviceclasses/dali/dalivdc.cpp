@@ -23,13 +23,25 @@
 
 #include "dalidevice.hpp"
 
+#include <algorithm>
+
 #if ENABLE_DALI
 
 using namespace p44;
 
 
 DaliVdc::DaliVdc(int aInstanceNumber, VdcHost *aVdcHostP, int aTag) :
-  Vdc(aInstanceNumber, aVdcHostP, aTag)
+  Vdc(aInstanceNumber, aVdcHostP, aTag),
+  groupsInUse(0),
+  busAddresses(0),
+  busVerified(false),
+  optimizerGroupsMask(0),
+  newOptimizerGroupsMask(0),
+  optimizerCleanupMask(0),
+  optimizerProgramming(false),
+  optimizerGeneration(0),
+  optimizerUpdateTicket(0),
+  powerFlushTicket(0)
 {
   daliComm = DaliCommPtr(new 	DaliComm(MainLoop::currentMainLoop()));
 }
@@ -57,8 +69,25 @@ bool DaliVdc::getDeviceIcon(string &aIcon, bool aWithData, const char *aResoluti
 // Version history
 //  1 : first version
 //  2 : added groupNo (0..15) for DALI groups
+//  3 : added busDevices (device info and parameter cache per short address)
+//  4 : added optimizerGroups to globs (DALI groups allocated by the bus command optimizer)
 #define DALI_SCHEMA_MIN_VERSION 1 // minimally supported version, anything older will be deleted
-#define DALI_SCHEMA_VERSION 2 // current version
+#define DALI_SCHEMA_VERSION 4 // current version
+
+#define DALI_BUSDEVICES_TABLE_SQL \
+  "CREATE TABLE busDevices (" \
+  " shortAddress INTEGER," \
+  " devInfStatus INTEGER," \
+  " gtin INTEGER," \
+  " fwVersionMajor INTEGER," \
+  " fwVersionMinor INTEGER," \
+  " serialNo INTEGER," \
+  " oemGtin INTEGER," \
+  " oemSerialNo INTEGER," \
+  " groups INTEGER," /* DALI group membership bits, -1 if unknown */ \
+  " minLevel INTEGER," /* minimum arc power, -1 if unknown */ \
+  " PRIMARY KEY (shortAddress)" \
+  ");"
 
 string DaliPersistence::dbSchemaUpgradeSQL(int aFromVersion, int &aToVersion)
 {
@@ -76,6 +105,8 @@ string DaliPersistence::dbSchemaUpgradeSQL(int aFromVersion, int &aToVersion)
       " groupNo INTEGER," // DALI group Number (0..15), valid for dimmerType "GRP" only
       " PRIMARY KEY (dimmerUID)"
       ");"
+      DALI_BUSDEVICES_TABLE_SQL
+      "ALTER TABLE globs ADD optimizerGroups INTEGER;"
     );
     // reached final version in one step
     aToVersion = DALI_SCHEMA_VERSION;
@@ -87,6 +118,18 @@ string DaliPersistence::dbSchemaUpgradeSQL(int aFromVersion, int &aToVersion)
     // reached version 2
     aToVersion = 2;
   }
+  else if (aFromVersion==2) {
+    // V2->V3: busDevices added
+    sql = DALI_BUSDEVICES_TABLE_SQL;
+    // reached version 3
+    aToVersion = 3;
+  }
+  else if (aFromVersion==3) {
+    // V3->V4: optimizerGroups added
+    sql = "ALTER TABLE globs ADD optimizerGroups INTEGER;";
+    // reached version 4
+    aToVersion = 4;
+  }
   return sql;
 }
 
@@ -96,10 +139,159 @@ void DaliVdc::initialize(StatusCB aCompletedCB, bool aFactoryReset)
 	string databaseName = getPersistentDataDir();
 	string_format_append(databaseName, "%s_%d.sqlite3", vdcClassIdentifier(), getInstanceNumber());
   ErrorPtr error = db.connectAndInitialize(databaseName.c_str(), DALI_SCHEMA_VERSION, DALI_SCHEMA_MIN_VERSION, aFactoryReset);
+  if (Error::isOK(error)) {
+    // bus devices known from last run
+    loadBusCache();
+    // DALI groups the optimizer has allocated so far
+    sqlite3pp::query qry(db);
+    if (qry.prepare("SELECT optimizerGroups FROM globs")==SQLITE_OK) {
+      sqlite3pp::query::iterator i = qry.begin();
+      if (i!=qry.end()) optimizerGroupsMask = i->get<int>(0); // NULL reads as 0
+    }
+  }
 	aCompletedCB(error); // return status of DB init
 }
 
 
+// MARK: ===== persistent bus device cache
+
+void DaliVdc::loadCompositeDevices()
+{
+  compositeDevices.clear();
+  sqlite3pp::query qry(db);
+  if (qry.prepare("SELECT dimmerUID, dimmerType, collectionID, groupNo FROM compositeDevices")==SQLITE_OK) {
+    for (sqlite3pp::query::iterator i = qry.begin(); i!=qry.end(); ++i) {
+      CompositeDevicesEntry &e = compositeDevices[nonNullCStr(i->get<const char *>(0))];
+      e.dimmerType = nonNullCStr(i->get<const char *>(1));
+      e.collectionID = i->get<long long>(2);
+      e.groupNo = i->get<int>(3);
+    }
+  }
+}
+
+
+void DaliVdc::loadBusCache()
+{
+  deviceInfoCache.clear();
+  ballastStateCache.clear();
+  sqlite3pp::query qry(db);
+  if (qry.prepare("SELECT shortAddress, devInfStatus, gtin, fwVersionMajor, fwVersionMinor, serialNo, oemGtin, oemSerialNo, groups, minLevel FROM busDevices")==SQLITE_OK) {
+    for (sqlite3pp::query::iterator i = qry.begin(); i!=qry.end(); ++i) {
+      DaliDeviceInfoPtr info = DaliDeviceInfoPtr(new DaliDeviceInfo);
+      info->shortAddress = i->get<int>(0);
+      info->devInfStatus = (DaliDeviceInfo::DaliDevInfStatus)i->get<int>(1);
+      info->gtin = i->get<long long>(2);
+      info->fw_version_major = i->get<int>(3);
+      info->fw_version_minor = i->get<int>(4);
+      info->serialNo = i->get<long long>(5);
+      info->oem_gtin = i->get<long long>(6);
+      info->oem_serialNo = i->get<long long>(7);
+      if (info->devInfStatus==DaliDeviceInfo::devinf_needsquery) continue; // incomplete, must be read again anyway
+      deviceInfoCache[info->shortAddress] = info;
+      DaliBallastState &st = ballastStateCache[info->shortAddress];
+      st.groups = i->get<int>(8);
+      st.minLevel = i->get<int>(9);
+    }
+  }
+  LOG(LOG_INFO, "DALI: %d bus devices known from last run", (int)deviceInfoCache.size());
+}
+
+
+void DaliVdc::saveBallast(DaliAddress aShortAddress)
+{
+  DaliDeviceInfoMap::iterator pos = deviceInfoCache.find(aShortAddress);
+  if (pos==deviceInfoCache.end() || pos->second->devInfStatus==DaliDeviceInfo::devinf_needsquery) return; // nothing to save
+  DaliDeviceInfoPtr info = pos->second;
+  DaliBallastState &st = ballastState(aShortAddress);
+  db.executef(
+    "INSERT OR REPLACE INTO busDevices (shortAddress, devInfStatus, gtin, fwVersionMajor, fwVersionMinor, serialNo, oemGtin, oemSerialNo, groups, minLevel) "
+    "VALUES (%d, %d, %lld, %d, %d, %lld, %lld, %lld, %d, %d)",
+    (int)aShortAddress, (int)info->devInfStatus, info->gtin, (int)info->fw_version_major, (int)info->fw_version_minor,
+    info->serialNo, info->oem_gtin, info->oem_serialNo, st.groups, st.minLevel
+  );
+}
+
+
+void DaliVdc::forgetBallast(DaliAddress aShortAddress)
+{
+  deviceInfoCache.erase(aShortAddress);
+  ballastStateCache.erase(aShortAddress);
+  db.executef("DELETE FROM busDevices WHERE shortAddress=%d", (int)aShortAddress);
+}
+
+
+void DaliVdc::clearBusCache()
+{
+  deviceInfoCache.clear();
+  ballastStateCache.clear();
+  db.execute("DELETE FROM busDevices");
+}
+
+
+DaliVdc::DaliBallastState &DaliVdc::ballastState(DaliAddress aShortAddress)
+{
+  DaliBallastStateMap::iterator pos = ballastStateCache.find(aShortAddress);
+  if (pos==ballastStateCache.end()) {
+    // not known yet
+    DaliBallastState st;
+    st.groups = -1;
+    st.minLevel = -1;
+    pos = ballastStateCache.insert(make_pair(aShortAddress, st)).first;
+  }
+  return pos->second;
+}
+
+
+bool DaliVdc::getCachedGroups(DaliAddress aShortAddress, uint16_t &aGroups)
+{
+  DaliBallastStateMap::iterator pos = ballastStateCache.find(aShortAddress);
+  if (pos==ballastStateCache.end() || pos->second.groups<0) return false;
+  aGroups = pos->second.groups;
+  return true;
+}
+
+
+void DaliVdc::setCachedGroups(DaliAddress aShortAddress, uint16_t aGroups)
+{
+  DaliBallastState &st = ballastState(aShortAddress);
+  if (st.groups!=aGroups) {
+    st.groups = aGroups;
+    saveBallast(aShortAddress);
+  }
+}
+
+
+void DaliVdc::changeGroupMembership(DaliAddress aShortAddress, uint8_t aGroupNo, bool aMember)
+{
+  daliComm->daliSendConfigCommand(aShortAddress, (aMember ? DALICMD_ADD_TO_GROUP : DALICMD_REMOVE_FROM_GROUP)|aGroupNo);
+  DaliBallastState &st = ballastState(aShortAddress);
+  if (st.groups>=0) {
+    // update known memberships
+    setCachedGroups(aShortAddress, aMember ? st.groups | (1<<aGroupNo) : st.groups & ~(1<<aGroupNo));
+  }
+}
+
+
+bool DaliVdc::getCachedMinLevel(DaliAddress aShortAddress, uint8_t &aArcPower)
+{
+  DaliBallastStateMap::iterator pos = ballastStateCache.find(aShortAddress);
+  if (pos==ballastStateCache.end() || pos->second.minLevel<0) return false;
+  aArcPower = pos->second.minLevel;
+  return true;
+}
+
+
+void DaliVdc::setCachedMinLevel(DaliAddress aShortAddress, uint8_t aArcPower)
+{
+  DaliBallastState &st = ballastState(aShortAddress);
+  if (st.minLevel!=aArcPower) {
+    st.minLevel = aArcPower;
+    saveBallast(aShortAddress);
+  }
+}
+
+
+
 
 
 // MARK: ===== collect devices
@@ -114,19 +306,97 @@ int DaliVdc::getRescanModes() const
 
 void DaliVdc::collectDevices(StatusCB aCompletedCB, bool aIncremental, bool aExhaustive, bool aClearSettings)
 {
+  // group memberships might change while collecting
+  invalidateOptimizerGroups();
+  busVerified = false; // until scan confirms the bus
   if (!aIncremental) {
     removeDevices(aClearSettings);
+  }
+  if (aExhaustive) {
     // clear the cache, we want fresh info from the devices!
-    deviceInfoCache.clear();
+    clearBusCache();
+  }
+  if (!deviceInfoCache.empty()) {
+    // bus is known from last time, just verify which devices are still there
+    daliComm->daliStatusScan(boost::bind(&DaliVdc::statusScanDone, this, aCompletedCB, _1, _2, _3));
+    return;
   }
   // start collecting, allow quick scan when not exhaustively collecting (will still use full scan when bus collisions are detected)
   daliComm->daliFullBusScan(boost::bind(&DaliVdc::deviceListReceived, this, aCompletedCB, _1, _2, _3), !aExhaustive);
 }
 
 
+void DaliVdc::statusScanDone(StatusCB aCompletedCB, DaliComm::ShortAddressListPtr aDeviceListPtr, DaliComm::ShortAddressListPtr aUnreliableDeviceListPtr, ErrorPtr aError)
+{
+  if (Error::isError(aError, DaliCommError::domain(), DaliCommError::NeedFullScan)) {
+    // bus has changed in a way that might re-assign short addresses, cached info is no longer reliable
+    LOG(LOG_NOTICE, "DALI bus setup has changed, cached bus device info discarded");
+    clearBusCache();
+    daliComm->daliFullBusScan(boost::bind(&DaliVdc::deviceListReceived, this, aCompletedCB, _1, _2, _3), true);
+    return;
+  }
+  if (Error::isOK(aError)) {
+    // forget cached devices that are gone, new ones will get their device info read
+    ShortAddressSet present = 0;
+    for (DaliComm::ShortAddressList::iterator pos = aDeviceListPtr->begin(); pos!=aDeviceListPtr->end(); ++pos) {
+      present |= (ShortAddressSet)1<<(*pos & DaliAddressMask);
+    }
+    DaliComm::ShortAddressList gone;
+    for (DaliDeviceInfoMap::iterator pos = deviceInfoCache.begin(); pos!=deviceInfoCache.end(); ++pos) {
+      if ((present & ((ShortAddressSet)1<<(pos->first & DaliAddressMask)))==0) gone.push_back(pos->first);
+    }
+    for (DaliComm::ShortAddressList::iterator pos = gone.begin(); pos!=gone.end(); ++pos) {
+      LOG(LOG_NOTICE, "DALI bus device at short address %d no longer present", *pos);
+      forgetBallast(*pos);
+    }
+    // make sure the still present devices are the same as cached
+    verifyNextCachedDevice(aCompletedCB, aDeviceListPtr, aUnreliableDeviceListPtr, aDeviceListPtr->begin());
+    return;
+  }
+  deviceListReceived(aCompletedCB, aDeviceListPtr, aUnreliableDeviceListPtr, aError);
+}
+
+
+void DaliVdc::verifyNextCachedDevice(StatusCB aCompletedCB, DaliComm::ShortAddressListPtr aDeviceListPtr, DaliComm::ShortAddressListPtr aUnreliableDeviceListPtr, DaliComm::ShortAddressList::iterator aNextDev)
+{
+  while (aNextDev!=aDeviceListPtr->end()) {
+    DaliDeviceInfoMap::iterator ipos = deviceInfoCache.find(*aNextDev);
+    if (ipos!=deviceInfoCache.end() && ipos->second->devInfStatus==DaliDeviceInfo::devinf_solid) {
+      // a ballast replaced at the same short address would answer the status scan as well,
+      // so check one byte of the serial number (devices without device info have short address based dSUIDs anyway)
+      daliComm->daliReadMemory(
+        boost::bind(&DaliVdc::cachedSerialReceived, this, aCompletedCB, aDeviceListPtr, aUnreliableDeviceListPtr, aNextDev, _1, _2),
+        *aNextDev, 0, DALIMEM_BANK0_SERIAL_LSB, 1
+      );
+      return;
+    }
+    ++aNextDev;
+  }
+  // all verified
+  deviceListReceived(aCompletedCB, aDeviceListPtr, aUnreliableDeviceListPtr, ErrorPtr());
+}
+
+
+void DaliVdc::cachedSerialReceived(StatusCB aCompletedCB, DaliComm::ShortAddressListPtr aDeviceListPtr, DaliComm::ShortAddressListPtr aUnreliableDeviceListPtr, DaliComm::ShortAddressList::iterator aNextDev, DaliComm::MemoryVectorPtr aData, ErrorPtr aError)
+{
+  DaliDeviceInfoMap::iterator ipos = deviceInfoCache.find(*aNextDev);
+  if (ipos!=deviceInfoCache.end()) {
+    if (!Error::isOK(aError) || !aData || aData->size()<1 || (*aData)[0]!=(uint8_t)(ipos->second->serialNo & 0xFF)) {
+      // different (or unreadable) serial number: forget cached info, will be re-read like for a new device
+      LOG(LOG_NOTICE, "DALI bus device at short address %d does not match cached device info (replaced?) -> re-reading device info", *aNextDev);
+      forgetBallast(*aNextDev);
+    }
+  }
+  ++aNextDev;
+  verifyNextCachedDevice(aCompletedCB, aDeviceListPtr, aUnreliableDeviceListPtr, aNextDev);
+}
+
+
 // recollect devices after grouping change without scanning bus again
 void DaliVdc::recollectDevices(StatusCB aCompletedCB)
 {
+  // group memberships might change while collecting
+  invalidateOptimizerGroups();
   removeDevices(false);
   // no scan used, just use the cache
   // - create a Dali bus device for every cached devInf
@@ -145,17 +415,28 @@ void DaliVdc::recollectDevices(StatusCB aCompletedCB)
 
 void DaliVdc::deviceListReceived(StatusCB aCompletedCB, DaliComm::ShortAddressListPtr aDeviceListPtr, DaliComm::ShortAddressListPtr aUnreliableDeviceListPtr, ErrorPtr aError)
 {
+  // Note: scans fail with NeedFullScan when there is gear without short address, so an ok scan without
+  //   unreliable devices means that all gear on the bus is in aDeviceListPtr
+  busVerified = Error::isOK(aError) && (!aUnreliableDeviceListPtr || aUnreliableDeviceListPtr->empty());
   // check if any devices
   if (aError || aDeviceListPtr->size()==0)
     return aCompletedCB(aError); // no devices to query, completed
   // create a Dali bus device for every detected device
   DaliBusDeviceListPtr busDevices(new DaliBusDeviceList);
   for (DaliComm::ShortAddressList::iterator pos = aDeviceListPtr->begin(); pos!=aDeviceListPtr->end(); ++pos) {
-    // create simple device info containing only short address
-    DaliDeviceInfoPtr info = DaliDeviceInfoPtr(new DaliDeviceInfo);
-    info->shortAddress = *pos; // assign short address
-    info->devInfStatus = DaliDeviceInfo::devinf_needsquery;
-    deviceInfoCache[*pos] = info; // put it into the cache to represent the device
+    DaliDeviceInfoPtr info;
+    DaliDeviceInfoMap::iterator ipos = deviceInfoCache.find(*pos);
+    if (ipos!=deviceInfoCache.end()) {
+      // known device, use cached info
+      info = ipos->second;
+    }
+    else {
+      // create simple device info containing only short address
+      info = DaliDeviceInfoPtr(new DaliDeviceInfo);
+      info->shortAddress = *pos; // assign short address
+      info->devInfStatus = DaliDeviceInfo::devinf_needsquery;
+      deviceInfoCache[*pos] = info; // put it into the cache to represent the device
+    }
     // create bus device
     DaliBusDevicePtr busDevice(new DaliBusDevice(*this));
     busDevice->setDeviceInfo(info); // assign info to bus device
@@ -188,9 +469,11 @@ void DaliVdc::queryNextDev(DaliBusDeviceListPtr aBusDevices, DaliBusDeviceList::
       }
     }
     // all done successfully, complete bus info now available in aBusDevices
+    // - get current grouping and composite device configuration
+    loadCompositeDevices();
     // - look for dimmers that are to be addressed as a group
     DaliBusDeviceListPtr dimmerDevices = DaliBusDeviceListPtr(new DaliBusDeviceList());
-    uint16_t groupsInUse = 0; // groups in use
+    groupsInUse = 0; // groups in use
     while (aBusDevices->size()>0) {
       // get first remaining
       DaliBusDevicePtr busDevice = aBusDevices->front();
@@ -210,58 +493,57 @@ void DaliVdc::queryNextDev(DaliBusDeviceListPtr aBusDevices, DaliBusDeviceList::
         busDevice->clearDeviceInfo();
       }
       // check if this device is part of a DALI group
-      sqlite3pp::query qry(db);
-      string sql = string_format("SELECT groupNo FROM compositeDevices WHERE dimmerUID = '%s' AND dimmerType='GRP'", busDevice->dSUID.getString().c_str());
-      if (qry.prepare(sql.c_str())==SQLITE_OK) {
-        sqlite3pp::query::iterator i = qry.begin();
-        if (i!=qry.end()) {
-          // this is part of a DALI group
-          int groupNo = i->get<int>(0);
-          // - collect all with same group (= those that once were combined, in any order)
-          sql = string_format("SELECT dimmerUID FROM compositeDevices WHERE groupNo = %d AND dimmerType='GRP'", groupNo);
-          if (qry.prepare(sql.c_str())==SQLITE_OK) {
-            // we know that we found at least one dimmer of this group on the bus, so we'll instantiate
-            // the group (even if some dimmers might be missing)
-            groupsInUse |= 1<<groupNo; // flag used
-            DaliBusDeviceGroupPtr daliGroup = DaliBusDeviceGroupPtr(new DaliBusDeviceGroup(*this, groupNo));
-            for (sqlite3pp::query::iterator j = qry.begin(); j != qry.end(); ++j) {
-              DsUid dimmerUID(nonNullCStr(i->get<const char *>(0)));
-              // see if we have this dimmer on the bus
-              DaliBusDevicePtr dimmer;
-              for (DaliBusDeviceList::iterator pos = aBusDevices->begin(); pos!=aBusDevices->end(); ++pos) {
-                if ((*pos)->dSUID == dimmerUID) {
-                  // found dimmer
-                  dimmer = *pos;
-                  // consumed, remove from the list
-                  aBusDevices->erase(pos);
-                  break;
-                }
-              }
-              // process dimmer
-              if (!dimmer) {
-                // dimmer not found
-                LOG(LOG_WARNING, "Missing DALI dimmer %s for DALI group %d", dimmerUID.getString().c_str(), groupNo);
-                // insert dummy instead
-                dimmer = DaliBusDevicePtr(new DaliBusDevice(*this));
-                dimmer->isDummy = true; // disable bus access
-                dimmer->dSUID = dimmerUID; // just set the dSUID we know from the DB
-              }
-              // add the dimmer (real or dummy)
-              daliGroup->addDaliBusDevice(dimmer);
-            } // for all needed dimmers
-            // - derive dSUID for group
-            daliGroup->deriveDsUid();
-            // - add group to the list of single channel dimmer devices (groups and single devices)
-            dimmerDevices->push_back(daliGroup);
+      CompositeDevicesMap::iterator cpos = compositeDevices.find(busDevice->dSUID.getString());
+      if (cpos!=compositeDevices.end() && cpos->second.dimmerType=="GRP") {
+        // this is part of a DALI group
+        int groupNo = cpos->second.groupNo;
+        // - collect all with same group (= those that once were combined, in any order)
+        //   we know that we found at least one dimmer of this group on the bus, so we'll instantiate
+        //   the group (even if some dimmers might be missing)
+        groupsInUse |= 1<<groupNo; // flag used
+        DaliBusDeviceGroupPtr daliGroup = DaliBusDeviceGroupPtr(new DaliBusDeviceGroup(*this, groupNo));
+        for (CompositeDevicesMap::iterator j = compositeDevices.begin(); j!=compositeDevices.end(); ++j) {
+          if (j->second.dimmerType!="GRP" || j->second.groupNo!=groupNo) continue;
+          DsUid dimmerUID(j->first);
+          // see if we have this dimmer on the bus
+          DaliBusDevicePtr dimmer;
+          for (DaliBusDeviceList::iterator pos = aBusDevices->begin(); pos!=aBusDevices->end(); ++pos) {
+            if ((*pos)->dSUID == dimmerUID) {
+              // found dimmer
+              dimmer = *pos;
+              // consumed, remove from the list
+              aBusDevices->erase(pos);
+              break;
+            }
           }
-        } // part of group
-        else {
-          // definitely NOT part of group, single device dimmer
-          dimmerDevices->push_back(busDevice);
-          aBusDevices->remove(busDevice);
-        }
+          // process dimmer
+          if (!dimmer) {
+            // dimmer not found
+            LOG(LOG_WARNING, "Missing DALI dimmer %s for DALI group %d", dimmerUID.getString().c_str(), groupNo);
+            // insert dummy instead
+            dimmer = DaliBusDevicePtr(new DaliBusDevice(*this));
+            dimmer->isDummy = true; // disable bus access
+            dimmer->dSUID = dimmerUID; // just set the dSUID we know from the DB
+          }
+          // add the dimmer (real or dummy)
+          daliGroup->addDaliBusDevice(dimmer);
+        } // for all needed dimmers
+        // - derive dSUID for group
+        daliGroup->deriveDsUid();
+        // - add group to the list of single channel dimmer devices (groups and single devices)
+        dimmerDevices->push_back(daliGroup);
+      } // part of group
+      else {
+        // definitely NOT part of group, single device dimmer
+        dimmerDevices->push_back(busDevice);
+        aBusDevices->remove(busDevice);
       }
     }
+    // groups used for grouped dimmers must not contain optimizer members any more
+    // (grouped dimmer initialisation will re-add the group's own members afterwards)
+    for (int g=0; g<16; g++) {
+      if (optimizerGroupsMask & groupsInUse & (1<<g)) releaseOptimizerGroup(g);
+    }
     // initialize dimmer devices
     initializeNextDimmer(dimmerDevices, groupsInUse, dimmerDevices->begin(), aCompletedCB, ErrorPtr());
   }
@@ -300,55 +582,49 @@ void DaliVdc::createDsDevices(DaliBusDeviceListPtr aDimmerDevices, StatusCB aCom
     // get first remaining
     DaliBusDevicePtr busDevice = aDimmerDevices->front();
     // check if this device is part of a multi-channel composite device (but not a DALI group)
-    sqlite3pp::query qry(db);
-    string sql = string_format("SELECT collectionID FROM compositeDevices WHERE dimmerUID = '%s' AND dimmerType!='GRP'", busDevice->dSUID.getString().c_str());
-    if (qry.prepare(sql.c_str())==SQLITE_OK) {
-      sqlite3pp::query::iterator i = qry.begin();
-      if (i!=qry.end()) {
-        // this is part of a composite device
-        int collectionID = i->get<int>(0);
-        // - collect all with same collectionID (= those that once were combined, in any order)
-        sql = string_format("SELECT dimmerType, dimmerUID FROM compositeDevices WHERE collectionID = %d", collectionID);
-        if (qry.prepare(sql.c_str())==SQLITE_OK) {
-          // we know that we found at least one dimmer of this composite on the bus, so we'll instantiate
-          // a composite (even if some dimmers might be missing)
-          DaliRGBWDevicePtr daliDevice = DaliRGBWDevicePtr(new DaliRGBWDevice(this));
-          daliDevice->collectionID = collectionID; // remember from what collection this was created
-          for (sqlite3pp::query::iterator j = qry.begin(); j != qry.end(); ++j) {
-            string dimmerType = nonNullCStr(i->get<const char *>(0));
-            DsUid dimmerUID(nonNullCStr(i->get<const char *>(1)));
-            // see if we have this dimmer on the bus
-            DaliBusDevicePtr dimmer;
-            for (DaliBusDeviceList::iterator pos = aDimmerDevices->begin(); pos!=aDimmerDevices->end(); ++pos) {
-              if ((*pos)->dSUID == dimmerUID) {
-                // found dimmer on the bus, use it
-                dimmer = *pos;
-                // consumed, remove from the list
-                aDimmerDevices->erase(pos);
-                break;
-              }
-            }
-            // process dimmer
-            if (!dimmer) {
-              // dimmer not found
-              LOG(LOG_WARNING, "Missing DALI dimmer %s (type %s) for composite device", dimmerUID.getString().c_str(), dimmerType.c_str());
-              // insert dummy instead
-              dimmer = DaliBusDevicePtr(new DaliBusDevice(*this));
-              dimmer->isDummy = true; // disable bus access
-              dimmer->dSUID = dimmerUID; // just set the dSUID we know from the DB
-            }
-            // add the dimmer (real or dummy)
-            daliDevice->addDimmer(dimmer, dimmerType);
-          } // for all needed dimmers
-          // - add it to our collection (if not already there)
-          addDevice(daliDevice);
+    CompositeDevicesMap::iterator cpos = compositeDevices.find(busDevice->dSUID.getString());
+    if (cpos!=compositeDevices.end() && cpos->second.dimmerType!="GRP") {
+      // this is part of a composite device
+      long long collectionID = cpos->second.collectionID;
+      // - collect all with same collectionID (= those that once were combined, in any order)
+      //   we know that we found at least one dimmer of this composite on the bus, so we'll instantiate
+      //   a composite (even if some dimmers might be missing)
+      DaliRGBWDevicePtr daliDevice = DaliRGBWDevicePtr(new DaliRGBWDevice(this));
+      daliDevice->collectionID = collectionID; // remember from what collection this was created
+      for (CompositeDevicesMap::iterator j = compositeDevices.begin(); j!=compositeDevices.end(); ++j) {
+        if (j->second.dimmerType=="GRP" || j->second.collectionID!=collectionID) continue;
+        string dimmerType = j->second.dimmerType;
+        DsUid dimmerUID(j->first);
+        // see if we have this dimmer on the bus
+        DaliBusDevicePtr dimmer;
+        for (DaliBusDeviceList::iterator pos = aDimmerDevices->begin(); pos!=aDimmerDevices->end(); ++pos) {
+          if ((*pos)->dSUID == dimmerUID) {
+            // found dimmer on the bus, use it
+            dimmer = *pos;
+            // consumed, remove from the list
+            aDimmerDevices->erase(pos);
+            break;
+          }
         }
-      } // part of composite multichannel device
-      else {
-        // definitely NOT part of composite, put into single channel dimmer list
-        singleDevices.push_back(busDevice);
-        aDimmerDevices->remove(busDevice);
-      }
+        // process dimmer
+        if (!dimmer) {
+          // dimmer not found
+          LOG(LOG_WARNING, "Missing DALI dimmer %s (type %s) for composite device", dimmerUID.getString().c_str(), dimmerType.c_str());
+          // insert dummy instead
+          dimmer = DaliBusDevicePtr(new DaliBusDevice(*this));
+          dimmer->isDummy = true; // disable bus access
+          dimmer->dSUID = dimmerUID; // just set the dSUID we know from the DB
+        }
+        // add the dimmer (real or dummy)
+        daliDevice->addDimmer(dimmer, dimmerType);
+      } // for all needed dimmers
+      // - add it to our collection (if not already there)
+      addDevice(daliDevice);
+    } // part of composite multichannel device
+    else {
+      // definitely NOT part of composite, put into single channel dimmer list
+      singleDevices.push_back(busDevice);
+      aDimmerDevices->remove(busDevice);
     }
   }
   // remaining devices are single channel dimmer devices
@@ -361,6 +637,13 @@ void DaliVdc::createDsDevices(DaliBusDeviceListPtr aDimmerDevices, StatusCB aCom
     // - add it to our collection (if not already there)
     addDevice(daliDimmerDevice);
   }
+  // all ballasts on the bus are known now
+  busAddresses = 0;
+  for (DaliDeviceInfoMap::iterator pos = deviceInfoCache.begin(); pos!=deviceInfoCache.end(); ++pos) {
+    busAddresses |= (ShortAddressSet)1<<(pos->first & DaliAddressMask);
+  }
+  // settings (zones) of the devices are loaded, set up optimizer groups
+  scheduleOptimizerGroupsUpdate(0);
   // collecting complete
   aCompletedCB(ErrorPtr());
 }
@@ -384,6 +667,9 @@ void DaliVdc::deviceInfoReceived(DaliBusDeviceListPtr aBusDevices, DaliBusDevice
   // Note: callback always gets a deviceInfo back, possibly with devinf_none if device does not have devInf at all (or garbage)
   //   So, assigning this here will make sure no entries with devinf_needsquery will remain.
   deviceInfoCache[aDaliDeviceInfoPtr->shortAddress] = aDaliDeviceInfoPtr;
+  // - new device at this address, nothing known about its parameters yet
+  ballastStateCache.erase(aDaliDeviceInfoPtr->shortAddress);
+  saveBallast(aDaliDeviceInfoPtr->shortAddress);
   // use device info and continue
   deviceInfoValid(aBusDevices, aNextDev, aCompletedCB, aDaliDeviceInfoPtr);
 }
@@ -399,6 +685,351 @@ void DaliVdc::deviceInfoValid(DaliBusDeviceListPtr aBusDevices, DaliBusDeviceLis
 }
 
 
+// MARK: ===== DALI bus command optimizer
+
+#define OPTIMIZER_MIN_GROUP_SIZE 2 // groups are only worth using for at least that many ballasts
+#define OPTIMIZER_GROUPS_UPDATE_DELAY (30*Second) // delay for re-evaluating optimizer groups after seeing unoptimized commands
+
+
+static int numAddresses(uint64_t aAddressSet)
+{
+  int n = 0;
+  while (aAddressSet) {
+    aAddressSet &= aAddressSet-1; // clear lowest bit
+    n++;
+  }
+  return n;
+}
+
+
+void DaliVdc::queueDirectPower(DaliAddress aShortAddress, uint8_t aPower, uint8_t aFadeTime)
+{
+  ShortAddressSet addr = (ShortAddressSet)1<<(aShortAddress & DaliAddressMask);
+  // a ballast can only go to one level, remove possibly already queued other level
+  for (PowerBucketMap::iterator pos = pendingPower.begin(); pos!=pendingPower.end(); ++pos) {
+    if (pos->second & addr) {
+      pos->second &= ~addr;
+      if (pos->second==0) pendingPower.erase(pos);
+      break;
+    }
+  }
+  pendingPower[((uint16_t)aPower<<8) | aFadeTime] |= addr;
+  // send all commands queued in this mainloop cycle together
+  if (powerFlushTicket==0) {
+    powerFlushTicket = MainLoop::currentMainLoop().executeOnce(boost::bind(&DaliVdc::sendPendingPower, this));
+  }
+}
+
+
+void DaliVdc::sendPendingPower()
+{
+  MainLoop::currentMainLoop().cancelExecutionTicket(powerFlushTicket);
+  for (PowerBucketMap::iterator pos = pendingPower.begin(); pos!=pendingPower.end(); ++pos) {
+    uint8_t power = pos->first>>8;
+    ShortAddressSet remaining = pos->second;
+    if (busVerified && remaining==busAddresses) {
+      // all ballasts on the bus go to the same level with the same fade time
+      // Note: only when the bus is known to have no other gear, which would be driven by the broadcast as well
+      LOG(LOG_INFO, "DALI optimizer: broadcasting arc power = %d to all %d ballasts", (int)power, numAddresses(remaining));
+      daliComm->daliSendDirectPower(DaliBroadcast, power);
+      continue;
+    }
+    if (numAddresses(remaining)>=OPTIMIZER_MIN_GROUP_SIZE) {
+      // use group commands for all optimizer groups entirely going to this level
+      for (OptimizerGroupsVector::iterator gpos = optimizerGroups.begin(); gpos!=optimizerGroups.end(); ++gpos) {
+        if ((remaining & gpos->members)==gpos->members) {
+          LOG(LOG_INFO, "DALI optimizer: sending arc power = %d to group %d (zone %d, %d ballasts)", (int)power, gpos->groupNo, gpos->zoneID, numAddresses(gpos->members));
+          daliComm->daliSendDirectPower(gpos->groupNo|DaliGroup, power);
+          remaining &= ~gpos->members;
+        }
+      }
+      if (numAddresses(remaining)>=OPTIMIZER_MIN_GROUP_SIZE) {
+        // still multiple single commands for the same level, zones might have changed since groups were set up
+        scheduleOptimizerGroupsUpdate(OPTIMIZER_GROUPS_UPDATE_DELAY);
+      }
+    }
+    // single ballast commands for the rest
+    for (DaliAddress a = 0; remaining; ++a, remaining >>= 1) {
+      if (remaining & 1) {
+        daliComm->daliSendDirectPower(a, power);
+      }
+    }
+  }
+  pendingPower.clear();
+}
+
+
+void DaliVdc::scheduleOptimizerGroupsUpdate(MLMicroSeconds aDelay)
+{
+  if (optimizerUpdateTicket==0) {
+    optimizerUpdateTicket = MainLoop::currentMainLoop().executeOnce(boost::bind(&DaliVdc::updateOptimizerGroups, this), aDelay);
+  }
+}
+
+
+void DaliVdc::invalidateOptimizerGroups()
+{
+  MainLoop::currentMainLoop().cancelExecutionTicket(optimizerUpdateTicket);
+  // queued commands were calculated for the current group setup
+  sendPendingPower();
+  // abort programming in progress, and do not use groups any more until re-programmed
+  optimizerGeneration++;
+  optimizerProgramming = false;
+  optimizerGroups.clear();
+}
+
+
+void DaliVdc::setOptimizerGroupsMask(uint16_t aGroupsMask)
+{
+  if (aGroupsMask!=optimizerGroupsMask) {
+    optimizerGroupsMask = aGroupsMask;
+    db.executef("UPDATE globs SET optimizerGroups=%d", (int)optimizerGroupsMask);
+  }
+}
+
+
+void DaliVdc::releaseOptimizerGroup(uint8_t aGroupNo)
+{
+  uint16_t gm = 1<<aGroupNo;
+  if ((optimizerGroupsMask & gm)==0) return; // not an optimizer group
+  LOG(LOG_NOTICE, "DALI optimizer: releasing group %d for other use, removing all its members", aGroupNo);
+  invalidateOptimizerGroups();
+  // group addressed REMOVE_FROM_GROUP makes all members leave the group, including ones we don't know of
+  daliComm->daliSendConfigCommand(aGroupNo|DaliGroup, DALICMD_REMOVE_FROM_GROUP|aGroupNo);
+  for (DaliBallastStateMap::iterator pos = ballastStateCache.begin(); pos!=ballastStateCache.end(); ++pos) {
+    if (pos->second.groups>=0) setCachedGroups(pos->first, pos->second.groups & ~gm);
+  }
+  setOptimizerGroupsMask(optimizerGroupsMask & ~gm);
+}
+
+
+static bool largerZoneFirst(const pair<int, uint64_t> &aA, const pair<int, uint64_t> &aB)
+{
+  return numAddresses(aA.second)>numAddresses(aB.second);
+}
+
+
+void DaliVdc::updateOptimizerGroups()
+{
+  optimizerUpdateTicket = 0;
+  // collect the single ballasts, and the ones that are controlled as a single dS device per zone
+  DaliBusDeviceListPtr ballasts = DaliBusDeviceListPtr(new DaliBusDeviceList);
+  typedef std::map<int, ShortAddressSet> ZoneAddressesMap;
+  ZoneAddressesMap zoneAddresses;
+  for (DeviceVector::iterator pos = devices.begin(); pos!=devices.end(); ++pos) {
+    DaliDimmerDevicePtr dimmerDev = boost::dynamic_pointer_cast<DaliDimmerDevice>(*pos);
+    if (dimmerDev) {
+      DaliBusDevicePtr b = dimmerDev->brightnessDimmer;
+      if (b && !b->isGrouped() && !b->isDummy) {
+        ballasts->push_back(b);
+        if (dimmerDev->getZoneID()!=0) {
+          zoneAddresses[dimmerDev->getZoneID()] |= (ShortAddressSet)1<<(b->deviceInfo->shortAddress & DaliAddressMask);
+        }
+      }
+      continue;
+    }
+    DaliRGBWDevicePtr rgbwDev = boost::dynamic_pointer_cast<DaliRGBWDevice>(*pos);
+    if (rgbwDev) {
+      // composite dimmers are never members of optimizer groups, but must be removed from them
+      for (int i=0; i<DaliRGBWDevice::numDimmers; i++) {
+        DaliBusDevicePtr b = rgbwDev->dimmers[i];
+        if (b && !b->isGrouped() && !b->isDummy) ballasts->push_back(b);
+      }
+    }
+  }
+  // assign DALI groups not used for grouped dimmers to the zones, largest zones first
+  // Note: allocating from group 15 downwards, because groupDevices() allocates new groups from 0 upwards
+  std::vector< pair<int, ShortAddressSet> > zones(zoneAddresses.begin(), zoneAddresses.end());
+  std::stable_sort(zones.begin(), zones.end(), largerZoneFirst);
+  OptimizerGroupsVector groups;
+  int groupNo = 15;
+  uint16_t newGroupsMask = 0;
+  for (size_t i=0; i<zones.size(); i++) {
+    if (numAddresses(zones[i].second)<OPTIMIZER_MIN_GROUP_SIZE) break; // sorted, remaining zones are too small as well
+    while (groupNo>=0 && (groupsInUse & (1<<groupNo))) groupNo--;
+    if (groupNo<0) break; // no more free groups
+    OptimizerGroup og;
+    og.groupNo = groupNo--;
+    og.zoneID = zones[i].first;
+    og.members = zones[i].second;
+    groups.push_back(og);
+    newGroupsMask |= 1<<og.groupNo;
+  }
+  // check if anything has changed (compared to the groups being programmed right now, if any)
+  OptimizerGroupsVector &current = optimizerProgramming ? newOptimizerGroups : optimizerGroups;
+  // (also reprogram when groups from an earlier, interrupted run might still have members)
+  if (groups.size()==current.size() && (optimizerProgramming || optimizerGroupsMask==newGroupsMask)) {
+    size_t i;
+    for (i=0; i<groups.size(); i++) {
+      if (groups[i].groupNo!=current[i].groupNo || groups[i].members!=current[i].members) break;
+    }
+    if (i>=groups.size()) {
+      // optimizer groups are still correct, no need to reprogram
+      current = groups; // zone IDs might have changed
+      return;
+    }
+  }
+  // reprogram ballasts
+  LOG(LOG_NOTICE, "DALI optimizer: setting up %d DALI groups mirroring dS zones", (int)groups.size());
+  invalidateOptimizerGroups();
+  newOptimizerGroups = groups;
+  optimizerProgramming = true;
+  // only touch groups allocated by the optimizer (now or before), but never those now used for grouped dimmers.
+  // Persist the union until programming completes, so an interrupted run still gets cleaned up later
+  setOptimizerGroupsMask((optimizerGroupsMask | newGroupsMask) & ~groupsInUse);
+  optimizerCleanupMask = optimizerGroupsMask;
+  newOptimizerGroupsMask = newGroupsMask;
+  programNextOptimizerMember(optimizerGeneration, ballasts, ballasts->begin());
+}
+
+
+void DaliVdc::programNextOptimizerMember(uint32_t aGeneration, DaliBusDeviceListPtr aBusDevices, DaliBusDeviceList::iterator aNextDev)
+{
+  if (aGeneration!=optimizerGeneration) return; // outdated, another programming run has started or collecting devices has begun
+  if (aNextDev!=aBusDevices->end()) {
+    // query current memberships, then adjust if needed
+    (*aNextDev)->getGroupMemberShip(
+      boost::bind(&DaliVdc::optimizerMembershipResponse, this, aGeneration, aBusDevices, aNextDev, _1, _2),
+      (*aNextDev)->deviceInfo->shortAddress
+    );
+    return;
+  }
+  // all ballasts programmed, groups can be used now
+  optimizerGroups = newOptimizerGroups;
+  newOptimizerGroups.clear();
+  optimizerProgramming = false;
+  setOptimizerGroupsMask(newOptimizerGroupsMask);
+  LOG(LOG_NOTICE, "DALI optimizer: %d DALI groups ready for use", (int)optimizerGroups.size());
+}
+
+
+void DaliVdc::optimizerMembershipResponse(uint32_t aGeneration, DaliBusDeviceListPtr aBusDevices, DaliBusDeviceList::iterator aNextDev, uint16_t aGroups, ErrorPtr aError)
+{
+  if (aGeneration!=optimizerGeneration) return; // outdated
+  DaliAddress shortAddress = (*aNextDev)->deviceInfo->shortAddress;
+  ShortAddressSet addr = (ShortAddressSet)1<<(shortAddress & DaliAddressMask);
+  // groups this ballast should be member of
+  uint16_t wanted = 0;
+  for (OptimizerGroupsVector::iterator pos = newOptimizerGroups.begin(); pos!=newOptimizerGroups.end(); ++pos) {
+    if (pos->members & addr) wanted |= 1<<pos->groupNo;
+  }
+  if (!Error::isOK(aError)) {
+    // unknown memberships: make sure ballast is not in any other optimizer group, a group command must not reach it unexpectedly
+    LOG(LOG_WARNING, "DALI optimizer: cannot query groups of ballast with shortaddr %d: %s", shortAddress, aError->description().c_str());
+    aGroups = optimizerCleanupMask & ~wanted;
+  }
+  // adjust memberships in the optimizer's groups only (groups configured otherwise are left alone)
+  for (int g=0; g<16; g++) {
+    uint16_t gm = 1<<g;
+    if ((optimizerCleanupMask & gm)==0) continue; // not an optimizer group
+    if ((wanted & gm) && !(aGroups & gm)) {
+      LOG(LOG_INFO, "- DALI optimizer: adding ballast with shortaddr %d to group %d", shortAddress, g);
+      changeGroupMembership(shortAddress, g, true);
+    }
+    else if (!(wanted & gm) && (aGroups & gm)) {
+      LOG(LOG_INFO, "- DALI optimizer: removing ballast with shortaddr %d from group %d", shortAddress, g);
+      changeGroupMembership(shortAddress, g, false);
+    }
+  }
+  // next
+  ++aNextDev;
+  programNextOptimizerMember(aGeneration, aBusDevices, aNextDev);
+}
+
+
+
+// MARK: ===== property access
+
+enum {
+  busStatistics_key,
+  numDaliVdcProperties
+};
+
+static char dalivdc_key;
+
+
+int DaliVdc::numProps(int aDomain, PropertyDescriptorPtr aParentDescriptor)
+{
+  // Note: only add my own count when accessing root level properties!!
+  if (aParentDescriptor->isRootOfObject()) {
+    // Accessing properties at the vdc (root) level, add mine
+    return inherited::numProps(aDomain, aParentDescriptor)+numDaliVdcProperties;
+  }
+  // just return base class' count
+  return inherited::numProps(aDomain, aParentDescriptor);
+}
+
+
+PropertyDescriptorPtr DaliVdc::getDescriptorByIndex(int aPropIndex, int aDomain, PropertyDescriptorPtr aParentDescriptor)
+{
+  static const PropertyDescription properties[numDaliVdcProperties] = {
+    { "x-p44-busStatistics", apivalue_null, busStatistics_key, OKEY(dalivdc_key) },
+  };
+  if (aParentDescriptor->isRootOfObject()) {
+    // root level - accessing properties on the vdc level
+    int n = inherited::numProps(aDomain, aParentDescriptor);
+    if (aPropIndex<n)
+      return inherited::getDescriptorByIndex(aPropIndex, aDomain, aParentDescriptor); // base class' property
+    aPropIndex -= n; // rebase to 0 for my own first property
+    return PropertyDescriptorPtr(new StaticPropertyDescriptor(&properties[aPropIndex], aParentDescriptor));
+  }
+  // other level
+  return inherited::getDescriptorByIndex(aPropIndex, aDomain, aParentDescriptor); // base class' property
+}
+
+
+bool DaliVdc::accessField(PropertyAccessMode aMode, ApiValuePtr aPropValue, PropertyDescriptorPtr aPropertyDescriptor)
+{
+  if (aPropertyDescriptor->hasObjectKey(dalivdc_key)) {
+    if (aMode==access_read) {
+      switch (aPropertyDescriptor->fieldKey()) {
+        case busStatistics_key:
+          aPropValue->setType(apivalue_object); // make object (incoming object is NULL)
+          getBusStatistics(aPropValue);
+          return true;
+      }
+    }
+    else {
+      switch (aPropertyDescriptor->fieldKey()) {
+        case busStatistics_key:
+          // writing any value resets the counters
+          daliComm->resetBusStatistics();
+          return true;
+      }
+    }
+  }
+  // not my field, let base class handle it
+  return inherited::accessField(aMode, aPropValue, aPropertyDescriptor);
+}
+
+
+void DaliVdc::getBusStatistics(ApiValuePtr aStats)
+{
+  const DaliBusStatistics &st = daliComm->busStatistics();
+  aStats->add("commandsPerSecond", aStats->newDouble(daliComm->commandsPerSecond()));
+  aStats->add("commands", aStats->newUint64(st.commands));
+  aStats->add("queueDepth", aStats->newInt64(daliComm->queueDepth()));
+  aStats->add("maxQueueDepth", aStats->newInt64(st.maxQueueDepth));
+  aStats->add("inFlightWindow", aStats->newInt64(daliComm->inFlightWindow()));
+  aStats->add("windowReductions", aStats->newUint64(st.windowReductions));
+  aStats->add("idleRoundTripMs", aStats->newDouble((double)daliComm->idleRoundTripTime()/MilliSecond));
+  aStats->add("commandTimeMs", aStats->newDouble((double)daliComm->busCommandTime()/MilliSecond));
+  aStats->add("retries", aStats->newUint64(st.retries));
+  aStats->add("collisions", aStats->newUint64(st.collisions));
+  aStats->add("busOverloads", aStats->newUint64(st.busOverloads));
+  aStats->add("timeouts", aStats->newUint64(st.timeouts));
+  aStats->add("outOfSync", aStats->newUint64(st.outOfSync));
+  // round trip time histogram, keyed by upper bucket limit
+  ApiValuePtr hist = aStats->newValue(apivalue_object);
+  for (int i=0; i<DALI_RTT_HISTOGRAM_BUCKETS; i++) {
+    MLMicroSeconds limit = DaliBusStatistics::rttBucketLimit(i);
+    string key = limit==Never ? "longer" : string_format("below%lldms", (long long)(limit/MilliSecond));
+    hist->add(key, hist->newUint64(st.rttHistogram[i]));
+  }
+  aStats->add("rttHistogram", hist);
+}
+
+
 // MARK: ===== DALI specific methods
 
 ErrorPtr DaliVdc::handleMethod(VdcApiRequestPtr aRequest, const string &aMethod, ApiValuePtr aParams)
@@ -566,11 +1197,21 @@ ErrorPtr DaliVdc::groupDevices(VdcApiRequestPtr aRequest, ApiValuePtr aParams)
                     }
                   }
                   for (groupNo=0; groupNo<16; ++groupNo) {
-                    if ((groupMask & (1<<groupNo))==0) {
-                      // group number is free - use it
+                    if (((groupMask | optimizerGroupsMask) & (1<<groupNo))==0) {
+                      // group number is free and not used by the optimizer - use it
                       break;
                     }
                   }
+                  if (groupNo>=16) {
+                    // no completely unused group, take one from the optimizer (these are allocated from 15 downwards)
+                    for (groupNo=0; groupNo<16; ++groupNo) {
+                      if ((groupMask & (1<<groupNo))==0) {
+                        // make sure no optimizer members are left in the group
+                        releaseOptimizerGroup(groupNo);
+                        break;
+                      }
+                    }
+                  }
                   if (groupNo>=16) {
                     // no more unused DALI groups, cannot group at all
                     respErr = WebError::webErr(500, "16 groups already exist, cannot create additional group");
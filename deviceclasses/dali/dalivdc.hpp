@@ -61,7 +61,49 @@ namespace p44 {
     typedef Vdc inherited;
 
 		DaliPersistence db;
-    DaliDeviceInfoMap deviceInfoCache;
+    DaliDeviceInfoMap deviceInfoCache; ///< device info per short address, persisted in busDevices table
+    uint16_t groupsInUse; ///< DALI groups used for grouped dimmers (DaliBusDeviceGroup)
+
+    /// cached operating parameters of a single ballast
+    typedef struct {
+      int groups; ///< DALI group membership bits, -1 if unknown
+      int minLevel; ///< minimum arc power, -1 if unknown
+    } DaliBallastState;
+    typedef std::map<uint8_t, DaliBallastState> DaliBallastStateMap;
+    DaliBallastStateMap ballastStateCache; ///< parameters per short address, persisted in busDevices table
+
+    /// in-memory copy of compositeDevices table
+    typedef struct {
+      string dimmerType; ///< "GRP" for members of DALI groups, dimmer type within composite device otherwise
+      long long collectionID; ///< composite device collection
+      int groupNo; ///< DALI group number for "GRP"
+    } CompositeDevicesEntry;
+    typedef std::map<string, CompositeDevicesEntry> CompositeDevicesMap; ///< by dimmerUID
+    CompositeDevicesMap compositeDevices; ///< loaded once per collection run
+
+    /// @name DALI bus command optimizer
+    /// @{
+    typedef uint64_t ShortAddressSet; ///< one bit per DALI short address 0..63
+    ShortAddressSet busAddresses; ///< all ballasts found on the bus
+    bool busVerified; ///< set when the last bus scan was clean, i.e. there is no gear on the bus other than busAddresses
+    typedef struct {
+      uint8_t groupNo; ///< DALI group number
+      int zoneID; ///< dS zone mirrored by this group
+      ShortAddressSet members; ///< short addresses programmed as members of this group
+    } OptimizerGroup;
+    typedef std::vector<OptimizerGroup> OptimizerGroupsVector;
+    OptimizerGroupsVector optimizerGroups; ///< optimizer groups currently programmed into the ballasts
+    OptimizerGroupsVector newOptimizerGroups; ///< optimizer groups being programmed
+    uint16_t optimizerGroupsMask; ///< DALI groups allocated by the optimizer (persistent), only these are ever modified by it
+    uint16_t newOptimizerGroupsMask; ///< DALI groups used by newOptimizerGroups
+    uint16_t optimizerCleanupMask; ///< DALI groups to adjust memberships in while programming
+    bool optimizerProgramming; ///< set while group memberships are being programmed
+    uint32_t optimizerGeneration; ///< incremented whenever group programming starts or becomes invalid, aborts outdated programming runs
+    long optimizerUpdateTicket; ///< debounced re-evaluation of the optimizer groups
+    typedef std::map<uint16_t, ShortAddressSet> PowerBucketMap;
+    PowerBucketMap pendingPower; ///< direct power commands to send, key = arcpower<<8 | DALI fade time
+    long powerFlushTicket; ///< sends pendingPower at end of current mainloop cycle
+    /// @}
 
   public:
     DaliVdc(int aInstanceNumber, VdcHost *aVdcHostP, int aTag);
@@ -105,8 +147,74 @@ namespace p44 {
     /// @return true if there is an icon, false if not
     virtual bool getDeviceIcon(string &aIcon, bool aWithData, const char *aResolutionPrefix);
 
+    /// queue a direct arc power command for a single ballast
+    /// @param aShortAddress short address of the ballast
+    /// @param aPower arc power to set
+    /// @param aFadeTime DALI fade time currently set in the ballast
+    /// @note all commands queued within the same mainloop cycle (e.g. all devices affected by a scene call) are
+    ///   sent together at the end of the cycle. Ballasts going to the same level with the same fade time are
+    ///   addressed with a single broadcast or group command where possible, see sendPendingPower()
+    void queueDirectPower(DaliAddress aShortAddress, uint8_t aPower, uint8_t aFadeTime);
+
+    /// @name cached ballast parameters
+    /// @note these are persisted, so they are available without bus access on warm startup
+    /// @{
+
+    /// get cached group membership
+    /// @param aShortAddress short address of the ballast
+    /// @param aGroups will be set to group membership bits if known
+    /// @return true if group membership is known
+    bool getCachedGroups(DaliAddress aShortAddress, uint16_t &aGroups);
+
+    /// update cached group membership
+    /// @param aShortAddress short address of the ballast
+    /// @param aGroups group membership bits as read from the ballast
+    void setCachedGroups(DaliAddress aShortAddress, uint16_t aGroups);
+
+    /// add ballast to or remove it from a DALI group, keeping cached membership up to date
+    /// @param aShortAddress short address of the ballast
+    /// @param aGroupNo DALI group number 0..15
+    /// @param aMember true to add, false to remove
+    void changeGroupMembership(DaliAddress aShortAddress, uint8_t aGroupNo, bool aMember);
+
+    /// get cached minimum arc power
+    /// @param aShortAddress short address of the ballast
+    /// @param aArcPower will be set to the minimum arc power if known
+    /// @return true if minimum level is known
+    bool getCachedMinLevel(DaliAddress aShortAddress, uint8_t &aArcPower);
+
+    /// update cached minimum arc power
+    /// @param aShortAddress short address of the ballast
+    /// @param aArcPower minimum arc power as read from the ballast
+    void setCachedMinLevel(DaliAddress aShortAddress, uint8_t aArcPower);
+
+    /// @}
+
+    /// send queued direct power commands now
+    /// @note must be called before sending other commands that must not overtake a queued power command
+    void sendPendingPower();
+
+  protected:
+
+    // property access implementation
+    virtual int numProps(int aDomain, PropertyDescriptorPtr aParentDescriptor) P44_OVERRIDE;
+    virtual PropertyDescriptorPtr getDescriptorByIndex(int aPropIndex, int aDomain, PropertyDescriptorPtr aParentDescriptor) P44_OVERRIDE;
+    virtual bool accessField(PropertyAccessMode aMode, ApiValuePtr aPropValue, PropertyDescriptorPtr aPropertyDescriptor) P44_OVERRIDE;
+
   private:
 
+    void getBusStatistics(ApiValuePtr aStats);
+
+    void loadBusCache();
+    void saveBallast(DaliAddress aShortAddress);
+    void forgetBallast(DaliAddress aShortAddress);
+    void clearBusCache();
+    DaliBallastState &ballastState(DaliAddress aShortAddress);
+    void loadCompositeDevices();
+
+    void statusScanDone(StatusCB aCompletedCB, DaliComm::ShortAddressListPtr aDeviceListPtr, DaliComm::ShortAddressListPtr aUnreliableDeviceListPtr, ErrorPtr aError);
+    void verifyNextCachedDevice(StatusCB aCompletedCB, DaliComm::ShortAddressListPtr aDeviceListPtr, DaliComm::ShortAddressListPtr aUnreliableDeviceListPtr, DaliComm::ShortAddressList::iterator aNextDev);
+    void cachedSerialReceived(StatusCB aCompletedCB, DaliComm::ShortAddressListPtr aDeviceListPtr, DaliComm::ShortAddressListPtr aUnreliableDeviceListPtr, DaliComm::ShortAddressList::iterator aNextDev, DaliComm::MemoryVectorPtr aData, ErrorPtr aError);
     void deviceListReceived(StatusCB aCompletedCB, DaliComm::ShortAddressListPtr aDeviceListPtr, DaliComm::ShortAddressListPtr aUnreliableDeviceListPtr, ErrorPtr aError);
     void queryNextDev(DaliBusDeviceListPtr aBusDevices, DaliBusDeviceList::iterator aNextDev, StatusCB aCompletedCB, ErrorPtr aError);
     void initializeNextDimmer(DaliBusDeviceListPtr aDimmerDevices, uint16_t aGroupsInUse, DaliBusDeviceList::iterator aNextDimmer, StatusCB aCompletedCB, ErrorPtr aError);
@@ -117,6 +225,14 @@ namespace p44 {
 
     void groupCollected(VdcApiRequestPtr aRequest);
 
+    void scheduleOptimizerGroupsUpdate(MLMicroSeconds aDelay);
+    void updateOptimizerGroups();
+    void invalidateOptimizerGroups();
+    void setOptimizerGroupsMask(uint16_t aGroupsMask);
+    void releaseOptimizerGroup(uint8_t aGroupNo);
+    void programNextOptimizerMember(uint32_t aGeneration, DaliBusDeviceListPtr aBusDevices, DaliBusDeviceList::iterator aNextDev);
+    void optimizerMembershipResponse(uint32_t aGeneration, DaliBusDeviceListPtr aBusDevices, DaliBusDeviceList::iterator aNextDev, uint16_t aGroups, ErrorPtr aError);
+
     ErrorPtr groupDevices(VdcApiRequestPtr aRequest, ApiValuePtr aParams);
     ErrorPtr daliScan(VdcApiRequestPtr aRequest, ApiValuePtr aParams);
     ErrorPtr daliCmd(VdcApiRequestPtr aRequest, ApiValuePtr aParams);
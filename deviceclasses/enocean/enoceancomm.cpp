@@ -51,6 +51,39 @@ Esp3Packet::~Esp3Packet()
 }
 
 
+// max number of released packet objects kept for reuse
+#define MAX_FREE_PACKETS 64
+
+static void *freePackets = NULL; ///< linked list of released packet objects, first word of each points to the next one
+static size_t numFreePackets = 0;
+
+void *Esp3Packet::operator new(size_t aSize)
+{
+  if (aSize==sizeof(Esp3Packet) && freePackets) {
+    // reuse a released packet object
+    void *pkt = freePackets;
+    freePackets = *((void **)pkt);
+    numFreePackets--;
+    return pkt;
+  }
+  return ::operator new(aSize);
+}
+
+
+void Esp3Packet::operator delete(void *aPtr, size_t aSize)
+{
+  if (!aPtr) return;
+  if (aSize==sizeof(Esp3Packet) && numFreePackets<MAX_FREE_PACKETS) {
+    // keep for reuse
+    *((void **)aPtr) = freePackets;
+    freePackets = aPtr;
+    numFreePackets++;
+    return;
+  }
+  ::operator delete(aPtr);
+}
+
+
 void Esp3Packet::clear()
 {
   clearData();
@@ -62,7 +95,7 @@ void Esp3Packet::clear()
 void Esp3Packet::clearData()
 {
   if (payloadP) {
-    if (payloadP) delete [] payloadP;
+    if (payloadP!=inlinePayload) delete [] payloadP;
     payloadP = NULL;
   }
   payloadSize = 0;
@@ -79,6 +112,7 @@ void Esp3Packet::clearData()
 //  5 : CRC over bytes 1..4
 
 #define ESP3_HEADERBYTES 6
+#define ESP3_SYNCBYTE 0x55
 
 
 
@@ -162,7 +196,7 @@ size_t Esp3Packet::acceptBytes(size_t aNumBytes, const uint8_t *aBytes, bool aNo
     switch (state) {
       case ps_syncwait:
         // waiting for 0x55 sync byte
-        if (byte==0x55) {
+        if (byte==ESP3_SYNCBYTE) {
           // potential start of packet
           header[0] = byte;
           // - start reading header
@@ -225,18 +259,34 @@ size_t Esp3Packet::acceptBytes(size_t aNumBytes, const uint8_t *aBytes, bool aNo
 }
 
 
+void Esp3Packet::assignFrame(const uint8_t *aFrameP)
+{
+  clear();
+  memcpy(header, aFrameP, ESP3_HEADERBYTES);
+  // get a payload buffer sized according to the header, then copy the payload as a whole
+  uint8_t *p = data();
+  if (p) memcpy(p, aFrameP+ESP3_HEADERBYTES, payloadSize);
+  state = ps_complete;
+}
+
+
 uint8_t *Esp3Packet::data()
 {
   size_t s = dataLength()+optDataLength()+1; // one byte extra for CRC
   if (s!=payloadSize || !payloadP) {
-    if (payloadSize>300) {
+    clearData();
+    if (s>ESP3_MAX_PAYLOAD_SIZE) {
       // safety - prevent huge telegrams
-      clearData();
       return NULL;
     }
     payloadSize = s;
-    if (payloadP) delete [] payloadP;
-    payloadP = new uint8_t[payloadSize];
+    if (payloadSize<=ESP3_INLINE_PAYLOAD_SIZE) {
+      // small payload, no separate buffer needed
+      payloadP = inlinePayload;
+    }
+    else {
+      payloadP = new uint8_t[payloadSize];
+    }
     memset(payloadP, 0, payloadSize); // zero out
   }
   return payloadP;
@@ -260,7 +310,7 @@ void Esp3Packet::finalize()
     // force creation of payload (usually already done, but to make sure to avoid crashes)
     data();
     // set sync byte
-    header[0] = 0x55;
+    header[0] = ESP3_SYNCBYTE;
     // assign header CRC
     header[ESP3_HEADERBYTES-1] = headerCRC();
     // assign payload CRC
@@ -872,11 +922,12 @@ uint8_t Esp3Packet::addToCrc8(uint8_t aByte, uint8_t aCRCValue)
 }
 
 
-uint8_t Esp3Packet::crc8(uint8_t *aDataP, size_t aNumBytes, uint8_t aCRCValue)
+uint8_t Esp3Packet::crc8(const uint8_t *aDataP, size_t aNumBytes, uint8_t aCRCValue)
 {
-  int i;
-  for (i = 0; i<aNumBytes; i++) {
-    aCRCValue = addToCrc8(aCRCValue, aDataP[i]);
+  // table lookup over the whole span, no per-byte call
+  const uint8_t *endP = aDataP+aNumBytes;
+  while (aDataP<endP) {
+    aCRCValue = CRC8Table[aCRCValue ^ *aDataP++];
   }
   return aCRCValue;
 }
@@ -965,21 +1016,41 @@ const char *EnoceanComm::manufacturerName(EnoceanManufacturer aManufacturerCode)
 #define ENOCEAN_ESP3_ALIVECHECK_TIMEOUT (3*Second)
 
 #define ENOCEAN_ESP3_COMMAND_TIMEOUT (3*Second)
+// lower priority command classes get a turn at the latest after this many commands of higher classes
+#define ENOCEAN_CMD_MAX_BYPASS 4
 
 #define ENOCEAN_INIT_RETRIES 5
 #define ENOCEAN_INIT_RETRY_INTERVAL (5*Second)
 
+// Subtelegrams are sent within 40mS, repeaters add their copies within a few 100mS at most
+#define ENOCEAN_DEFAULT_DUPLICATE_WINDOW (300*MilliSecond)
+// when more senders than this are remembered, expired ones are removed
+#define ENOCEAN_MAX_RECENT_TELEGRAMS 512
+
 
 
 EnoceanComm::EnoceanComm(MainLoop &aMainLoop) :
 	inherited(aMainLoop),
   aliveCheckTicket(0),
   cmdTimeoutTicket(0),
+  cmdWaitingForResponse(false),
+  runningCmdPriority(cmdprio_management),
+  runningCmdSentAt(Never),
+  collapseTelegrams(false),
   apiVersion(0),
   appVersion(0),
   myAddress(0),
-  myIdBase(0)
+  myIdBase(0),
+  duplicateWindow(ENOCEAN_DEFAULT_DUPLICATE_WINDOW),
+  rxBufferBytes(0),
+  captureFile(NULL),
+  captureStartedAt(Never),
+  replayIndex(0),
+  replaySpeed(1),
+  replayInjecting(false),
+  replayTicket(0)
 {
+  for (int p=0; p<numCmdPriorities; p++) cmdBypassed[p] = 0;
 }
 
 
@@ -987,6 +1058,8 @@ EnoceanComm::~EnoceanComm()
 {
   MainLoop::currentMainLoop().cancelExecutionTicket(aliveCheckTicket);
   MainLoop::currentMainLoop().cancelExecutionTicket(cmdTimeoutTicket);
+  MainLoop::currentMainLoop().cancelExecutionTicket(replayTicket);
+  stopCapture();
 }
 
 
@@ -1086,7 +1159,7 @@ void EnoceanComm::aliveCheck()
   // send a EPS3 command to the modem to check if it is alive
   Esp3PacketPtr checkPacket = Esp3Packet::newEsp3Message(pt_common_cmd, CO_RD_VERSION);
   // issue command
-  sendCommand(checkPacket, boost::bind(&EnoceanComm::aliveCheckResponse, this, _1, _2));
+  sendCommand(checkPacket, boost::bind(&EnoceanComm::aliveCheckResponse, this, _1, _2), cmdprio_poll);
 }
 
 
@@ -1164,6 +1237,12 @@ void EnoceanComm::setEventPacketHandler(ESPPacketCB aEventPacketCB)
 }
 
 
+void EnoceanComm::setBetterCopyHandler(ESPPacketCB aBetterCopyCB)
+{
+  betterCopyHandler = aBetterCopyCB;
+}
+
+
 size_t EnoceanComm::acceptBytes(size_t aNumBytes, uint8_t *aBytes)
 {
   if (FOCUSLOGGING) {
@@ -1173,24 +1252,67 @@ size_t EnoceanComm::acceptBytes(size_t aNumBytes, uint8_t *aBytes)
     }
     FOCUSLOG("%s",d.c_str());
   }
-	size_t remainingBytes = aNumBytes;
-	while (remainingBytes>0) {
-		if (!currentIncomingPacket) {
-			currentIncomingPacket = Esp3PacketPtr(new Esp3Packet);
-		}
-		// pass bytes to current telegram
-		size_t consumedBytes = currentIncomingPacket->acceptBytes(remainingBytes, aBytes);
-		if (currentIncomingPacket->isComplete()) {
-      FOCUSLOG("Received Enocean Packet:\n%s", currentIncomingPacket->description().c_str());
-      dispatchPacket(currentIncomingPacket);
-      // forget the packet, further incoming bytes will create new packet
-			currentIncomingPacket = Esp3PacketPtr(); // forget
-		}
-		// continue with rest (if any)
-		aBytes+=consumedBytes;
-		remainingBytes-=consumedBytes;
-	}
-	return aNumBytes-remainingBytes;
+  size_t acceptedBytes = 0;
+  while (acceptedBytes<aNumBytes) {
+    // append as much as fits into the receive buffer
+    size_t n = aNumBytes-acceptedBytes;
+    if (n>ESP3_RX_BUFFER_SIZE-rxBufferBytes) n = ESP3_RX_BUFFER_SIZE-rxBufferBytes;
+    memcpy(rxBuffer+rxBufferBytes, aBytes+acceptedBytes, n);
+    rxBufferBytes += n;
+    acceptedBytes += n;
+    // extract all complete frames, keep incomplete frame (if any)
+    // Note: afterwards, buffer holds less than one max size frame, so there is always room for more
+    size_t consumed = scanFrames(rxBuffer, rxBufferBytes);
+    if (consumed>0) {
+      rxBufferBytes -= consumed;
+      memmove(rxBuffer, rxBuffer+consumed, rxBufferBytes);
+    }
+  }
+  return acceptedBytes;
+}
+
+
+size_t EnoceanComm::scanFrames(const uint8_t *aBuffer, size_t aNumBytes)
+{
+  size_t pos = 0;
+  while (pos<aNumBytes) {
+    // find next sync byte candidate
+    const uint8_t *frameP = (const uint8_t *)memchr(aBuffer+pos, ESP3_SYNCBYTE, aNumBytes-pos);
+    if (!frameP) {
+      // no sync byte at all, nothing worth keeping
+      pos = aNumBytes;
+      break;
+    }
+    pos = frameP-aBuffer;
+    if (aNumBytes-pos<ESP3_HEADERBYTES) break; // header not yet complete
+    if (Esp3Packet::crc8(frameP+1, ESP3_HEADERBYTES-2)!=frameP[ESP3_HEADERBYTES-1]) {
+      // not a valid header, resync at next sync byte candidate
+      pos++;
+      continue;
+    }
+    size_t payloadSize = (frameP[1]<<8) + frameP[2] + frameP[3] + 1; // data + optdata + CRC
+    if (payloadSize>ESP3_MAX_PAYLOAD_SIZE) {
+      // implausible size, must be a false sync
+      pos++;
+      continue;
+    }
+    if (aNumBytes-pos<ESP3_HEADERBYTES+payloadSize) break; // payload not yet complete
+    const uint8_t *payloadP = frameP+ESP3_HEADERBYTES;
+    if (Esp3Packet::crc8(payloadP, payloadSize-1)!=payloadP[payloadSize-1]) {
+      // payload corrupted, resync at next sync byte candidate (might be within this frame)
+      FOCUSLOG("ESP3 payload CRC error -> resyncing");
+      pos++;
+      continue;
+    }
+    // complete frame
+    Esp3PacketPtr packet = Esp3PacketPtr(new Esp3Packet);
+    packet->assignFrame(frameP);
+    pos += ESP3_HEADERBYTES+payloadSize;
+    FOCUSLOG("Received Enocean Packet:\n%s", packet->description().c_str());
+    if (captureFile) captureFrame(frameP, ESP3_HEADERBYTES+payloadSize);
+    dispatchPacket(packet);
+  }
+  return pos;
 }
 
 
@@ -1200,6 +1322,12 @@ void EnoceanComm::dispatchPacket(Esp3PacketPtr aPacket)
   PacketType pt = aPacket->packetType();
   if (pt==pt_radio) {
     // incoming radio packet
+    radioStats.telegrams++;
+    if (isDuplicateRadioPacket(aPacket)) {
+      // copy of an already dispatched telegram (subtelegram or repeated)
+      return;
+    }
+    radioStats.dispatched++;
     if (radioPacketHandler) {
       // call the handler
       radioPacketHandler(aPacket, ErrorPtr());
@@ -1213,16 +1341,23 @@ void EnoceanComm::dispatchPacket(Esp3PacketPtr aPacket)
     // - stop timeout
     MainLoop::currentMainLoop().cancelExecutionTicket(cmdTimeoutTicket);
     // - this is a command response
-    if (cmdQueue.empty() || cmdQueue.front().commandPacket) {
+    if (!cmdWaitingForResponse) {
       // received unexpected answer
       LOG(LOG_WARNING, "ESP3: Received unexpected response packet of length %zu", aPacket->dataLength());
     }
     else {
-      // must be response to first entry in queue
+      // must be response to the running command
+      EnoceanCmdStatistics &st = cmdStats[runningCmdPriority];
+      MLMicroSeconds rt = MainLoop::now()-runningCmdSentAt;
+      st.responses++;
+      st.totalResponseTime += rt;
+      if (rt>st.maxResponseTime) st.maxResponseTime = rt;
       // - deliver to waiting callback, if any
-      ESPPacketCB callback = cmdQueue.front().responseCB;
-      // - remove waiting marker from queue
-      cmdQueue.pop_front();
+      ESPPacketCB callback = runningCmd.responseCB;
+      // - done with running command
+      cmdWaitingForResponse = false;
+      runningCmd.commandPacket.reset();
+      runningCmd.responseCB = NULL;
       // - now call handler
       if (callback) {
         // pass packet and response status
@@ -1248,6 +1383,219 @@ void EnoceanComm::dispatchPacket(Esp3PacketPtr aPacket)
 }
 
 
+bool EnoceanComm::isDuplicateRadioPacket(Esp3PacketPtr aPacket)
+{
+  if (duplicateWindow<=0) return false; // de-duplication disabled
+  MLMicroSeconds now = MainLoop::now();
+  // FNV-1a hash over RORG, user data and status, but not the repeater count (differs between repeated copies)
+  uint32_t h = 2166136261u;
+  h = (h ^ (uint8_t)aPacket->eepRorg()) * 16777619u;
+  uint8_t *ud = aPacket->radioUserData();
+  size_t udl = aPacket->radioUserDataLength();
+  for (size_t i=0; i<udl; i++) {
+    h = (h ^ ud[i]) * 16777619u;
+  }
+  h = (h ^ (aPacket->radioStatus() & ~status_repeaterCount_mask)) * 16777619u;
+  EnoceanAddress sender = aPacket->radioSender();
+  EnoceanRecentTelegramMap::iterator pos = recentTelegrams.find(sender);
+  if (pos!=recentTelegrams.end()) {
+    EnoceanRecentTelegram &rt = pos->second;
+    if (rt.contentHash==h && now-rt.receivedAt<duplicateWindow) {
+      // same content from same sender within window -> duplicate
+      radioStats.duplicatesDropped++;
+      uint8_t rc = aPacket->radioRepeaterCount();
+      if (rc>rt.repeaterCount) radioStats.repeatedDropped++;
+      int dBm = aPacket->radioDBm();
+      FOCUSLOG("Dropped duplicate radio telegram from 0x%08X (repeated=%d, dBm=%d)", sender, rc, dBm);
+      if (dBm>rt.bestDBm) {
+        // better signal than any copy so far, let signal quality information reflect it
+        rt.bestDBm = dBm;
+        radioStats.strongerCopies++;
+        if (betterCopyHandler) betterCopyHandler(aPacket, ErrorPtr());
+      }
+      return true;
+    }
+  }
+  else if (recentTelegrams.size()>=ENOCEAN_MAX_RECENT_TELEGRAMS) {
+    // prevent unlimited growth from many (foreign) senders: forget expired entries
+    EnoceanRecentTelegramMap::iterator rpos = recentTelegrams.begin();
+    while (rpos!=recentTelegrams.end()) {
+      if (now-rpos->second.receivedAt>=duplicateWindow)
+        rpos = recentTelegrams.erase(rpos);
+      else
+        ++rpos;
+    }
+  }
+  // new telegram, remember it
+  EnoceanRecentTelegram &rt = recentTelegrams[sender];
+  rt.receivedAt = now;
+  rt.contentHash = h;
+  rt.repeaterCount = aPacket->radioRepeaterCount();
+  rt.bestDBm = aPacket->radioDBm();
+  return false;
+}
+
+
+// MARK: ===== traffic capture and replay
+
+void EnoceanComm::captureFrame(const uint8_t *aFrameP, size_t aFrameSize)
+{
+  if (replayInjecting) return; // do not record replayed frames again
+  PacketType pt = (PacketType)aFrameP[4];
+  if (pt!=pt_radio && pt!=pt_event_message) return; // responses only make sense for the commands that caused them
+  fprintf(captureFile, "%lld ", (long long)(MainLoop::now()-captureStartedAt));
+  for (size_t i=0; i<aFrameSize; i++) {
+    fprintf(captureFile, "%02X", aFrameP[i]);
+  }
+  fprintf(captureFile, "\n");
+  fflush(captureFile);
+}
+
+
+ErrorPtr EnoceanComm::startCapture(const string &aFilePath)
+{
+  stopCapture();
+  captureFile = fopen(aFilePath.c_str(), "w");
+  if (!captureFile) {
+    return TextError::err("cannot create capture file %s: %s", aFilePath.c_str(), strerror(errno));
+  }
+  captureStartedAt = MainLoop::now();
+  fprintf(captureFile, "# EnOcean ESP3 capture: <microseconds since capture start> <ESP3 frame as hex>\n");
+  LOG(LOG_NOTICE, "EnOcean: started capturing received telegrams into %s", aFilePath.c_str());
+  return ErrorPtr();
+}
+
+
+void EnoceanComm::stopCapture()
+{
+  if (captureFile) {
+    fclose(captureFile);
+    captureFile = NULL;
+    LOG(LOG_NOTICE, "EnOcean: stopped capturing received telegrams");
+  }
+}
+
+
+ErrorPtr EnoceanComm::replayCapture(const string &aFilePath, double aSpeed, StatusCB aDoneCB)
+{
+  if (isReplaying()) {
+    return TextError::err("replay already running");
+  }
+  FILE *file = fopen(aFilePath.c_str(), "r");
+  if (!file) {
+    return TextError::err("cannot open capture file %s: %s", aFilePath.c_str(), strerror(errno));
+  }
+  // read all frames beforehand, so file access does not distort the timing
+  replayFrames.clear();
+  string line;
+  int lineNo = 0;
+  ErrorPtr err;
+  while (string_fgetline(file, line)) {
+    lineNo++;
+    if (line.empty() || line[0]=='#') continue;
+    long long offs;
+    int n;
+    if (sscanf(line.c_str(), "%lld %n", &offs, &n)<1) {
+      err = TextError::err("capture file %s line %d: missing timestamp", aFilePath.c_str(), lineNo);
+      break;
+    }
+    EnoceanCapturedFrame f;
+    f.offset = offs;
+    f.frame = hexToBinaryString(line.c_str()+n, true);
+    if (f.frame.size()<ESP3_HEADERBYTES || (uint8_t)f.frame[0]!=ESP3_SYNCBYTE) {
+      err = TextError::err("capture file %s line %d: invalid ESP3 frame", aFilePath.c_str(), lineNo);
+      break;
+    }
+    replayFrames.push_back(f);
+  }
+  fclose(file);
+  if (Error::isOK(err) && replayFrames.empty()) {
+    err = TextError::err("capture file %s contains no frames", aFilePath.c_str());
+  }
+  if (!Error::isOK(err)) {
+    replayFrames.clear();
+    return err;
+  }
+  // start replay
+  LOG(LOG_NOTICE, "EnOcean: replaying %zu captured frames from %s at speed %.1f", replayFrames.size(), aFilePath.c_str(), aSpeed);
+  replayIndex = 0;
+  replaySpeed = aSpeed;
+  replayDoneCB = aDoneCB;
+  replayStats.reset();
+  replayStats.startedAt = MainLoop::now();
+  replayTicket = MainLoop::currentMainLoop().executeOnce(boost::bind(&EnoceanComm::replayNext, this));
+  return ErrorPtr();
+}
+
+
+void EnoceanComm::replayNext()
+{
+  replayTicket = 0;
+  MLMicroSeconds firstOffset = replayFrames.front().offset;
+  while (replayIndex<replayFrames.size()) {
+    EnoceanCapturedFrame &f = replayFrames[replayIndex];
+    MLMicroSeconds now = MainLoop::now();
+    if (replaySpeed>0) {
+      // timed replay
+      MLMicroSeconds due = replayStats.startedAt+(MLMicroSeconds)((f.offset-firstOffset)/replaySpeed);
+      if (due>now) {
+        replayTicket = MainLoop::currentMainLoop().executeOnce(boost::bind(&EnoceanComm::replayNext, this), due-now);
+        return;
+      }
+      if (now-due>replayStats.maxLag) replayStats.maxLag = now-due;
+    }
+    // feed frame into framer, measure time until processing returns
+    // Note: not via rxBuffer, which might hold a partial frame from the modem
+    replayInjecting = true;
+    scanFrames((const uint8_t *)f.frame.data(), f.frame.size());
+    replayInjecting = false;
+    MLMicroSeconds t = MainLoop::now()-now;
+    replayStats.frames++;
+    replayStats.bytes += f.frame.size();
+    replayStats.totalProcessing += t;
+    if (replayStats.frames==1 || t<replayStats.minProcessing) replayStats.minProcessing = t;
+    if (t>replayStats.maxProcessing) replayStats.maxProcessing = t;
+    replayIndex++;
+    if (replaySpeed<=0 && replayIndex<replayFrames.size()) {
+      // as fast as possible, but let mainloop run what processing has scheduled
+      replayTicket = MainLoop::currentMainLoop().executeOnce(boost::bind(&EnoceanComm::replayNext, this));
+      return;
+    }
+  }
+  replayFinished(ErrorPtr());
+}
+
+
+void EnoceanComm::stopReplay()
+{
+  if (isReplaying()) {
+    MainLoop::currentMainLoop().cancelExecutionTicket(replayTicket);
+    replayFinished(TextError::err("replay stopped after %llu of %zu frames", (unsigned long long)replayStats.frames, replayFrames.size()));
+  }
+}
+
+
+void EnoceanComm::replayFinished(ErrorPtr aError)
+{
+  replayStats.finishedAt = MainLoop::now();
+  replayFrames.clear();
+  replayIndex = 0;
+  LOG(LOG_NOTICE,
+    "EnOcean: replay finished: %llu frames in %.3f seconds, processing avg/min/max = %lld/%lld/%lld uS, max lag = %lld uS",
+    (unsigned long long)replayStats.frames,
+    (double)(replayStats.finishedAt-replayStats.startedAt)/Second,
+    (long long)(replayStats.frames>0 ? replayStats.totalProcessing/(MLMicroSeconds)replayStats.frames : 0),
+    (long long)replayStats.minProcessing,
+    (long long)replayStats.maxProcessing,
+    (long long)replayStats.maxLag
+  );
+  StatusCB cb = replayDoneCB;
+  replayDoneCB = NULL;
+  if (cb) cb(aError);
+}
+
+
+
 void EnoceanComm::flushLine()
 {
   ErrorPtr err;
@@ -1283,54 +1631,123 @@ void EnoceanComm::sendPacket(Esp3PacketPtr aPacket)
 
 
 
-void EnoceanComm::sendCommand(Esp3PacketPtr aCommandPacket, ESPPacketCB aResponsePacketCB)
+void EnoceanComm::sendCommand(Esp3PacketPtr aCommandPacket, ESPPacketCB aResponsePacketCB, EnoceanCmdPriority aPriority)
 {
+  if (aPriority==cmdprio_auto) {
+    aPriority = aCommandPacket->packetType()==pt_radio ? cmdprio_radio : cmdprio_management;
+  }
+  EnoceanCmdList &queue = cmdQueues[aPriority];
+  EnoceanCmdStatistics &st = cmdStats[aPriority];
+  if (collapseTelegrams && !aResponsePacketCB) {
+    // replace a not yet sent telegram to the same actuator (keeping its place in the queue)
+    for (EnoceanCmdList::iterator pos = queue.begin(); pos!=queue.end(); ++pos) {
+      if (!pos->responseCB && supersedesTelegram(aCommandPacket, pos->commandPacket)) {
+        FOCUSLOG("EnOcean: queued telegram to 0x%08X superseded by newer one", aCommandPacket->radioDestination());
+        pos->commandPacket = aCommandPacket;
+        st.collapsed++;
+        return;
+      }
+    }
+  }
   // queue command
   EnoceanCmd cmd;
   cmd.commandPacket = aCommandPacket;
   cmd.responseCB = aResponsePacketCB;
-  cmdQueue.push_back(cmd);
+  cmd.queuedAt = MainLoop::now();
+  queue.push_back(cmd);
+  if (queue.size()>st.maxQueueDepth) st.maxQueueDepth = queue.size();
   checkCmdQueue();
 }
 
 
+bool EnoceanComm::supersedesTelegram(Esp3PacketPtr aNewPacket, Esp3PacketPtr aOldPacket)
+{
+  if (aNewPacket->packetType()!=pt_radio || aOldPacket->packetType()!=pt_radio) return false;
+  RadioOrg rorg = aNewPacket->eepRorg();
+  if (rorg!=aOldPacket->eepRorg()) return false;
+  // RPS and 1BS telegrams are button/contact events, each of them counts
+  if (rorg!=rorg_4BS && rorg!=rorg_VLD) return false;
+  if (aNewPacket->radioHasTeachInfo() || aOldPacket->radioHasTeachInfo()) return false;
+  if (aNewPacket->radioDestination()!=aOldPacket->radioDestination() || aNewPacket->radioSender()!=aOldPacket->radioSender()) return false;
+  if (rorg==rorg_VLD) {
+    // VLD: only same command for same channel (command ID and channel are in the first two bytes in common actuator EEPs)
+    size_t l = aNewPacket->radioUserDataLength();
+    if (l!=aOldPacket->radioUserDataLength() || l<2) return false;
+    if (memcmp(aNewPacket->radioUserData(), aOldPacket->radioUserData(), 2)!=0) return false;
+  }
+  return true;
+}
+
+
 void EnoceanComm::checkCmdQueue()
 {
-  if (cmdQueue.empty()) return; // queue empty
-  EnoceanCmd cmd = cmdQueue.front();
-  if (cmd.commandPacket) {
-    // front is command to be sent -> send it
-    sendPacket(cmd.commandPacket);
-    // remove original entry, put waiting-for-response marker there instead
-    cmd.commandPacket.reset(); // clear out, marks this entry for "waiting for response"
-    cmdQueue.pop_front();
-    cmdQueue.push_front(cmd);
-    // schedule timeout
-    cmdTimeoutTicket = MainLoop::currentMainLoop().executeOnce(boost::bind(&EnoceanComm::cmdTimeout, this), ENOCEAN_ESP3_COMMAND_TIMEOUT);
+  if (cmdWaitingForResponse) return; // ESP3 allows only one command at a time
+  // select priority class
+  int prio = -1;
+  for (int p=0; p<numCmdPriorities; p++) {
+    if (!cmdQueues[p].empty() && cmdBypassed[p]>=ENOCEAN_CMD_MAX_BYPASS) {
+      // this class has waited long enough, give it a turn
+      prio = p;
+      break;
+    }
+  }
+  if (prio<0) {
+    // highest class with waiting commands
+    for (int p=0; p<numCmdPriorities; p++) {
+      if (!cmdQueues[p].empty()) {
+        prio = p;
+        break;
+      }
+    }
+  }
+  if (prio<0) return; // all queues empty
+  for (int p=prio+1; p<numCmdPriorities; p++) {
+    if (!cmdQueues[p].empty()) cmdBypassed[p]++;
   }
+  cmdBypassed[prio] = 0;
+  // send it
+  runningCmd = cmdQueues[prio].front();
+  cmdQueues[prio].pop_front();
+  runningCmdPriority = (EnoceanCmdPriority)prio;
+  runningCmdSentAt = MainLoop::now();
+  EnoceanCmdStatistics &st = cmdStats[prio];
+  MLMicroSeconds w = runningCmdSentAt-runningCmd.queuedAt;
+  st.sent++;
+  st.totalQueueWait += w;
+  if (w>st.maxQueueWait) st.maxQueueWait = w;
+  cmdWaitingForResponse = true;
+  sendPacket(runningCmd.commandPacket);
+  // schedule timeout
+  cmdTimeoutTicket = MainLoop::currentMainLoop().executeOnce(boost::bind(&EnoceanComm::cmdTimeout, this), ENOCEAN_ESP3_COMMAND_TIMEOUT);
 }
 
 
 void EnoceanComm::cmdTimeout()
 {
+  cmdTimeoutTicket = 0;
   // currently waiting command has timed out
-  if (cmdQueue.empty()) return; // queue empty -> NOP (should not happen, no timeout should be running when queue is empty!)
+  if (!cmdWaitingForResponse) return; // NOP (should not happen, no timeout should be running when no command is waiting!)
   FOCUSLOG("EnOcean Command timeout");
-  EnoceanCmd cmd = cmdQueue.front();
-  // Note: commandPacket should always be NULL here (because we are waiting for a response)
-  if (!cmd.commandPacket) {
-    // done with this command
-    // - remove from queue
-    cmdQueue.pop_front();
-    // - now call handler with error
-    if (cmd.responseCB) {
-      cmd.responseCB(Esp3PacketPtr(), ErrorPtr(new EnoceanCommError(EnoceanCommError::CmdTimeout)));
-    }
+  cmdStats[runningCmdPriority].timeouts++;
+  ESPPacketCB callback = runningCmd.responseCB;
+  // done with this command
+  cmdWaitingForResponse = false;
+  runningCmd.commandPacket.reset();
+  runningCmd.responseCB = NULL;
+  // - now call handler with error
+  if (callback) {
+    callback(Esp3PacketPtr(), ErrorPtr(new EnoceanCommError(EnoceanCommError::CmdTimeout)));
   }
   // check if more commands in queue to be sent
   checkCmdQueue();
 }
 
+
+void EnoceanComm::resetCommandStatistics()
+{
+  for (int p=0; p<numCmdPriorities; p++) cmdStats[p].reset();
+}
+
 #endif // ENABLE_ENOCEAN
 
 
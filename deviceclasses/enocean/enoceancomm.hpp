@@ -29,6 +29,8 @@
 #include "serialqueue.hpp"
 #include "digitalio.hpp"
 
+#include <boost/unordered_map.hpp>
+
 using namespace std;
 
 namespace p44 {
@@ -177,6 +179,14 @@ namespace p44 {
 
 	class EnoceanComm;
 
+  /// payload size (data+optdata+CRC) that fits into the packet object itself. Larger payloads use a heap buffer.
+  /// @note ERP1 radio telegrams including optional data and all common responses fit, VLD telegrams up to 14 bytes as well.
+  #define ESP3_INLINE_PAYLOAD_SIZE 40
+  /// max payload size (data+optdata+CRC) accepted, longer frames are considered corrupted
+  #define ESP3_MAX_PAYLOAD_SIZE 300
+  /// size of the receive buffer for the ESP3 framer. Must hold at least one max size frame (header+payload)
+  #define ESP3_RX_BUFFER_SIZE 512
+
   class Esp3Packet;
 	typedef boost::intrusive_ptr<Esp3Packet> Esp3PacketPtr;
 	/// ESP3 packet object with byte stream parser and generator
@@ -198,8 +208,9 @@ namespace p44 {
   private:
     // packet contents
     uint8_t header[6]; ///< the ESP3 header
-    uint8_t *payloadP; ///< the payload or NULL if none defined
+    uint8_t *payloadP; ///< the payload or NULL if none defined, points to inlinePayload for small payloads
     size_t payloadSize; ///< the payload size
+    uint8_t inlinePayload[ESP3_INLINE_PAYLOAD_SIZE]; ///< storage for small payloads, avoids a heap buffer per packet
     // scanner
     PacketState state; ///< scanning state
     size_t dataIndex; ///< data scanner index
@@ -210,6 +221,16 @@ namespace p44 {
     Esp3Packet();
     virtual ~Esp3Packet();
 
+    /// @name packet object recycling
+    /// @note every received telegram creates a packet object, and most of them are released again
+    ///   right after dispatching. Released packet objects are kept in a free list and reused, so
+    ///   steady-state radio traffic does not need heap allocations. Not thread safe, packets are
+    ///   used from the mainloop thread only.
+    /// @{
+    static void *operator new(size_t aSize);
+    static void operator delete(void *aPtr, size_t aSize);
+    /// @}
+
     /// add one byte to a ESP3 CRC8
     /// @param aByte the byte to add
     /// @param aCRCValue the current CRC
@@ -220,7 +241,7 @@ namespace p44 {
     /// @param aNumBytes number of bytes
     /// @param aCRCValue start value, feed in existing CRC to continue adding bytes. Defaults to 0.
     /// @return updated CRC
-    static uint8_t crc8(uint8_t *aDataP, size_t aNumBytes, uint8_t aCRCValue = 0);
+    static uint8_t crc8(const uint8_t *aDataP, size_t aNumBytes, uint8_t aCRCValue = 0);
 
     /// clear the packet so that we can re-start accepting bytes and looking for packet start or
     /// start filling in information for creating an outgoing packet
@@ -238,6 +259,12 @@ namespace p44 {
     /// @return number of bytes operation could accept, 0 if none (means that packet is already complete)
     size_t acceptBytes(size_t aNumBytes, const uint8_t *aBytes, bool aNoChecks = false);
 
+    /// set packet contents from a complete, already validated ESP3 frame
+    /// @param aFrameP pointer to the frame, starting with the sync byte. Header and payload
+    ///   size fields must be consistent with the buffer, which must hold header and payload.
+    /// @note packet is complete after this call
+    void assignFrame(const uint8_t *aFrameP);
+
 
     /// finalize packet to make it ready for sending (complete header fields, calculate CRCs)
     void finalize();
@@ -412,22 +439,124 @@ namespace p44 {
 
   typedef boost::function<void (Esp3PacketPtr aEsp3PacketPtr, ErrorPtr aError)> ESPPacketCB;
 
+  /// command priority classes, in order of decreasing priority
+  typedef enum {
+    cmdprio_radio, ///< outgoing radio telegrams (actuator commands, teach-in responses)
+    cmdprio_poll, ///< periodic queries (modem alive check)
+    cmdprio_management, ///< modem setup and management commands
+    numCmdPriorities,
+    cmdprio_auto = numCmdPriorities ///< derive from packet: radio telegrams are cmdprio_radio, everything else cmdprio_management
+  } EnoceanCmdPriority;
+
   typedef struct {
-    Esp3PacketPtr commandPacket; ///< packet to send. If empty, this means we are waiting for the response
+    Esp3PacketPtr commandPacket; ///< packet to send
     ESPPacketCB responseCB; ///< callback to call when response arrives
+    MLMicroSeconds queuedAt; ///< when the command was queued
   } EnoceanCmd;
 
   typedef std::list<EnoceanCmd> EnoceanCmdList;
 
+
+  /// command queue statistics (per priority class)
+  class EnoceanCmdStatistics
+  {
+  public:
+    EnoceanCmdStatistics() { reset(); };
+    void reset() { sent = 0; responses = 0; timeouts = 0; collapsed = 0; maxQueueDepth = 0; totalQueueWait = 0; maxQueueWait = 0; totalResponseTime = 0; maxResponseTime = 0; };
+
+    uint64_t sent; ///< commands sent to the modem
+    uint64_t responses; ///< responses received
+    uint64_t timeouts; ///< commands that got no response in time
+    uint64_t collapsed; ///< radio telegrams replaced by a newer one to the same actuator before being sent
+    size_t maxQueueDepth; ///< max number of commands waiting in the queue
+    MLMicroSeconds totalQueueWait; ///< sum of times commands waited in the queue before being sent
+    MLMicroSeconds maxQueueWait; ///< longest time a command waited in the queue
+    MLMicroSeconds totalResponseTime; ///< sum of times from sending to receiving the response
+    MLMicroSeconds maxResponseTime; ///< longest time from sending to receiving the response
+  };
+
+
+  /// radio telegram reception statistics
+  class EnoceanRadioStatistics
+  {
+  public:
+    EnoceanRadioStatistics() { reset(); };
+    void reset() { telegrams = 0; dispatched = 0; duplicatesDropped = 0; repeatedDropped = 0; strongerCopies = 0; };
+
+    uint64_t telegrams; ///< radio telegrams received from the modem
+    uint64_t dispatched; ///< radio telegrams passed on to the radio packet handler
+    uint64_t duplicatesDropped; ///< copies dropped as duplicates of an already dispatched telegram (all causes)
+    uint64_t repeatedDropped; ///< of duplicatesDropped, copies that came via more repeaters than the dispatched one
+    uint64_t strongerCopies; ///< of duplicatesDropped, copies received with better signal than the dispatched one
+  };
+
+
+  /// state of the most recently dispatched radio telegram of a sender, for duplicate detection
+  typedef struct {
+    MLMicroSeconds receivedAt; ///< when the dispatched copy was received
+    uint32_t contentHash; ///< hash over the radio user data and status (without repeater count)
+    uint8_t repeaterCount; ///< repeater count of the dispatched copy
+    int bestDBm; ///< best signal strength seen among all copies
+  } EnoceanRecentTelegram;
+
+  typedef boost::unordered_map<EnoceanAddress, EnoceanRecentTelegram> EnoceanRecentTelegramMap;
+
+
+  /// traffic capture replay statistics
+  class EnoceanReplayStatistics
+  {
+  public:
+    EnoceanReplayStatistics() { reset(); };
+    void reset() { frames = 0; bytes = 0; totalProcessing = 0; minProcessing = 0; maxProcessing = 0; maxLag = 0; startedAt = Never; finishedAt = Never; };
+
+    uint64_t frames; ///< frames fed into the receiver so far
+    uint64_t bytes; ///< bytes fed into the receiver so far
+    MLMicroSeconds totalProcessing; ///< sum of synchronous processing times of all frames
+    MLMicroSeconds minProcessing; ///< shortest processing time of a single frame
+    MLMicroSeconds maxProcessing; ///< longest processing time of a single frame
+    MLMicroSeconds maxLag; ///< max delay of a frame behind its (timed) schedule, i.e. how far the mainloop fell behind
+    MLMicroSeconds startedAt; ///< when replay started
+    MLMicroSeconds finishedAt; ///< when replay finished, Never while still running
+  };
+
+
+  /// a frame read from a traffic capture file
+  typedef struct {
+    MLMicroSeconds offset; ///< time of reception relative to start of capture
+    string frame; ///< complete ESP3 frame including sync byte and CRCs
+  } EnoceanCapturedFrame;
+
+  typedef std::vector<EnoceanCapturedFrame> EnoceanCapturedFrameVector;
+
+
   typedef boost::intrusive_ptr<EnoceanComm> EnoceanCommPtr;
 	// Enocean communication
 	class EnoceanComm : public SerialOperationQueue
 	{
 		typedef SerialOperationQueue inherited;
 		
-		Esp3PacketPtr currentIncomingPacket;
+    // ESP3 framer
+    uint8_t rxBuffer[ESP3_RX_BUFFER_SIZE]; ///< received bytes not yet consumed as complete frames
+    size_t rxBufferBytes; ///< number of bytes in rxBuffer
     ESPPacketCB radioPacketHandler;
     ESPPacketCB eventPacketHandler;
+    ESPPacketCB betterCopyHandler;
+
+    // radio telegram de-duplication
+    MLMicroSeconds duplicateWindow; ///< copies of the same telegram within this time are dropped, 0 = no de-duplication
+    EnoceanRecentTelegramMap recentTelegrams; ///< most recent dispatched telegram per sender
+    EnoceanRadioStatistics radioStats;
+
+    // traffic capture and replay
+    FILE *captureFile; ///< if not NULL, received radio and event frames are recorded here
+    MLMicroSeconds captureStartedAt;
+    EnoceanCapturedFrameVector replayFrames; ///< frames of the capture being replayed
+    size_t replayIndex; ///< next frame to replay
+    double replaySpeed; ///< speed factor relative to recorded timing, 0 = as fast as possible
+    bool replayInjecting; ///< set while a replayed frame is being processed (prevents re-capturing it)
+    long replayTicket;
+    StatusCB replayDoneCB;
+    EnoceanReplayStatistics replayStats;
 
     DigitalIoPtr enoceanResetPin;
     long aliveCheckTicket;
@@ -439,8 +568,15 @@ namespace p44 {
     EnoceanAddress myIdBase; ///< base address for creating other sender addresses than my own module address (e.g. to simulate switches to control actors)
 
     // Command queue
-    EnoceanCmdList cmdQueue; ///< commands awaiting send or receive
+    EnoceanCmdList cmdQueues[numCmdPriorities]; ///< commands awaiting send, per priority class
+    int cmdBypassed[numCmdPriorities]; ///< how many commands of higher classes were sent in a row while this class was waiting
+    bool cmdWaitingForResponse; ///< set while runningCmd awaits its response
+    EnoceanCmd runningCmd; ///< command sent, awaiting response
+    EnoceanCmdPriority runningCmdPriority;
+    MLMicroSeconds runningCmdSentAt;
     long cmdTimeoutTicket; ///< timeout for waiting for command response
+    bool collapseTelegrams; ///< if set, queued radio telegrams are replaced by newer ones to the same actuator
+    EnoceanCmdStatistics cmdStats[numCmdPriorities];
 
 	public:
 		
@@ -486,6 +622,58 @@ namespace p44 {
     /// @param aRadioPacketCB callback to deliver radio packets to
     void setEventPacketHandler(ESPPacketCB aEventPacketCB);
 
+    /// set callback to handle dropped duplicate radio packets that were received with a better
+    /// signal strength than the copy that was dispatched (to update signal quality information)
+    /// @param aBetterCopyCB callback to deliver better copies of already dispatched radio packets to
+    void setBetterCopyHandler(ESPPacketCB aBetterCopyCB);
+
+    /// set the radio telegram de-duplication window
+    /// @param aWindow copies of a telegram (subtelegrams, repeated copies) received within this time after
+    ///   the first copy are not dispatched. 0 disables de-duplication.
+    /// @note only consecutive telegrams of the same sender are compared, so quickly repeated identical user
+    ///   actions (like press-release-press) are not affected
+    void setDuplicateWindow(MLMicroSeconds aWindow) { duplicateWindow = aWindow; };
+
+    /// @return current de-duplication window
+    MLMicroSeconds getDuplicateWindow() { return duplicateWindow; };
+
+    /// @return radio reception statistics
+    const EnoceanRadioStatistics &radioStatistics() { return radioStats; };
+
+    /// reset radio reception statistics
+    void resetRadioStatistics() { radioStats.reset(); };
+
+    /// start recording received radio and event frames into a capture file
+    /// @param aFilePath file to write the capture to (will be overwritten)
+    /// @note the capture format is line based text: lines starting with # are comments, all others consist of
+    ///   the reception time in microseconds relative to capture start, followed by the complete ESP3 frame
+    ///   (including sync byte and CRCs) as hex bytes.
+    /// @return error if file cannot be created
+    ErrorPtr startCapture(const string &aFilePath);
+
+    /// stop recording frames
+    void stopCapture();
+
+    /// @return true if capture is running
+    bool isCapturing() { return captureFile!=NULL; };
+
+    /// replay a capture through the receiver (framer, de-duplication and packet handlers), as if received from the modem
+    /// @param aFilePath capture file as written by startCapture()
+    /// @param aSpeed speed factor relative to the recorded timing (1 = real time, 10 = ten times faster),
+    ///   0 = as fast as possible, only yielding to the mainloop between frames
+    /// @param aDoneCB called when all frames are replayed or replay is stopped
+    /// @return error if capture cannot be read or a replay is already running
+    ErrorPtr replayCapture(const string &aFilePath, double aSpeed, StatusCB aDoneCB);
+
+    /// stop running replay (done callback will be called)
+    void stopReplay();
+
+    /// @return true if replay is running
+    bool isReplaying() { return replayIndex<replayFrames.size(); };
+
+    /// @return statistics of the running or last replay
+    const EnoceanReplayStatistics &replayStatistics() { return replayStats; };
+
     /// send flush, i.e. a row of zeroes to re-sync EnOcean modem
     void flushLine();
 
@@ -495,7 +683,25 @@ namespace p44 {
 
     /// send a command and await response
     /// @param aResponsePacketCB callback to deliver command response to
-    void sendCommand(Esp3PacketPtr aCommandPacket, ESPPacketCB aResponsePacketCB);
+    /// @param aPriority priority class to queue the command in. Higher classes are sent first, but
+    ///   lower classes still get a turn after a few commands of higher classes.
+    /// @note only one command is outstanding at a time (ESP3 requires waiting for the response before sending the next one)
+    void sendCommand(Esp3PacketPtr aCommandPacket, ESPPacketCB aResponsePacketCB, EnoceanCmdPriority aPriority = cmdprio_auto);
+
+    /// enable/disable collapsing queued radio telegrams
+    /// @param aCollapse if set, a radio telegram still waiting in the queue is replaced by a newer one
+    ///   to the same actuator (only 4BS and VLD data telegrams without response callback)
+    void setCollapseTelegrams(bool aCollapse) { collapseTelegrams = aCollapse; };
+
+    /// @return true if collapsing queued radio telegrams is enabled
+    bool getCollapseTelegrams() { return collapseTelegrams; };
+
+    /// @param aPriority priority class
+    /// @return command queue statistics for the priority class
+    const EnoceanCmdStatistics &commandStatistics(EnoceanCmdPriority aPriority) { return cmdStats[aPriority]; };
+
+    /// reset command queue statistics of all priority classes
+    void resetCommandStatistics();
 
     /// manufacturer name lookup
     /// @param aManufacturerCode EEP manufacturer code
@@ -528,6 +734,14 @@ namespace p44 {
 
     void checkCmdQueue();
     void cmdTimeout();
+    static bool supersedesTelegram(Esp3PacketPtr aNewPacket, Esp3PacketPtr aOldPacket);
+
+    bool isDuplicateRadioPacket(Esp3PacketPtr aPacket);
+
+    size_t scanFrames(const uint8_t *aBuffer, size_t aNumBytes);
+    void captureFrame(const uint8_t *aFrameP, size_t aFrameSize);
+    void replayNext();
+    void replayFinished(ErrorPtr aError);
 
 	};
 
@@ -284,6 +284,16 @@ void EnoceanDevice::handleRadioPacket(Esp3PacketPtr aEsp3PacketPtr)
 }
 
 
+void EnoceanDevice::updateRadioQuality(Esp3PacketPtr aEsp3PacketPtr)
+{
+  int dBm = aEsp3PacketPtr->radioDBm();
+  if (dBm>lastRSSI) {
+    lastRSSI = dBm;
+    lastRepeaterCount = aEsp3PacketPtr->radioRepeaterCount();
+  }
+}
+
+
 void EnoceanDevice::checkPresence(PresenceCB aPresenceResultHandler)
 {
   bool present = true;
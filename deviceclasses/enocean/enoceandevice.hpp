@@ -152,6 +152,10 @@ namespace p44 {
     /// @return time when last packet was received or Never
     MLMicroSeconds getLastPacketTime() { return lastPacketTime; };
 
+    /// update radio signal quality information from a better copy of the last received packet
+    /// @param aEsp3PacketPtr a (not otherwise processed) copy of the last packet, received with better signal
+    void updateRadioQuality(Esp3PacketPtr aEsp3PacketPtr);
+
     /// check presence of this addressable
     /// @param aPresenceResultHandler will be called to report presence status
     virtual void checkPresence(PresenceCB aPresenceResultHandler);
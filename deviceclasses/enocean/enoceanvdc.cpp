@@ -127,6 +127,7 @@ void EnoceanVdc::collectDevices(StatusCB aCompletedCB, bool aIncremental, bool a
   // install standard packet handler
   enoceanComm.setRadioPacketHandler(boost::bind(&EnoceanVdc::handleRadioPacket, this, _1, _2));
   enoceanComm.setEventPacketHandler(boost::bind(&EnoceanVdc::handleEventPacket, this, _1, _2));
+  enoceanComm.setBetterCopyHandler(boost::bind(&EnoceanVdc::handleBetterCopy, this, _1, _2));
   // incrementally collecting EnOcean devices makes no sense as the set of devices is defined by learn-in (DB state)
   if (!aIncremental) {
     // start with zero
@@ -165,7 +166,7 @@ bool EnoceanVdc::addKnownDevice(EnoceanDevicePtr aEnoceanDevice)
 {
   if (inherited::addDevice(aEnoceanDevice)) {
     // not a duplicate, actually added - add to my own list
-    enoceanDevices.insert(make_pair(aEnoceanDevice->getAddress(), aEnoceanDevice));
+    enoceanDevices[aEnoceanDevice->getAddress()].push_back(aEnoceanDevice);
     return true;
   }
   return false;
@@ -198,14 +199,16 @@ void EnoceanVdc::removeDevice(DevicePtr aDevice, bool aForget)
     // - remove single device from superclass
     inherited::removeDevice(aDevice, aForget);
     // - remove only selected subdevice from my own list, other subdevices might be other devices
-    EnoceanDeviceMap::iterator pos = enoceanDevices.lower_bound(ed->getAddress());
-    while (pos!=enoceanDevices.upper_bound(ed->getAddress())) {
-      if (pos->second->getSubDevice()==ed->getSubDevice()) {
-        // this is the subdevice we want deleted
-        enoceanDevices.erase(pos);
-        break; // done
+    EnoceanDeviceMap::iterator pos = enoceanDevices.find(ed->getAddress());
+    if (pos!=enoceanDevices.end()) {
+      EnoceanDeviceList &devs = pos->second;
+      for (EnoceanDeviceList::iterator dpos = devs.begin(); dpos!=devs.end(); ++dpos) {
+        if ((*dpos)->getSubDevice()==ed->getSubDevice()) {
+          // this is the subdevice we want deleted
+          devs.erase(dpos);
+          break; // done
+        }
       }
-      pos++;
     }
   }
 }
@@ -217,11 +220,14 @@ void EnoceanVdc::unpairDevicesByAddress(EnoceanAddress aEnoceanAddress, bool aFo
   typedef list<EnoceanDevicePtr> TbdList;
   TbdList toBeDeleted;
   // collect those we need to remove
-  for (EnoceanDeviceMap::iterator pos = enoceanDevices.lower_bound(aEnoceanAddress); pos!=enoceanDevices.upper_bound(aEnoceanAddress); ++pos) {
-    // check subdevice index
-    EnoceanSubDevice i = pos->second->getSubDevice();
-    if (i>=aFromIndex && ((aNumIndices==0) || (i<aFromIndex+aNumIndices))) {
-      toBeDeleted.push_back(pos->second);
+  EnoceanDeviceMap::iterator pos = enoceanDevices.find(aEnoceanAddress);
+  if (pos!=enoceanDevices.end()) {
+    for (EnoceanDeviceList::iterator dpos = pos->second.begin(); dpos!=pos->second.end(); ++dpos) {
+      // check subdevice index
+      EnoceanSubDevice i = (*dpos)->getSubDevice();
+      if (i>=aFromIndex && ((aNumIndices==0) || (i<aFromIndex+aNumIndices))) {
+        toBeDeleted.push_back(*dpos);
+      }
     }
   }
   // now call vanish (which will in turn remove devices from the container's list
@@ -231,6 +237,129 @@ void EnoceanVdc::unpairDevicesByAddress(EnoceanAddress aEnoceanAddress, bool aFo
 }
 
 
+// MARK: ===== property access
+
+enum {
+  radioStatistics_key,
+  duplicateWindow_key,
+  commandStatistics_key,
+  collapseTelegrams_key,
+  numEnoceanVdcProperties
+};
+
+static char enoceanvdc_key;
+
+
+int EnoceanVdc::numProps(int aDomain, PropertyDescriptorPtr aParentDescriptor)
+{
+  // Note: only add my own count when accessing root level properties!!
+  if (aParentDescriptor->isRootOfObject()) {
+    // Accessing properties at the vdc (root) level, add mine
+    return inherited::numProps(aDomain, aParentDescriptor)+numEnoceanVdcProperties;
+  }
+  // just return base class' count
+  return inherited::numProps(aDomain, aParentDescriptor);
+}
+
+
+PropertyDescriptorPtr EnoceanVdc::getDescriptorByIndex(int aPropIndex, int aDomain, PropertyDescriptorPtr aParentDescriptor)
+{
+  static const PropertyDescription properties[numEnoceanVdcProperties] = {
+    { "x-p44-radioStatistics", apivalue_null, radioStatistics_key, OKEY(enoceanvdc_key) },
+    { "x-p44-duplicateWindow", apivalue_double, duplicateWindow_key, OKEY(enoceanvdc_key) },
+    { "x-p44-commandStatistics", apivalue_null, commandStatistics_key, OKEY(enoceanvdc_key) },
+    { "x-p44-collapseTelegrams", apivalue_bool, collapseTelegrams_key, OKEY(enoceanvdc_key) },
+  };
+  if (aParentDescriptor->isRootOfObject()) {
+    // root level - accessing properties on the vdc level
+    int n = inherited::numProps(aDomain, aParentDescriptor);
+    if (aPropIndex<n)
+      return inherited::getDescriptorByIndex(aPropIndex, aDomain, aParentDescriptor); // base class' property
+    aPropIndex -= n; // rebase to 0 for my own first property
+    return PropertyDescriptorPtr(new StaticPropertyDescriptor(&properties[aPropIndex], aParentDescriptor));
+  }
+  // other level
+  return inherited::getDescriptorByIndex(aPropIndex, aDomain, aParentDescriptor); // base class' property
+}
+
+
+bool EnoceanVdc::accessField(PropertyAccessMode aMode, ApiValuePtr aPropValue, PropertyDescriptorPtr aPropertyDescriptor)
+{
+  if (aPropertyDescriptor->hasObjectKey(enoceanvdc_key)) {
+    if (aMode==access_read) {
+      switch (aPropertyDescriptor->fieldKey()) {
+        case radioStatistics_key:
+          aPropValue->setType(apivalue_object); // make object (incoming object is NULL)
+          getRadioStatistics(aPropValue);
+          return true;
+        case duplicateWindow_key:
+          aPropValue->setDoubleValue((double)enoceanComm.getDuplicateWindow()/Second);
+          return true;
+        case commandStatistics_key:
+          aPropValue->setType(apivalue_object); // make object (incoming object is NULL)
+          getCommandStatistics(aPropValue);
+          return true;
+        case collapseTelegrams_key:
+          aPropValue->setBoolValue(enoceanComm.getCollapseTelegrams());
+          return true;
+      }
+    }
+    else {
+      switch (aPropertyDescriptor->fieldKey()) {
+        case radioStatistics_key:
+          // writing any value resets the counters
+          enoceanComm.resetRadioStatistics();
+          return true;
+        case duplicateWindow_key:
+          enoceanComm.setDuplicateWindow(aPropValue->doubleValue()*Second);
+          return true;
+        case commandStatistics_key:
+          // writing any value resets the counters
+          enoceanComm.resetCommandStatistics();
+          return true;
+        case collapseTelegrams_key:
+          enoceanComm.setCollapseTelegrams(aPropValue->boolValue());
+          return true;
+      }
+    }
+  }
+  // not my field, let base class handle it
+  return inherited::accessField(aMode, aPropValue, aPropertyDescriptor);
+}
+
+
+void EnoceanVdc::getRadioStatistics(ApiValuePtr aStats)
+{
+  const EnoceanRadioStatistics &st = enoceanComm.radioStatistics();
+  aStats->add("telegrams", aStats->newUint64(st.telegrams));
+  aStats->add("dispatched", aStats->newUint64(st.dispatched));
+  aStats->add("duplicatesDropped", aStats->newUint64(st.duplicatesDropped));
+  aStats->add("repeatedDropped", aStats->newUint64(st.repeatedDropped));
+  aStats->add("strongerCopies", aStats->newUint64(st.strongerCopies));
+}
+
+
+void EnoceanVdc::getCommandStatistics(ApiValuePtr aStats)
+{
+  static const char *classNames[numCmdPriorities] = { "radio", "poll", "management" };
+  for (int p=0; p<numCmdPriorities; p++) {
+    const EnoceanCmdStatistics &st = enoceanComm.commandStatistics((EnoceanCmdPriority)p);
+    ApiValuePtr c = aStats->newObject();
+    c->add("sent", c->newUint64(st.sent));
+    c->add("responses", c->newUint64(st.responses));
+    c->add("timeouts", c->newUint64(st.timeouts));
+    c->add("collapsed", c->newUint64(st.collapsed));
+    c->add("maxQueueDepth", c->newUint64(st.maxQueueDepth));
+    c->add("avgQueueWait", c->newDouble(st.sent>0 ? (double)st.totalQueueWait/st.sent/Second : 0));
+    c->add("maxQueueWait", c->newDouble((double)st.maxQueueWait/Second));
+    c->add("avgResponseTime", c->newDouble(st.responses>0 ? (double)st.totalResponseTime/st.responses/Second : 0));
+    c->add("maxResponseTime", c->newDouble((double)st.maxResponseTime/Second));
+    aStats->add(classNames[p], c);
+  }
+}
+
+
+
 // MARK: ===== EnOcean specific methods
 
 
@@ -245,6 +374,14 @@ ErrorPtr EnoceanVdc::handleMethod(VdcApiRequestPtr aRequest, const string &aMeth
     // simulate reception of a ESP packet
     respErr = simulatePacket(aRequest, aParams);
   }
+  else if (aMethod=="x-p44-captureTraffic") {
+    // start or stop recording received telegrams
+    respErr = captureTraffic(aRequest, aParams);
+  }
+  else if (aMethod=="x-p44-replayCapture") {
+    // replay recorded telegrams
+    respErr = replayCapture(aRequest, aParams);
+  }
   else {
     respErr = inherited::handleMethod(aRequest, aMethod, aParams);
   }
@@ -273,7 +410,9 @@ ErrorPtr EnoceanVdc::addProfile(VdcApiRequestPtr aRequest, ApiValuePtr aParams)
         string usedOffsetMap;
         usedOffsetMap.assign(128,'0');
         for (EnoceanDeviceMap::iterator pos = enoceanDevices.begin(); pos!=enoceanDevices.end(); ++pos) {
-          pos->second->markUsedBaseOffsets(usedOffsetMap);
+          for (EnoceanDeviceList::iterator dpos = pos->second.begin(); dpos!=pos->second.end(); ++dpos) {
+            (*dpos)->markUsedBaseOffsets(usedOffsetMap);
+          }
         }
         addr &= 0xFF; // extract offset
         if (addr==0xFF) {
@@ -351,6 +490,96 @@ ErrorPtr EnoceanVdc::simulatePacket(VdcApiRequestPtr aRequest, ApiValuePtr aPara
 
 
 
+ErrorPtr EnoceanVdc::captureFilePath(const string &aName, string &aPath)
+{
+  // only simple names, capture files are always enocean_capture_<name>.esp3 in the persistent data directory
+  // (so no API client can touch any other file, in particular not the settings databases)
+  if (aName.empty()) {
+    return WebError::webErr(400, "missing capture name");
+  }
+  for (size_t i=0; i<aName.size(); i++) {
+    char c = aName[i];
+    if (!isalnum((unsigned char)c) && c!='_' && c!='-') {
+      return WebError::webErr(400, "capture name may only contain letters, digits, '_' and '-'");
+    }
+  }
+  aPath = string_format("%senocean_capture_%s.esp3", getPersistentDataDir(), aName.c_str());
+  return ErrorPtr();
+}
+
+
+ErrorPtr EnoceanVdc::captureTraffic(VdcApiRequestPtr aRequest, ApiValuePtr aParams)
+{
+  ApiValuePtr o = aParams->get("file");
+  if (!o || o->stringValue().empty()) {
+    // no file: stop capturing
+    enoceanComm.stopCapture();
+    return Error::ok();
+  }
+  string path;
+  ErrorPtr respErr = captureFilePath(o->stringValue(), path);
+  if (!Error::isOK(respErr)) return respErr;
+  respErr = enoceanComm.startCapture(path);
+  if (!Error::isOK(respErr)) {
+    return WebError::webErr(500, "%s", respErr->description().c_str());
+  }
+  return Error::ok();
+}
+
+
+ErrorPtr EnoceanVdc::replayCapture(VdcApiRequestPtr aRequest, ApiValuePtr aParams)
+{
+  ApiValuePtr o = aParams->get("stop");
+  if (o && o->boolValue()) {
+    // stop running replay (which will send the answer to the request that started it)
+    enoceanComm.stopReplay();
+    return Error::ok();
+  }
+  ErrorPtr respErr = checkParam(aParams, "file", o); // capture name as used with x-p44-captureTraffic
+  string file;
+  if (Error::isOK(respErr)) {
+    respErr = captureFilePath(o->stringValue(), file);
+  }
+  if (Error::isOK(respErr)) {
+    double speed = 1; // default to real time
+    o = aParams->get("speed"); // 0 = as fast as possible
+    if (o) speed = o->doubleValue();
+    respErr = enoceanComm.replayCapture(file, speed, boost::bind(&EnoceanVdc::replayDone, this, aRequest, _1));
+    if (!Error::isOK(respErr)) {
+      respErr = WebError::webErr(400, "%s", respErr->description().c_str());
+    }
+    // if ok, answer will be sent when replay is done
+  }
+  return respErr;
+}
+
+
+void EnoceanVdc::replayDone(VdcApiRequestPtr aRequest, ErrorPtr aError)
+{
+  if (!Error::isOK(aError)) {
+    aRequest->sendError(aError);
+    return;
+  }
+  const EnoceanReplayStatistics &st = enoceanComm.replayStatistics();
+  MLMicroSeconds duration = st.finishedAt-st.startedAt;
+  ApiValuePtr r = aRequest->newApiValue();
+  r->setType(apivalue_object);
+  r->add("frames", r->newUint64(st.frames));
+  r->add("bytes", r->newUint64(st.bytes));
+  r->add("duration", r->newDouble((double)duration/Second));
+  // effective rate (limited by timing of the capture unless replayed as fast as possible)
+  r->add("framesPerSecond", r->newDouble(duration>0 ? (double)st.frames*Second/duration : 0));
+  // max rate the receive path could sustain (synchronous processing only)
+  r->add("processingCapacity", r->newDouble(st.totalProcessing>0 ? (double)st.frames*Second/st.totalProcessing : 0));
+  r->add("avgProcessing", r->newDouble(st.frames>0 ? (double)st.totalProcessing/st.frames/Second : 0));
+  r->add("minProcessing", r->newDouble((double)st.minProcessing/Second));
+  r->add("maxProcessing", r->newDouble((double)st.maxProcessing/Second));
+  r->add("maxLag", r->newDouble((double)st.maxLag/Second));
+  aRequest->sendResult(r);
+}
+
+
+
 // MARK: ===== learn and unlearn devices
 
 #define MIN_LEARN_DBM -50
@@ -362,7 +591,8 @@ Tristate EnoceanVdc::processLearn(EnoceanAddress aDeviceAddress, EnoceanProfile
 {
   // no learn/unlearn actions detected so far
   // - check if we know that device address already. If so, it is a learn-out
-  bool learnIn = enoceanDevices.find(aDeviceAddress)==enoceanDevices.end();
+  EnoceanDeviceMap::iterator pos = enoceanDevices.find(aDeviceAddress);
+  bool learnIn = pos==enoceanDevices.end() || pos->second.empty();
   if (learnIn) {
     // new device learned in, add logical devices for it
     if  (onlyEstablish!=no) {
@@ -413,33 +643,60 @@ void EnoceanVdc::handleRadioPacket(Esp3PacketPtr aEsp3PacketPtr, ErrorPtr aError
       }
     } // learn action
     else {
-      LOG(LOG_INFO, "Learn mode enabled: Received non-learn EnOcean packet -> ignored: %s", aEsp3PacketPtr->description().c_str());
+      if (LOGENABLED(LOG_INFO)) {
+        LOG(LOG_INFO, "Learn mode enabled: Received non-learn EnOcean packet -> ignored: %s", aEsp3PacketPtr->description().c_str());
+      }
     }
   }
   else {
     // not learning mode, dispatch packet to all devices known for that address
     bool reachedDevice = false;
-    for (EnoceanDeviceMap::iterator pos = enoceanDevices.lower_bound(aEsp3PacketPtr->radioSender()); pos!=enoceanDevices.upper_bound(aEsp3PacketPtr->radioSender()); ++pos) {
-      if (aEsp3PacketPtr->radioHasTeachInfo(MIN_LEARN_DBM, false) && aEsp3PacketPtr->eepRorg()!=rorg_RPS) {
-        // learning packet in non-learn mode -> report as non-regular user action, might be attempt to identify a device
-        // Note: RPS devices are excluded because for these all telegrams are regular user actions.
+    EnoceanDeviceMap::iterator pos = enoceanDevices.find(aEsp3PacketPtr->radioSender());
+    if (pos!=enoceanDevices.end() && !pos->second.empty()) {
+      // learning packet in non-learn mode -> report as non-regular user action, might be attempt to identify a device
+      // Note: RPS devices are excluded because for these all telegrams are regular user actions.
+      // Note: evaluated once per packet, not per subdevice
+      bool identifyAction = aEsp3PacketPtr->eepRorg()!=rorg_RPS && aEsp3PacketPtr->radioHasTeachInfo(MIN_LEARN_DBM, false);
+      // Note: index based, the list stays valid (but might shrink) when handlers remove devices
+      EnoceanDeviceList &devs = pos->second;
+      for (size_t i=0; i<devs.size(); ++i) {
+        EnoceanDevicePtr dev = devs[i];
         // signalDeviceUserAction() will be called from button and binary input behaviours
-        if (getVdcHost().signalDeviceUserAction(*(pos->second), false)) {
+        if (identifyAction && getVdcHost().signalDeviceUserAction(*dev, false)) {
           // consumed for device identification purposes, suppress further processing
           break;
         }
+        // handle regularily (might be RPS switch which does not have separate learn/action packets
+        dev->handleRadioPacket(aEsp3PacketPtr);
+        reachedDevice = true;
       }
-      // handle regularily (might be RPS switch which does not have separate learn/action packets
-      pos->second->handleRadioPacket(aEsp3PacketPtr);
-      reachedDevice = true;
     }
-    if (!reachedDevice) {
+    if (!reachedDevice && LOGENABLED(LOG_INFO)) {
       LOG(LOG_INFO, "Received EnOcean packet not directed to any known device -> ignored: %s", aEsp3PacketPtr->description().c_str());
     }
   }
 }
 
 
+void EnoceanVdc::handleBetterCopy(Esp3PacketPtr aEsp3PacketPtr, ErrorPtr aError)
+{
+  if (learningMode) {
+    // proximity checked teach-in must succeed if any copy is strong enough (as without de-duplication),
+    // so let the learn logic evaluate the stronger copy as well
+    // Note: after a successful learn action, learningMode is off, so further copies cannot cause a learn-out
+    handleRadioPacket(aEsp3PacketPtr, aError);
+    return;
+  }
+  // a duplicate of an already dispatched telegram came in with better signal, update devices' signal info only
+  EnoceanDeviceMap::iterator pos = enoceanDevices.find(aEsp3PacketPtr->radioSender());
+  if (pos!=enoceanDevices.end()) {
+    for (EnoceanDeviceList::iterator dpos = pos->second.begin(); dpos!=pos->second.end(); ++dpos) {
+      (*dpos)->updateRadioQuality(aEsp3PacketPtr);
+    }
+  }
+}
+
+
 #define SMART_ACK_RESPONSE_TIME_MS 100
 
 void EnoceanVdc::handleEventPacket(Esp3PacketPtr aEsp3PacketPtr, ErrorPtr aError)
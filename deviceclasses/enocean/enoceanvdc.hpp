@@ -32,12 +32,19 @@
 #include "enoceancomm.hpp"
 #include "enoceandevice.hpp"
 
+#include <boost/unordered_map.hpp>
+
 
 using namespace std;
 
 namespace p44 {
 
-  typedef std::multimap<EnoceanAddress, EnoceanDevicePtr> EnoceanDeviceMap;
+  /// logical devices sharing one EnOcean sender address (subdevices), usually only one or a few
+  typedef std::vector<EnoceanDevicePtr> EnoceanDeviceList;
+  /// hashed index from sender address to the logical devices for that address
+  /// @note entries are not erased when their last device is removed, so radio dispatch can safely
+  ///   hold on to a device list while device handlers run. removeDevices() clears the index.
+  typedef boost::unordered_map<EnoceanAddress, EnoceanDeviceList> EnoceanDeviceMap;
 
 
   /// persistence for enocean device container
@@ -62,7 +69,7 @@ namespace p44 {
     Tristate onlyEstablish;
     bool selfTesting;
 
-    EnoceanDeviceMap enoceanDevices; ///< local map linking EnoceanDeviceID to devices
+    EnoceanDeviceMap enoceanDevices; ///< local index linking EnOcean sender addresses to devices
 
 		EnoceanPersistence db;
 
@@ -134,6 +141,11 @@ namespace p44 {
 
   protected:
 
+    // property access implementation
+    virtual int numProps(int aDomain, PropertyDescriptorPtr aParentDescriptor) P44_OVERRIDE;
+    virtual PropertyDescriptorPtr getDescriptorByIndex(int aPropIndex, int aDomain, PropertyDescriptorPtr aParentDescriptor) P44_OVERRIDE;
+    virtual bool accessField(PropertyAccessMode aMode, ApiValuePtr aPropValue, PropertyDescriptorPtr aPropertyDescriptor) P44_OVERRIDE;
+
     /// remove device
     /// @param aDevice device to remove (possibly only part of a multi-function physical device)
     virtual void removeDevice(DevicePtr aDevice, bool aForget) P44_OVERRIDE;
@@ -142,12 +154,19 @@ namespace p44 {
 
     void handleRadioPacket(Esp3PacketPtr aEsp3PacketPtr, ErrorPtr aError);
     void handleEventPacket(Esp3PacketPtr aEsp3PacketPtr, ErrorPtr aError);
+    void handleBetterCopy(Esp3PacketPtr aEsp3PacketPtr, ErrorPtr aError);
+    void getRadioStatistics(ApiValuePtr aStats);
+    void getCommandStatistics(ApiValuePtr aStats);
     void handleTestRadioPacket(StatusCB aCompletedCB, Esp3PacketPtr aEsp3PacketPtr, ErrorPtr aError);
 
     Tristate processLearn(EnoceanAddress aDeviceAddress, EnoceanProfile aEEProfile, EnoceanManufacturer aManufacturer);
 
     ErrorPtr addProfile(VdcApiRequestPtr aRequest, ApiValuePtr aParams);
     ErrorPtr simulatePacket(VdcApiRequestPtr aRequest, ApiValuePtr aParams);
+    ErrorPtr captureFilePath(const string &aName, string &aPath);
+    ErrorPtr captureTraffic(VdcApiRequestPtr aRequest, ApiValuePtr aParams);
+    ErrorPtr replayCapture(VdcApiRequestPtr aRequest, ApiValuePtr aParams);
+    void replayDone(VdcApiRequestPtr aRequest, ErrorPtr aError);
   };
 
 } // namespace p44
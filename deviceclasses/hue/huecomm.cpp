@@ -448,17 +448,26 @@ public:
 // MARK: ===== hueComm
 
 
+// the hue bridge handles about 10 light commands per second
+#define HUE_DEFAULT_COMMAND_RATE 10
+
+
 HueComm::HueComm() :
   inherited(MainLoop::currentMainLoop()),
   bridgeAPIComm(MainLoop::currentMainLoop()),
   findInProgress(false),
-  apiReady(false)
+  apiReady(false),
+  commandRate(HUE_DEFAULT_COMMAND_RATE),
+  lastScheduledSend(Never),
+  scheduledInFlight(false),
+  scheduleTicket(0)
 {
 }
 
 
 HueComm::~HueComm()
 {
+  MainLoop::currentMainLoop().cancelExecutionTicket(scheduleTicket);
 }
 
 
@@ -472,6 +481,7 @@ void HueComm::apiAction(HttpMethods aMethod, const char* aUrlSuffix, JsonObjectP
 {
   if (!apiReady && !aNoAutoURL) {
     if (aResultHandler) aResultHandler(JsonObjectPtr(), ErrorPtr(new HueCommError(HueCommError::ApiNotReady)));
+    return;
   }
   string url;
   if (aNoAutoURL) {
@@ -526,4 +536,107 @@ void HueComm::refindBridge(HueBridgeFindCB aFindHandler)
 };
 
 
+
+// MARK: ===== rate limiting scheduler
+
+void HueComm::mergeState(JsonObjectPtr aOlder, JsonObjectPtr aNewer)
+{
+  if (!aOlder || !aNewer) return;
+  // fields only present in the older state change remain valid, unless new state switches off
+  JsonObjectPtr o = aNewer->get("on");
+  if (o && !o->boolValue()) return;
+  // hue/sat, xy and ct are mutually exclusive, the bridge would apply the older mode's fields with priority
+  const char *newMode = colorModeOfState(aNewer);
+  string key;
+  JsonObjectPtr val;
+  aOlder->resetKeyIteration();
+  while (aOlder->nextKeyValue(key, val)) {
+    if (aNewer->get(key.c_str())) continue; // newer value exists
+    const char *mode = colorModeOfField(key);
+    if (mode && newMode && strcmp(mode, newMode)!=0) continue; // other color mode, obsolete
+    aNewer->add(key.c_str(), val);
+  }
+}
+
+
+const char *HueComm::colorModeOfField(const string &aKey)
+{
+  if (aKey=="hue" || aKey=="sat") return "hs";
+  if (aKey=="xy") return "xy";
+  if (aKey=="ct") return "ct";
+  return NULL;
+}
+
+
+const char *HueComm::colorModeOfState(JsonObjectPtr aState)
+{
+  if (aState->get("hue") || aState->get("sat")) return "hs";
+  if (aState->get("xy")) return "xy";
+  if (aState->get("ct")) return "ct";
+  return NULL;
+}
+
+
+void HueComm::apiScheduledAction(HttpMethods aMethod, const char* aUrlSuffix, JsonObjectPtr aData, HueApiResultCB aResultHandler)
+{
+  string urlSuffix = nonNullCStr(aUrlSuffix);
+  for (HueScheduledCommandList::iterator pos = scheduledCommands.begin(); pos!=scheduledCommands.end(); ++pos) {
+    if (pos->method==aMethod && pos->urlSuffix==urlSuffix) {
+      // still waiting command for the same resource -> supersede it (latest wins)
+      mergeState(pos->data, aData);
+      // - superseded command is done, but report that from mainloop, not from within this call
+      if (pos->resultHandler) {
+        MainLoop::currentMainLoop().executeOnce(boost::bind(pos->resultHandler, JsonObjectPtr(), ErrorPtr()));
+      }
+      scheduledCommands.erase(pos);
+      schedulerStats.droppedIntermediate++;
+      FOCUSLOG("hue scheduler: superseded waiting command for %s", urlSuffix.c_str());
+      break;
+    }
+  }
+  // queue new command
+  HueScheduledCommand cmd;
+  cmd.method = aMethod;
+  cmd.urlSuffix = urlSuffix;
+  cmd.data = aData;
+  cmd.resultHandler = aResultHandler;
+  scheduledCommands.push_back(cmd);
+  if (scheduledCommands.size()>schedulerStats.maxQueueDepth) schedulerStats.maxQueueDepth = scheduledCommands.size();
+  processScheduledCommands();
+}
+
+
+void HueComm::processScheduledCommands()
+{
+  MainLoop::currentMainLoop().cancelExecutionTicket(scheduleTicket);
+  if (scheduledInFlight || scheduledCommands.empty()) return; // busy or nothing to do
+  // check budget
+  MLMicroSeconds now = MainLoop::now();
+  if (commandRate>0 && lastScheduledSend!=Never) {
+    MLMicroSeconds nextSlot = lastScheduledSend+(MLMicroSeconds)(Second/commandRate);
+    if (now<nextSlot) {
+      // too early, retry when next send slot is due
+      scheduleTicket = MainLoop::currentMainLoop().executeOnce(boost::bind(&HueComm::processScheduledCommands, this), nextSlot-now);
+      return;
+    }
+  }
+  // send next command
+  HueScheduledCommand cmd = scheduledCommands.front();
+  scheduledCommands.pop_front();
+  lastScheduledSend = now;
+  scheduledInFlight = true;
+  schedulerStats.commandsSent++;
+  apiAction(cmd.method, cmd.urlSuffix.c_str(), cmd.data, boost::bind(&HueComm::scheduledActionDone, this, cmd.resultHandler, _1, _2));
+}
+
+
+void HueComm::scheduledActionDone(HueApiResultCB aResultHandler, JsonObjectPtr aResult, ErrorPtr aError)
+{
+  scheduledInFlight = false;
+  if (aResultHandler) aResultHandler(aResult, aError);
+  // next command, if any
+  processScheduledCommands();
+}
+
+
 #endif // ENABLE_HUE
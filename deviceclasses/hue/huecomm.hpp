@@ -109,6 +109,29 @@ namespace p44 {
   typedef boost::intrusive_ptr<HueApiOperation> HueApiOperationPtr;
 
 
+  /// command waiting in the rate limiting scheduler, not yet passed to the operation queue
+  typedef struct {
+    HttpMethods method;
+    string urlSuffix; ///< also identifies the resource (e.g. a light's state), for coalescing
+    JsonObjectPtr data;
+    HueApiResultCB resultHandler;
+  } HueScheduledCommand;
+  typedef std::list<HueScheduledCommand> HueScheduledCommandList;
+
+
+  /// rate limiting scheduler statistics
+  class HueSchedulerStatistics
+  {
+  public:
+    HueSchedulerStatistics() { reset(); };
+    void reset() { commandsSent = 0; droppedIntermediate = 0; maxQueueDepth = 0; };
+
+    uint64_t commandsSent; ///< scheduled commands actually sent to the bridge
+    uint64_t droppedIntermediate; ///< commands superseded by a newer command for the same resource before being sent
+    size_t maxQueueDepth; ///< max number of commands waiting in the scheduler
+  };
+
+
   class BridgeFinder;
 
   class HueComm : public OperationQueue
@@ -119,6 +142,14 @@ namespace p44 {
     bool findInProgress;
     bool apiReady;
 
+    // rate limiting scheduler
+    HueScheduledCommandList scheduledCommands; ///< commands waiting for their send slot
+    double commandRate; ///< max number of scheduled commands per second, 0 = unlimited
+    MLMicroSeconds lastScheduledSend; ///< when the last scheduled command was sent
+    bool scheduledInFlight; ///< set while a scheduled command is sent and awaiting its answer
+    long scheduleTicket;
+    HueSchedulerStatistics schedulerStats;
+
   public:
 
     HueComm();
@@ -155,6 +186,49 @@ namespace p44 {
     /// @param aNoAutoURL if set, aUrlSuffix must be the complete URL (baseURL and userName will not be used automatically)
     void apiAction(HttpMethods aMethod, const char* aUrlSuffix, JsonObjectPtr aData, HueApiResultCB aResultHandler, bool aNoAutoURL = false);
 
+    /// Send a state change to the API through the rate limiting scheduler
+    /// @param aMethod the HTTP method to use
+    /// @param aUrlSuffix the suffix to append to the baseURL+userName (including leading slash)
+    /// @param aData the state change to perform (JSON body of the request)
+    /// @param aResultHandler will be called with the result, or without result and error when the command
+    ///   was superseded by a newer one for the same resource
+    /// @note commands are sent one at a time, not faster than the configured command rate.
+    ///   A command still waiting for a send slot when a new command for the same URL suffix is scheduled is
+    ///   superseded (latest wins): it is removed, and its fields are merged into the new command using mergeState().
+    ///   The new command is queued at the end, so it cannot be overtaken by commands scheduled before it
+    ///   (e.g. a group action affecting the same light).
+    void apiScheduledAction(HttpMethods aMethod, const char* aUrlSuffix, JsonObjectPtr aData, HueApiResultCB aResultHandler);
+
+    /// helper to combine a superseded state change into a newer one
+    /// @param aOlder the older, superseded state change
+    /// @param aNewer the newer state change. Fields only present in aOlder are added, unless aNewer switches off.
+    ///   Color fields of aOlder are not added when aNewer sets another color mode (these are mutually exclusive).
+    static void mergeState(JsonObjectPtr aOlder, JsonObjectPtr aNewer);
+
+    /// @param aKey a light state field name
+    /// @return color mode the field belongs to ("hs", "xy" or "ct"), NULL for non-color fields
+    static const char *colorModeOfField(const string &aKey);
+
+    /// @param aState a light state (change)
+    /// @return color mode set by the state ("hs", "xy" or "ct"), NULL if it does not set a color
+    static const char *colorModeOfState(JsonObjectPtr aState);
+
+    /// set the command budget for scheduled commands
+    /// @param aCommandsPerSecond max number of scheduled commands per second, 0 for unlimited
+    void setCommandRate(double aCommandsPerSecond) { commandRate = aCommandsPerSecond; };
+
+    /// @return command budget for scheduled commands in commands per second
+    double getCommandRate() { return commandRate; };
+
+    /// @return number of commands waiting in the scheduler
+    size_t scheduledQueueDepth() { return scheduledCommands.size(); };
+
+    /// @return scheduler statistics
+    const HueSchedulerStatistics &schedulerStatistics() { return schedulerStats; };
+
+    /// reset scheduler statistics
+    void resetSchedulerStatistics() { schedulerStats.reset(); };
+
     /// helper to get success from apiAction results
     /// @param aResult a result as delivered by apiAction
     /// @param aIndex the index of the success item, defaults to 0
@@ -186,6 +260,11 @@ namespace p44 {
     /// @note ssdpUuid and apiToken member variables must be set to the pre-know bridge's parameters before calling this
     void refindBridge(HueBridgeFindCB aFindHandler);
 
+  private:
+
+    void processScheduledCommands();
+    void scheduledActionDone(HueApiResultCB aResultHandler, JsonObjectPtr aResult, ErrorPtr aError);
+
   };
   
 } // namespace p44
@@ -25,6 +25,8 @@
 
 #include "huevdc.hpp"
 
+#include <math.h>
+
 using namespace p44;
 
 
@@ -60,7 +62,11 @@ HueDevice::HueDevice(HueVdc *aVdcP, const string &aLightID, bool aIsColor, const
   lightID(aLightID),
   uniqueID(aUniqueID),
   reapplyMode(reapply_once),
-  reapplyTicket(0)
+  reapplyTicket(0),
+  reachable(true),
+  applySettledAt(Never),
+  mismatchReapplies(0),
+  lastMismatchReapply(Never)
 {
   // hue devices are lights
   setColorClass(class_yellow_light);
@@ -184,26 +190,19 @@ string HueDevice::hardwareGUID()
 
 
 
+#define PRESENCE_MAX_AGE (40*Second) // reachability from bulk poll is considered current for this time
+
+
 void HueDevice::checkPresence(PresenceCB aPresenceResultHandler)
 {
-  // query the device
-  string url = string_format("/lights/%s", lightID.c_str());
-  hueComm().apiQuery(url.c_str(), boost::bind(&HueDevice::presenceStateReceived, this, aPresenceResultHandler, _1, _2));
+  // use reachability from bulk poll (which is triggered if last poll is too old)
+  hueVdc().pollLights(boost::bind(&HueDevice::presenceStatePolled, this, aPresenceResultHandler), PRESENCE_MAX_AGE);
 }
 
 
 
-void HueDevice::presenceStateReceived(PresenceCB aPresenceResultHandler, JsonObjectPtr aDeviceInfo, ErrorPtr aError)
+void HueDevice::presenceStatePolled(PresenceCB aPresenceResultHandler)
 {
-  bool reachable = false;
-  if (Error::isOK(aError) && aDeviceInfo) {
-    JsonObjectPtr state = aDeviceInfo->get("state");
-    if (state) {
-      // Note: 2012 hue bridge firmware always returns 1 for this.
-      JsonObjectPtr o = state->get("reachable");
-      reachable = o && o->boolValue();
-    }
-  }
   aPresenceResultHandler(reachable);
 }
 
@@ -232,7 +231,9 @@ void HueDevice::disconnectableHandler(bool aForgetParams, DisconnectCB aDisconne
 
 
 #define INITIAL_REAPPLY_DELAY (1*Second)
-#define PERIODIC_REAPPLY_INTERVAL (30*Second)
+#define POLL_SYNC_HOLDOFF (5*Second) // polled state is only considered settled this long after the end of the last transition
+#define MISMATCH_REAPPLY_MAX 3 // re-applies in a row that did not fix a state mismatch before backing off
+#define MISMATCH_REAPPLY_BACKOFF (10*Minute) // interval for further re-applies when re-applying did not help
 
 void HueDevice::applyChannelValues(SimpleCB aDoneCB, bool aForDimming)
 {
@@ -255,10 +256,8 @@ void HueDevice::reapplyTimerHandler()
   reapplyCount++;
   ALOG(reapplyCount>1 ? LOG_DEBUG : LOG_INFO, "Re-applying values to hue (%d. time) to make sure light actually is udpated", reapplyCount);
   applyLightState(NULL, false, true);
-  if (reapplyMode==reapply_periodic) {
-    // re-apply periodically -> schedule next
-    reapplyTicket = MainLoop::currentMainLoop().executeOnce(boost::bind(&HueDevice::reapplyTimerHandler, this), PERIODIC_REAPPLY_INTERVAL);
-  }
+  // Note: further re-applying in reapply_periodic mode is done by processPolledInfo(), and only
+  //   when the bridge reports a state that differs from what was applied
 }
 
 
@@ -277,7 +276,6 @@ bool HueDevice::applyLightState(SimpleCB aDoneCB, bool aForDimming, bool aAnyway
     ColorLightBehaviourPtr cl = boost::dynamic_pointer_cast<ColorLightBehaviour>(l);
     MLMicroSeconds transitionTime = 0; // undefined so far
     // build hue API light state
-    string url = string_format("/lights/%s/state", lightID.c_str());
     JsonObjectPtr newState = JsonObject::newObj();
     // brightness is always re-applied unless it's dimming
     bool lightIsOn = true; // assume on
@@ -369,7 +367,12 @@ bool HueDevice::applyLightState(SimpleCB aDoneCB, bool aForDimming, bool aAnyway
     }
     // use transition time from (1/10 = 100mS second resolution)
     newState->add("transitiontime", JsonObject::newInt64(transitionTime/(100*MilliSecond)));
-    hueComm().apiAction(httpMethodPUT, url.c_str(), newState, boost::bind(&HueDevice::channelValuesSent, this, l, aDoneCB, _1, _2));
+    rememberAppliedState(newState, transitionTime);
+    // Note: light state goes through the vdc (to combine identical states into group actions) and then through
+    //   the bridge's rate limiting scheduler. Applying is done as soon as the new state is queued, so further
+    //   changes can supersede it while it is still waiting for its send slot.
+    hueVdc().queueLightState(lightID, newState, boost::bind(&HueDevice::channelValuesSent, this, l, SimpleCB(), _1, _2));
+    if (aDoneCB) aDoneCB();
   }
   return true;
 }
@@ -488,25 +491,177 @@ void HueDevice::parseLightState(JsonObjectPtr aDeviceInfo)
 
 void HueDevice::syncChannelValues(SimpleCB aDoneCB)
 {
-  // query light attributes and state
-  string url = string_format("/lights/%s", lightID.c_str());
-  hueComm().apiQuery(url.c_str(), boost::bind(&HueDevice::channelValuesReceived, this, aDoneCB, _1, _2));
+  // get fresh state of all lights in one query (lights of a room usually sync at the same time and share it)
+  hueVdc().pollLights(boost::bind(&HueDevice::channelValuesPolled, this, aDoneCB), 0);
 }
 
 
 
-void HueDevice::channelValuesReceived(SimpleCB aDoneCB, JsonObjectPtr aDeviceInfo, ErrorPtr aError)
+void HueDevice::channelValuesPolled(SimpleCB aDoneCB)
 {
-  if (Error::isOK(aError)) {
+  if (lastPolledInfo) {
     // assign the channel values
-    parseLightState(aDeviceInfo);
-  } // no error
+    parseLightState(lastPolledInfo);
+  }
   // done
   if (aDoneCB) aDoneCB();
 }
 
 
 
+void HueDevice::processPolledInfo(JsonObjectPtr aLightInfo)
+{
+  lastPolledInfo = aLightInfo;
+  JsonObjectPtr state;
+  if (aLightInfo) state = aLightInfo->get("state");
+  if (!state) {
+    // light not reported by bridge, or poll failed
+    reachable = false;
+    return;
+  }
+  // Note: 2012 hue bridge firmware always returns 1 for this.
+  JsonObjectPtr o = state->get("reachable");
+  reachable = o && o->boolValue();
+  if (!reachable || reapplyTicket || (applySettledAt!=Never && MainLoop::now()<applySettledAt)) {
+    // light unreachable, or own changes still underway, polled state is not meaningful
+    return;
+  }
+  if (reapplyMode==reapply_periodic && lastAppliedState) {
+    if (appliedStateMatches(state)) {
+      mismatchReapplies = 0;
+    }
+    else {
+      // bridge reports something else than what we applied (broken bulbs that go white after a while)
+      MLMicroSeconds now = MainLoop::now();
+      if (mismatchReapplies<MISMATCH_REAPPLY_MAX || now>lastMismatchReapply+MISMATCH_REAPPLY_BACKOFF) {
+        ALOG(LOG_INFO, "hue reports state different from last applied state -> re-applying");
+        mismatchReapplies++;
+        lastMismatchReapply = now;
+        applyLightState(NULL, false, true);
+      }
+      // Note: while backing off, the (mismatching) reported state is not taken over either
+      return;
+    }
+  }
+  // take over changes made elsewhere (e.g. hue app)
+  parseLightState(aLightInfo);
+}
+
+
+
+void HueDevice::rememberAppliedState(JsonObjectPtr aState, MLMicroSeconds aTransitionTime)
+{
+  applySettledAt = MainLoop::now()+aTransitionTime+POLL_SYNC_HOLDOFF;
+  // determine which color mode the new state uses, if any
+  const char *newMode = HueComm::colorModeOfState(aState);
+  JsonObjectPtr o = aState->get("on");
+  JsonObjectPtr applied = JsonObject::newObj();
+  if (lastAppliedState && !(o && !o->boolValue())) {
+    // keep previously applied fields not changed now, except for color fields of another color mode
+    string key;
+    JsonObjectPtr val;
+    lastAppliedState->resetKeyIteration();
+    while (lastAppliedState->nextKeyValue(key, val)) {
+      if (aState->get(key.c_str())) continue; // changed now
+      const char *mode = HueComm::colorModeOfField(key);
+      if (mode && newMode && strcmp(mode, newMode)!=0) continue; // other color mode, obsolete
+      applied->add(key.c_str(), val);
+    }
+  }
+  string key;
+  JsonObjectPtr val;
+  aState->resetKeyIteration();
+  while (aState->nextKeyValue(key, val)) {
+    if (key!="transitiontime") applied->add(key.c_str(), val);
+  }
+  lastAppliedState = applied;
+}
+
+
+
+/// @return true if point aX,aY is inside the triangle given by 3 [x,y] points in aGamut
+static bool insideGamut(double aX, double aY, JsonObjectPtr aGamut)
+{
+  double p[3][2];
+  for (int i=0; i<3; i++) {
+    JsonObjectPtr pt = aGamut->arrayGet(i);
+    if (!pt || pt->arrayLength()<2) return true; // unknown gamut, assume inside
+    p[i][0] = pt->arrayGet(0)->doubleValue();
+    p[i][1] = pt->arrayGet(1)->doubleValue();
+  }
+  // point is inside when it is on the same side of all three edges
+  double d[3];
+  for (int i=0; i<3; i++) {
+    int j = (i+1)%3;
+    d[i] = (aX-p[j][0])*(p[i][1]-p[j][1]) - (p[i][0]-p[j][0])*(aY-p[j][1]);
+  }
+  bool hasNeg = d[0]<0 || d[1]<0 || d[2]<0;
+  bool hasPos = d[0]>0 || d[1]>0 || d[2]>0;
+  return !(hasNeg && hasPos);
+}
+
+
+bool HueDevice::appliedStateMatches(JsonObjectPtr aReportedState)
+{
+  // light capabilities (newer bridges only), bulbs limit ct and xy to what they can actually do
+  JsonObjectPtr control;
+  if (lastPolledInfo) {
+    JsonObjectPtr caps = lastPolledInfo->get("capabilities");
+    if (caps) control = caps->get("control");
+  }
+  JsonObjectPtr o = aReportedState->get("on");
+  bool reportedOn = o && o->boolValue();
+  string key;
+  JsonObjectPtr val;
+  lastAppliedState->resetKeyIteration();
+  while (lastAppliedState->nextKeyValue(key, val)) {
+    if (key=="on") {
+      if (val->boolValue()!=reportedOn) return false;
+      continue;
+    }
+    if (!reportedOn) continue; // light is off, other fields do not matter
+    JsonObjectPtr r = aReportedState->get(key.c_str());
+    if (!r) continue; // not reported, cannot compare
+    if (key=="xy") {
+      JsonObjectPtr a0 = val->arrayGet(0);
+      JsonObjectPtr a1 = val->arrayGet(1);
+      if (!a0 || !a1) continue;
+      // bridge maps colors outside the bulb's gamut to its border, these cannot be compared
+      // Note: without gamut information, bulbs clamping colors are handled by the re-apply backoff
+      JsonObjectPtr gamut;
+      if (control) gamut = control->get("colorgamut");
+      if (gamut && !insideGamut(a0->doubleValue(), a1->doubleValue(), gamut)) continue;
+      // bridge rounds xy, allow some deviation
+      for (int i=0; i<2; i++) {
+        JsonObjectPtr a = val->arrayGet(i);
+        JsonObjectPtr b = r->arrayGet(i);
+        if (a && b && fabs(a->doubleValue()-b->doubleValue())>0.01) return false;
+      }
+    }
+    else if (key=="ct") {
+      // bulbs limit ct to their supported range
+      int ct = val->int32Value();
+      JsonObjectPtr range;
+      if (control) range = control->get("ct");
+      if (range) {
+        JsonObjectPtr m = range->get("min");
+        if (m && ct<m->int32Value()) ct = m->int32Value();
+        m = range->get("max");
+        if (m && ct>m->int32Value()) ct = m->int32Value();
+      }
+      if (abs(ct-r->int32Value())>2) return false;
+    }
+    else {
+      // integer fields, allow rounding differences
+      int tolerance = key=="hue" ? HUEAPI_FACTOR_HUE+1 : 2;
+      if (abs(val->int32Value()-r->int32Value())>tolerance) return false;
+    }
+  }
+  return true;
+}
+
+
+
 
 
 
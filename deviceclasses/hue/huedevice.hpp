@@ -60,6 +60,14 @@ namespace p44 {
     int reapplyCount;
     long reapplyTicket;
 
+    // state as known from bulk polling (see HueVdc::pollLights())
+    bool reachable; ///< reachability as last reported by the bridge
+    JsonObjectPtr lastPolledInfo; ///< light info from last poll, NULL if none or light was missing
+    JsonObjectPtr lastAppliedState; ///< accumulated light state fields last sent to the bridge
+    MLMicroSeconds applySettledAt; ///< when the last applied state should be reached (including transition)
+    int mismatchReapplies; ///< number of re-applies due to a reported state mismatch since the last match
+    MLMicroSeconds lastMismatchReapply; ///< when the last re-apply due to a mismatch happened
+
 
   public:
     HueDevice(HueVdc *aVdcP, const string &aLightID, bool aIsColor, const string &aUniqueID);
@@ -71,6 +79,15 @@ namespace p44 {
     HueVdc &hueVdc();
     HueComm &hueComm();
 
+    /// @return the light's ID in the hue bridge
+    const string &getLightID() { return lightID; };
+
+    /// process light info as polled in bulk by the vdc
+    /// @param aLightInfo the light's info object from the bridge's /lights answer, NULL if not reported or poll failed
+    /// @note updates reachability, synchronizes channel values when no own changes are underway, and
+    ///   re-applies the state (in reapply_periodic mode) when the bridge reports something different from what was applied
+    void processPolledInfo(JsonObjectPtr aLightInfo);
+
     /// description of object, mainly for debug and logging
     /// @return textual description of object
     virtual string description();
@@ -152,10 +169,12 @@ namespace p44 {
   private:
 
     void deviceStateReceived(StatusCB aCompletedCB, bool aFactoryReset, JsonObjectPtr aDeviceInfo, ErrorPtr aError);
-    void presenceStateReceived(PresenceCB aPresenceResultHandler, JsonObjectPtr aDeviceInfo, ErrorPtr aError);
+    void presenceStatePolled(PresenceCB aPresenceResultHandler);
     void disconnectableHandler(bool aForgetParams, DisconnectCB aDisconnectResultHandler, bool aPresent);
     void channelValuesSent(LightBehaviourPtr aColorLightBehaviour, SimpleCB aDoneCB, JsonObjectPtr aResult, ErrorPtr aError);
-    void channelValuesReceived(SimpleCB aDoneCB, JsonObjectPtr aDeviceInfo, ErrorPtr aError);
+    void channelValuesPolled(SimpleCB aDoneCB);
+    void rememberAppliedState(JsonObjectPtr aState, MLMicroSeconds aTransitionTime);
+    bool appliedStateMatches(JsonObjectPtr aReportedState);
     bool applyLightState(SimpleCB aDoneCB, bool aForDimming, bool aAnyway);
     void reapplyTimerHandler();
     void parseLightState(JsonObjectPtr aDeviceInfo);
@@ -25,12 +25,22 @@
 
 #include "huedevice.hpp"
 
+#include <algorithm>
+
 using namespace p44;
 
+#define HUE_POLL_INTERVAL (30*Second) // interval for polling all light states from the bridge in one query
+
 
 HueVdc::HueVdc(int aInstanceNumber, VdcHost *aVdcHostP, int aTag) :
   inherited(aInstanceNumber, aVdcHostP, aTag),
-  hueComm()
+  hueComm(),
+  zoneGroupsGeneration(0),
+  zoneGroupsTicket(0),
+  stateFlushTicket(0),
+  pollTicket(0),
+  pollInProgress(false),
+  lastPoll(Never)
 {
 }
 
@@ -94,6 +104,90 @@ void HueVdc::initialize(StatusCB aCompletedCB, bool aFactoryReset)
 
 
 
+// MARK: ===== property access
+
+enum {
+  bridgeStatistics_key,
+  commandRate_key,
+  numHueVdcProperties
+};
+
+static char huevdc_key;
+
+
+int HueVdc::numProps(int aDomain, PropertyDescriptorPtr aParentDescriptor)
+{
+  // Note: only add my own count when accessing root level properties!!
+  if (aParentDescriptor->isRootOfObject()) {
+    // Accessing properties at the vdc (root) level, add mine
+    return inherited::numProps(aDomain, aParentDescriptor)+numHueVdcProperties;
+  }
+  // just return base class' count
+  return inherited::numProps(aDomain, aParentDescriptor);
+}
+
+
+PropertyDescriptorPtr HueVdc::getDescriptorByIndex(int aPropIndex, int aDomain, PropertyDescriptorPtr aParentDescriptor)
+{
+  static const PropertyDescription properties[numHueVdcProperties] = {
+    { "x-p44-bridgeStatistics", apivalue_null, bridgeStatistics_key, OKEY(huevdc_key) },
+    { "x-p44-commandRate", apivalue_double, commandRate_key, OKEY(huevdc_key) },
+  };
+  if (aParentDescriptor->isRootOfObject()) {
+    // root level - accessing properties on the vdc level
+    int n = inherited::numProps(aDomain, aParentDescriptor);
+    if (aPropIndex<n)
+      return inherited::getDescriptorByIndex(aPropIndex, aDomain, aParentDescriptor); // base class' property
+    aPropIndex -= n; // rebase to 0 for my own first property
+    return PropertyDescriptorPtr(new StaticPropertyDescriptor(&properties[aPropIndex], aParentDescriptor));
+  }
+  // other level
+  return inherited::getDescriptorByIndex(aPropIndex, aDomain, aParentDescriptor); // base class' property
+}
+
+
+bool HueVdc::accessField(PropertyAccessMode aMode, ApiValuePtr aPropValue, PropertyDescriptorPtr aPropertyDescriptor)
+{
+  if (aPropertyDescriptor->hasObjectKey(huevdc_key)) {
+    if (aMode==access_read) {
+      switch (aPropertyDescriptor->fieldKey()) {
+        case bridgeStatistics_key:
+          aPropValue->setType(apivalue_object); // make object (incoming object is NULL)
+          getBridgeStatistics(aPropValue);
+          return true;
+        case commandRate_key:
+          aPropValue->setDoubleValue(hueComm.getCommandRate());
+          return true;
+      }
+    }
+    else {
+      switch (aPropertyDescriptor->fieldKey()) {
+        case bridgeStatistics_key:
+          // writing any value resets the counters
+          hueComm.resetSchedulerStatistics();
+          return true;
+        case commandRate_key:
+          hueComm.setCommandRate(aPropValue->doubleValue());
+          return true;
+      }
+    }
+  }
+  // not my field, let base class handle it
+  return inherited::accessField(aMode, aPropValue, aPropertyDescriptor);
+}
+
+
+void HueVdc::getBridgeStatistics(ApiValuePtr aStats)
+{
+  const HueSchedulerStatistics &st = hueComm.schedulerStatistics();
+  aStats->add("queueDepth", aStats->newUint64(hueComm.scheduledQueueDepth()));
+  aStats->add("maxQueueDepth", aStats->newUint64(st.maxQueueDepth));
+  aStats->add("commandsSent", aStats->newUint64(st.commandsSent));
+  aStats->add("droppedIntermediate", aStats->newUint64(st.droppedIntermediate));
+}
+
+
+
 // MARK: ===== collect devices
 
 
@@ -107,6 +201,8 @@ int HueVdc::getRescanModes() const
 void HueVdc::collectDevices(StatusCB aCompletedCB, bool aIncremental, bool aExhaustive, bool aClearSettings)
 {
   collectedHandler = aCompletedCB;
+  // zone groups must be re-evaluated for the new set of lights
+  invalidateZoneGroups();
   if (!aIncremental) {
     // full collect, remove all devices
     removeDevices(aClearSettings);
@@ -309,6 +405,10 @@ void HueVdc::collectedLightsHandler(JsonObjectPtr aResult, ErrorPtr aError)
       }
     }
   }
+  // set up bridge groups for the zones
+  scheduleZoneGroupsUpdate(0);
+  // start polling light states
+  schedulePoll(HUE_POLL_INTERVAL);
   // collect phase done
   if (collectedHandler)
     collectedHandler(ErrorPtr());
@@ -317,4 +417,281 @@ void HueVdc::collectedLightsHandler(JsonObjectPtr aResult, ErrorPtr aError)
 
 
 
+// MARK: ===== bulk state polling
+
+void HueVdc::pollLights(SimpleCB aDoneCB, MLMicroSeconds aMaxAge)
+{
+  if (!pollInProgress && aMaxAge>0 && lastPoll!=Never && MainLoop::now()<lastPoll+aMaxAge) {
+    // recent enough, devices already have the information
+    if (aDoneCB) aDoneCB();
+    return;
+  }
+  if (aDoneCB) pollWaiters.push_back(aDoneCB);
+  if (!pollInProgress) {
+    // one query for all lights, shared by all devices waiting for it
+    pollInProgress = true;
+    MainLoop::currentMainLoop().cancelExecutionTicket(pollTicket);
+    hueComm.apiQuery("/lights", boost::bind(&HueVdc::lightsPolled, this, _1, _2));
+  }
+}
+
+
+void HueVdc::schedulePoll(MLMicroSeconds aDelay)
+{
+  MainLoop::currentMainLoop().cancelExecutionTicket(pollTicket);
+  pollTicket = MainLoop::currentMainLoop().executeOnce(boost::bind(&HueVdc::periodicPoll, this), aDelay);
+}
+
+
+void HueVdc::periodicPoll()
+{
+  pollTicket = 0;
+  pollLights(NULL, 0);
+}
+
+
+void HueVdc::lightsPolled(JsonObjectPtr aResult, ErrorPtr aError)
+{
+  pollInProgress = false;
+  if (!Error::isOK(aError)) {
+    LOG(LOG_WARNING, "hue: polling lights failed: %s", aError->description().c_str());
+    aResult.reset(); // devices will consider themselves unreachable
+  }
+  else {
+    lastPoll = MainLoop::now();
+  }
+  // distribute state to devices
+  for (DeviceVector::iterator pos = devices.begin(); pos!=devices.end(); ++pos) {
+    HueDevicePtr dev = boost::dynamic_pointer_cast<HueDevice>(*pos);
+    if (dev) {
+      dev->processPolledInfo(aResult ? aResult->get(dev->getLightID().c_str()) : JsonObjectPtr());
+    }
+  }
+  // inform waiters (list might get new entries from callbacks, these must wait for next poll)
+  std::list<SimpleCB> waiters;
+  waiters.swap(pollWaiters);
+  for (std::list<SimpleCB>::iterator pos = waiters.begin(); pos!=waiters.end(); ++pos) {
+    (*pos)();
+  }
+  // next periodic poll
+  if (!pollInProgress) schedulePoll(HUE_POLL_INTERVAL);
+}
+
+
+
+// MARK: ===== group action optimizer
+
+#define HUE_ZONEGROUP_MIN_SIZE 2 // bridge groups are only worth using for at least that many lights
+#define HUE_ZONEGROUPS_UPDATE_DELAY (30*Second) // delay for re-evaluating zone groups after seeing unoptimized commands
+#define HUE_ZONEGROUP_NAME_PREFIX "p44 zone " // bridge groups managed by us are named with this prefix followed by the zone ID
+
+
+void HueVdc::queueLightState(const string &aLightID, JsonObjectPtr aState, HueApiResultCB aResultHandler)
+{
+  HuePendingLightStateMap::iterator pos = pendingStates.find(aLightID);
+  if (pos!=pendingStates.end()) {
+    // light already has a state queued in this cycle, new state supersedes it
+    HueComm::mergeState(pos->second.state, aState);
+    if (pos->second.resultHandler) {
+      MainLoop::currentMainLoop().executeOnce(boost::bind(pos->second.resultHandler, JsonObjectPtr(), ErrorPtr()));
+    }
+  }
+  HuePendingLightState &ps = pendingStates[aLightID];
+  ps.state = aState;
+  ps.resultHandler = aResultHandler;
+  // send all states queued in this mainloop cycle together
+  if (stateFlushTicket==0) {
+    stateFlushTicket = MainLoop::currentMainLoop().executeOnce(boost::bind(&HueVdc::sendPendingLightStates, this));
+  }
+}
+
+
+void HueVdc::sendPendingLightStates()
+{
+  MainLoop::currentMainLoop().cancelExecutionTicket(stateFlushTicket);
+  // collect lights going to identical states
+  typedef std::map<string, HueLightIdSet> StateLightsMap;
+  StateLightsMap stateLights;
+  for (HuePendingLightStateMap::iterator pos = pendingStates.begin(); pos!=pendingStates.end(); ++pos) {
+    stateLights[pos->second.state->json_c_str()].insert(pos->first);
+  }
+  for (StateLightsMap::iterator spos = stateLights.begin(); spos!=stateLights.end(); ++spos) {
+    HueLightIdSet &remaining = spos->second;
+    if (remaining.size()>=HUE_ZONEGROUP_MIN_SIZE) {
+      // use group actions for all zone groups entirely going to this state
+      for (HueZoneGroupsVector::iterator gpos = zoneGroups.begin(); gpos!=zoneGroups.end(); ++gpos) {
+        if (std::includes(remaining.begin(), remaining.end(), gpos->lights.begin(), gpos->lights.end())) {
+          JsonObjectPtr state;
+          std::vector<HueApiResultCB> handlers;
+          for (HueLightIdSet::iterator lpos = gpos->lights.begin(); lpos!=gpos->lights.end(); ++lpos) {
+            HuePendingLightState &ps = pendingStates[*lpos];
+            state = ps.state; // all identical
+            if (ps.resultHandler) handlers.push_back(ps.resultHandler);
+            remaining.erase(*lpos);
+          }
+          LOG(LOG_INFO, "hue optimizer: sending state to group %s (zone %d, %d lights)", gpos->groupID.c_str(), gpos->zoneID, (int)gpos->lights.size());
+          string url = string_format("/groups/%s/action", gpos->groupID.c_str());
+          hueComm.apiScheduledAction(httpMethodPUT, url.c_str(), state, boost::bind(&HueVdc::groupActionDone, this, handlers, _1, _2));
+        }
+      }
+      if (remaining.size()>=HUE_ZONEGROUP_MIN_SIZE) {
+        // still multiple lights with the same state, zones might have changed since groups were set up
+        scheduleZoneGroupsUpdate(HUE_ZONEGROUPS_UPDATE_DELAY);
+      }
+    }
+    // per-light state changes for the rest
+    for (HueLightIdSet::iterator lpos = remaining.begin(); lpos!=remaining.end(); ++lpos) {
+      HuePendingLightState &ps = pendingStates[*lpos];
+      string url = string_format("/lights/%s/state", lpos->c_str());
+      hueComm.apiScheduledAction(httpMethodPUT, url.c_str(), ps.state, ps.resultHandler);
+    }
+  }
+  pendingStates.clear();
+}
+
+
+void HueVdc::groupActionDone(std::vector<HueApiResultCB> aResultHandlers, JsonObjectPtr aResult, ErrorPtr aError)
+{
+  // group action results look the same as light state results (except for the path), let every light process them
+  for (std::vector<HueApiResultCB>::iterator pos = aResultHandlers.begin(); pos!=aResultHandlers.end(); ++pos) {
+    (*pos)(aResult, aError);
+  }
+}
+
+
+void HueVdc::scheduleZoneGroupsUpdate(MLMicroSeconds aDelay)
+{
+  if (zoneGroupsTicket==0) {
+    zoneGroupsTicket = MainLoop::currentMainLoop().executeOnce(boost::bind(&HueVdc::updateZoneGroups, this), aDelay);
+  }
+}
+
+
+void HueVdc::invalidateZoneGroups()
+{
+  MainLoop::currentMainLoop().cancelExecutionTicket(zoneGroupsTicket);
+  // queued states were calculated for the current group setup
+  sendPendingLightStates();
+  // do not use groups any more until confirmed again, ignore answers still underway
+  zoneGroupsGeneration++;
+  zoneGroups.clear();
+}
+
+
+void HueVdc::updateZoneGroups()
+{
+  zoneGroupsTicket = 0;
+  invalidateZoneGroups();
+  hueComm.apiQuery("/groups", boost::bind(&HueVdc::zoneGroupsReceived, this, zoneGroupsGeneration, _1, _2));
+}
+
+
+static JsonObjectPtr lightsArray(const HueLightIdSet &aLights)
+{
+  JsonObjectPtr arr = JsonObject::newArray();
+  for (HueLightIdSet::const_iterator pos = aLights.begin(); pos!=aLights.end(); ++pos) {
+    arr->arrayAppend(JsonObject::newString(*pos));
+  }
+  return arr;
+}
+
+
+void HueVdc::zoneGroupsReceived(uint32_t aGeneration, JsonObjectPtr aResult, ErrorPtr aError)
+{
+  if (aGeneration!=zoneGroupsGeneration) return; // outdated
+  if (!Error::isOK(aError) || !aResult) {
+    LOG(LOG_WARNING, "hue optimizer: cannot read bridge groups, using per-light commands only: %s", Error::isOK(aError) ? "no answer" : aError->description().c_str());
+    return;
+  }
+  // the lights per zone
+  typedef std::map<int, HueLightIdSet> ZoneLightsMap;
+  ZoneLightsMap zoneLights;
+  for (DeviceVector::iterator pos = devices.begin(); pos!=devices.end(); ++pos) {
+    HueDevicePtr dev = boost::dynamic_pointer_cast<HueDevice>(*pos);
+    if (dev && dev->getZoneID()!=0) {
+      zoneLights[dev->getZoneID()].insert(dev->getLightID());
+    }
+  }
+  // check the groups we already have in the bridge
+  // { "1": { "name": "p44 zone 5", "lights": [ "1", "2" ], "type": "LightGroup", ... }, "2": ... }
+  std::set<int> zonesDone;
+  string prefix = HUE_ZONEGROUP_NAME_PREFIX;
+  aResult->resetKeyIteration();
+  string groupID;
+  JsonObjectPtr groupInfo;
+  while (aResult->nextKeyValue(groupID, groupInfo)) {
+    JsonObjectPtr o;
+    if (!groupInfo || !(o = groupInfo->get("name"))) continue;
+    string name = o->stringValue();
+    if (name.compare(0, prefix.size(), prefix)!=0) continue; // not one of ours
+    int zoneID = atoi(name.c_str()+prefix.size());
+    ZoneLightsMap::iterator zpos = zoneLights.find(zoneID);
+    if (zpos==zoneLights.end() || zpos->second.size()<HUE_ZONEGROUP_MIN_SIZE || zonesDone.count(zoneID)>0) {
+      // zone does not need a group (any more)
+      LOG(LOG_INFO, "hue optimizer: removing group %s (zone %d) no longer needed", groupID.c_str(), zoneID);
+      string url = "/groups/" + groupID;
+      hueComm.apiAction(httpMethodDELETE, url.c_str(), JsonObjectPtr(), NULL);
+      continue;
+    }
+    zonesDone.insert(zoneID);
+    HueZoneGroup zg;
+    zg.groupID = groupID;
+    zg.zoneID = zoneID;
+    zg.lights = zpos->second;
+    // compare membership
+    HueLightIdSet current;
+    o = groupInfo->get("lights");
+    if (o) {
+      for (int i=0; i<o->arrayLength(); i++) {
+        JsonObjectPtr l = o->arrayGet(i);
+        if (l) current.insert(l->stringValue());
+      }
+    }
+    if (current==zg.lights) {
+      // group is up to date, can be used right away
+      zoneGroups.push_back(zg);
+    }
+    else {
+      // update membership, use group when confirmed
+      LOG(LOG_INFO, "hue optimizer: updating group %s for zone %d to %d lights", groupID.c_str(), zoneID, (int)zg.lights.size());
+      JsonObjectPtr params = JsonObject::newObj();
+      params->add("lights", lightsArray(zg.lights));
+      string url = "/groups/" + groupID;
+      hueComm.apiAction(httpMethodPUT, url.c_str(), params, boost::bind(&HueVdc::zoneGroupConfirmed, this, aGeneration, zg, _1, _2));
+    }
+  }
+  // create groups for zones not yet having one
+  for (ZoneLightsMap::iterator zpos = zoneLights.begin(); zpos!=zoneLights.end(); ++zpos) {
+    if (zpos->second.size()<HUE_ZONEGROUP_MIN_SIZE || zonesDone.count(zpos->first)>0) continue;
+    LOG(LOG_INFO, "hue optimizer: creating group for zone %d with %d lights", zpos->first, (int)zpos->second.size());
+    HueZoneGroup zg;
+    zg.zoneID = zpos->first;
+    zg.lights = zpos->second;
+    JsonObjectPtr params = JsonObject::newObj();
+    params->add("name", JsonObject::newString(string_format("%s%d", HUE_ZONEGROUP_NAME_PREFIX, zg.zoneID)));
+    params->add("lights", lightsArray(zg.lights));
+    hueComm.apiAction(httpMethodPOST, "/groups", params, boost::bind(&HueVdc::zoneGroupConfirmed, this, aGeneration, zg, _1, _2));
+  }
+}
+
+
+void HueVdc::zoneGroupConfirmed(uint32_t aGeneration, HueZoneGroup aZoneGroup, JsonObjectPtr aResult, ErrorPtr aError)
+{
+  if (aGeneration!=zoneGroupsGeneration) return; // outdated
+  if (!Error::isOK(aError)) {
+    // Note: bridge might have run out of groups, zone will just use per-light commands
+    LOG(LOG_WARNING, "hue optimizer: cannot set up group for zone %d: %s", aZoneGroup.zoneID, aError->description().c_str());
+    return;
+  }
+  if (aZoneGroup.groupID.empty()) {
+    // newly created group, get ID: [{"success":{"id":"3"}}]
+    JsonObjectPtr s = HueComm::getSuccessItem(aResult);
+    JsonObjectPtr o;
+    if (!s || !(o = s->get("id"))) return;
+    aZoneGroup.groupID = o->stringValue();
+  }
+  zoneGroups.push_back(aZoneGroup);
+}
+
+
 #endif // ENABLE_HUE
@@ -32,6 +32,9 @@
 #include "huecomm.hpp"
 #include "vdc.hpp"
 
+#include <set>
+#include <list>
+
 using namespace std;
 
 namespace p44 {
@@ -50,6 +53,24 @@ namespace p44 {
   };
 
 
+  typedef std::set<string> HueLightIdSet;
+
+  /// bridge group mirroring the hue lights of a dS zone
+  typedef struct {
+    string groupID; ///< the bridge's group ID
+    int zoneID; ///< the dS zone
+    HueLightIdSet lights; ///< the lights in the group
+  } HueZoneGroup;
+  typedef std::vector<HueZoneGroup> HueZoneGroupsVector;
+
+  /// light state waiting to be sent, possibly combined with other lights' identical states into a group action
+  typedef struct {
+    JsonObjectPtr state;
+    HueApiResultCB resultHandler;
+  } HuePendingLightState;
+  typedef std::map<string, HuePendingLightState> HuePendingLightStateMap;
+
+
   typedef boost::intrusive_ptr<HueVdc> HueVdcPtr;
   class HueVdc : public Vdc
   {
@@ -60,6 +81,19 @@ namespace p44 {
 
     StatusCB collectedHandler;
 
+    // group action optimizer
+    HueZoneGroupsVector zoneGroups; ///< bridge groups mirroring zones, with confirmed membership
+    uint32_t zoneGroupsGeneration; ///< incremented whenever zone groups are invalidated, to ignore outdated bridge answers
+    long zoneGroupsTicket; ///< delayed zone groups update
+    HuePendingLightStateMap pendingStates; ///< light states queued in this mainloop cycle, by light ID
+    long stateFlushTicket;
+
+    // bulk state polling
+    long pollTicket; ///< next periodic poll
+    bool pollInProgress; ///< set while a /lights query is running
+    MLMicroSeconds lastPoll; ///< when the last successful poll result was distributed
+    std::list<SimpleCB> pollWaiters; ///< callbacks waiting for the running or next poll to complete
+
     /// @name persistent parameters
     /// @{
 
@@ -115,13 +149,51 @@ namespace p44 {
     /// @return string, single line extra info describing aspects of the device not visible elsewhere
     virtual string getExtraInfo() P44_OVERRIDE;
 
+    /// queue new light state for sending
+    /// @param aLightID the light
+    /// @param aState the new state
+    /// @param aResultHandler will be called with the result of the light or group action that applied the state
+    /// @note all states queued within the same mainloop cycle are sent together, see sendPendingLightStates()
+    void queueLightState(const string &aLightID, JsonObjectPtr aState, HueApiResultCB aResultHandler);
+
+    /// send queued light states now
+    /// @note identical states for all lights of a zone group are sent as a single group action,
+    ///   all others as per-light state changes
+    void sendPendingLightStates();
+
+    /// get the state of all lights from the bridge in one query and distribute it to the devices
+    /// @param aDoneCB will be called when the devices have received the polled state
+    /// @param aMaxAge if the last poll is not older than this, aDoneCB is called immediately.
+    ///   With 0, a new poll is always done (but a poll already in progress is shared)
+    void pollLights(SimpleCB aDoneCB, MLMicroSeconds aMaxAge);
+
+  protected:
+
+    // property access implementation
+    virtual int numProps(int aDomain, PropertyDescriptorPtr aParentDescriptor) P44_OVERRIDE;
+    virtual PropertyDescriptorPtr getDescriptorByIndex(int aPropIndex, int aDomain, PropertyDescriptorPtr aParentDescriptor) P44_OVERRIDE;
+    virtual bool accessField(PropertyAccessMode aMode, ApiValuePtr aPropValue, PropertyDescriptorPtr aPropertyDescriptor) P44_OVERRIDE;
+
   private:
 
+    void getBridgeStatistics(ApiValuePtr aStats);
+
+    void groupActionDone(std::vector<HueApiResultCB> aResultHandlers, JsonObjectPtr aResult, ErrorPtr aError);
+    void scheduleZoneGroupsUpdate(MLMicroSeconds aDelay);
+    void invalidateZoneGroups();
+    void updateZoneGroups();
+    void zoneGroupsReceived(uint32_t aGeneration, JsonObjectPtr aResult, ErrorPtr aError);
+    void zoneGroupConfirmed(uint32_t aGeneration, HueZoneGroup aZoneGroup, JsonObjectPtr aResult, ErrorPtr aError);
+
     void refindResultHandler(ErrorPtr aError);
     void searchResultHandler(Tristate aOnlyEstablish, ErrorPtr aError);
     void collectLights();
     void collectedLightsHandler(JsonObjectPtr aResult, ErrorPtr aError);
 
+    void schedulePoll(MLMicroSeconds aDelay);
+    void periodicPoll();
+    void lightsPolled(JsonObjectPtr aResult, ErrorPtr aError);
+
   };
 
 } // namespace p44
@@ -26,6 +26,7 @@
 
 #include "lightbehaviour.hpp"
 #include "colorlightbehaviour.hpp"
+#include "transitionscheduler.hpp"
 
 
 using namespace p44;
@@ -38,10 +39,9 @@ LedChainDevice::LedChainDevice(LedChainVdc *aVdcP, uint16_t aFirstLED, uint16_t
   inherited(aVdcP),
   firstLED(aFirstLED),
   numLEDs(aNumLEDs),
-  transitionTicket(0),
   startSoftEdge(0),
   endSoftEdge(0),
-  r(0), g(0), b(0)
+  r(0), g(0), b(0), w(0)
 {
   // type:config_for_type
   // Where:
@@ -79,6 +79,8 @@ LedChainDevice::LedChainDevice(LedChainVdc *aVdcP, uint16_t aFirstLED, uint16_t
   if (!configOK) {
     LOG(LOG_ERR, "invalid LedChain device config: %s", aDeviceConfig.c_str());
   }
+  // - precalculate soft edges
+  calculateOpacityRamp();
   // - is RGB
   colorClass = class_yellow_light;
   // just color light settings, which include a color scene table
@@ -116,13 +118,11 @@ void LedChainDevice::disconnect(bool aForgetParams, DisconnectCB aDisconnectResu
 }
 
 
-#define TRANSITION_STEP_TIME (10*MilliSecond)
-
 void LedChainDevice::applyChannelValues(SimpleCB aDoneCB, bool aForDimming)
 {
-  MLMicroSeconds transitionTime = 0;
+  TransitionScheduler &ts = TransitionScheduler::sharedTransitionScheduler();
   // abort previous transition
-  MainLoop::currentMainLoop().cancelExecutionTicket(transitionTicket);
+  ts.stopTransition(*this);
   // full color device
   RGBColorLightBehaviourPtr cl = boost::dynamic_pointer_cast<RGBColorLightBehaviour>(output);
   if (cl) {
@@ -130,11 +130,8 @@ void LedChainDevice::applyChannelValues(SimpleCB aDoneCB, bool aForDimming)
       // needs update
       // - derive (possibly new) color mode from changed channels
       cl->deriveColorMode();
-      // - calculate and start transition
-      //   TODO: depending to what channel has changed, take transition time from that channel. For now always using brightness transition time
-      transitionTime = cl->transitionTimeToNewBrightness();
-      cl->colorTransitionStep(); // init
-      applyChannelValueSteps(aForDimming, transitionTime==0 ? 1 : (double)TRANSITION_STEP_TIME/transitionTime);
+      // - start transition, every channel using its own transition time
+      ts.startTransition(DevicePtr(this), boost::bind(&LedChainDevice::transitionFrame, this, cl, aForDimming, _1));
     }
     // consider applied
     cl->appliedColorValues();
@@ -143,29 +140,21 @@ void LedChainDevice::applyChannelValues(SimpleCB aDoneCB, bool aForDimming)
 }
 
 
-void LedChainDevice::applyChannelValueSteps(bool aForDimming, double aStepSize)
+void LedChainDevice::transitionFrame(RGBColorLightBehaviourPtr aColorLight, bool aForDimming, bool aFinal)
 {
-  // RGB, RGBW or RGBWA dimmer
-  RGBColorLightBehaviourPtr cl = boost::dynamic_pointer_cast<RGBColorLightBehaviour>(output);
   // RGB lamp, get components for rendering loop
   if (getLedChainVdc().hasWhite()) {
-    cl->getRGBW(r, g, b, w, 255); // get brightness per R,G,B,W channel
+    aColorLight->getRGBW(r, g, b, w, 255); // get brightness per R,G,B,W channel
   }
   else {
-    cl->getRGB(r, g, b, 255); // get brightness per R,G,B channel
+    aColorLight->getRGB(r, g, b, 255); // get brightness per R,G,B channel
     w = 0;
   }
-  // trigger rendering the LEDs soon
+  // trigger rendering the LEDs in next frame
   getLedChainVdc().triggerRenderingRange(firstLED, numLEDs);
-  // next step
-  if (cl->colorTransitionStep(aStepSize)) {
+  if (!aFinal) {
     ALOG(LOG_DEBUG, "LED chain transitional values R=%d, G=%d, B=%d", (int)r, (int)g, (int)b);
-    // not yet complete, schedule next step
-    transitionTicket = MainLoop::currentMainLoop().executeOnce(
-      boost::bind(&LedChainDevice::applyChannelValueSteps, this, aForDimming, aStepSize),
-      TRANSITION_STEP_TIME
-    );
-    return; // will be called later again
+    return; // more frames to come
   }
   if (!aForDimming) {
     ALOG(LOG_INFO, "LED chain final values R=%d, G=%d, B=%d", (int)r, (int)g, (int)b);
@@ -173,32 +162,38 @@ void LedChainDevice::applyChannelValueSteps(bool aForDimming, double aStepSize)
 }
 
 
-double LedChainDevice::getLEDColor(uint16_t aLedNumber, uint8_t &aRed, uint8_t &aGreen, uint8_t &aBlue, uint8_t &aWhite)
+void LedChainDevice::calculateOpacityRamp()
 {
-  // index relative to beginning of my segment
-  uint16_t i = aLedNumber-firstLED;
-  if (i<0 || i>=numLEDs)
-    return 0; // no color at this point
-  // color at this point
-  aRed = r; aGreen = g; aBlue = b; aWhite = w;
-  // for soft edges
-  if (i>=startSoftEdge && i<=numLEDs-endSoftEdge) {
-    // not withing soft edge range, full opacity
-    return 1;
-  }
-  else {
-    if (i<startSoftEdge) {
+  opacityRamp.resize(numLEDs);
+  for (uint16_t i=0; i<numLEDs; i++) {
+    if (i>=startSoftEdge && i<=numLEDs-endSoftEdge) {
+      // not withing soft edge range, full opacity
+      opacityRamp[i] = LEDCHAIN_OPACITY_ONE;
+    }
+    else if (i<startSoftEdge) {
       // zero point is LED *before* first LED!
-      return 1.0/(startSoftEdge+1)*(i+1);
+      opacityRamp[i] = LEDCHAIN_OPACITY_ONE*(i+1)/(startSoftEdge+1);
     }
     else {
       // zero point is LED *after* last LED!
-      return 1.0/(endSoftEdge+1)*(numLEDs-i);
+      opacityRamp[i] = LEDCHAIN_OPACITY_ONE*(numLEDs-i)/(endSoftEdge+1);
     }
   }
 }
 
 
+double LedChainDevice::getLEDColor(uint16_t aLedNumber, uint8_t &aRed, uint8_t &aGreen, uint8_t &aBlue, uint8_t &aWhite)
+{
+  // index relative to beginning of my segment
+  if (aLedNumber<firstLED || aLedNumber>=firstLED+numLEDs)
+    return 0; // no color at this point
+  // color at this point
+  aRed = r; aGreen = g; aBlue = b; aWhite = w;
+  // opacity (soft edges)
+  return (double)opacityRamp[aLedNumber-firstLED]/LEDCHAIN_OPACITY_ONE;
+}
+
+
 void LedChainDevice::deriveDsUid()
 {
   // vDC implementation specific UUID:
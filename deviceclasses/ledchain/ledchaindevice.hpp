@@ -34,6 +34,9 @@ namespace p44 {
 
   class LedChainVdc;
 
+  /// fixed point value representing full opacity in LedChainDevice::opacityRamp
+  #define LEDCHAIN_OPACITY_ONE 256
+
   class LedChainDevice : public Device
   {
     typedef Device inherited;
@@ -55,11 +58,13 @@ namespace p44 {
 
     long long ledChainDeviceRowID; ///< the ROWID this device was created from (0=none)
 
-    long transitionTicket;
 
     /// current color values
     double r, g, b, w;
 
+    /// opacity per LED of the segment, fixed point (LEDCHAIN_OPACITY_ONE = fully opaque), precalculated from the soft edge config
+    std::vector<uint16_t> opacityRamp;
+
   public:
 
     LedChainDevice(LedChainVdc *aVdcP, uint16_t aFirstLED, uint16_t aNumLEDs, const string &aDeviceConfig);
@@ -139,7 +144,8 @@ namespace p44 {
 
   private:
 
-    virtual void applyChannelValueSteps(bool aForDimming, double aStepSize);
+    void calculateOpacityRamp();
+    void transitionFrame(RGBColorLightBehaviourPtr aColorLight, bool aForDimming, bool aFinal);
 
   };
   typedef boost::intrusive_ptr<LedChainDevice> LedChainDevicePtr;
@@ -64,7 +64,12 @@ LedChainVdc::LedChainVdc(int aInstanceNumber, const string aChainSpec, VdcHost *
   Vdc(aInstanceNumber, aVdcHostP, aTag),
   renderStart(0),
   renderEnd(0),
-  renderTicket(0),
+  renderPending(false),
+  frameTicket(0),
+  nextFrameTime(Never),
+  frameReady(false),
+  stopRendering(false),
+  frameMaxOutValue(0),
   maxOutValue(128) // by default, allow only half of max intensity (for full intensity a ~200 LED chain needs 70W power supply!)
 {
   // parse chain specification
@@ -83,6 +88,34 @@ LedChainVdc::LedChainVdc(int aInstanceNumber, const string aChainSpec, VdcHost *
   if (sscanf(rest.c_str(), "%d", &numLedsInChain)!=1) {
     numLedsInChain = 200; // default
   }
+  // compositing buffer: R,G,B,W planes
+  composeBuffer.resize(4*numLedsInChain);
+  // render thread synchronisation
+  pthread_mutex_init(&frameAccess, NULL);
+  pthread_cond_init(&frameSignal, NULL);
+}
+
+
+LedChainVdc::~LedChainVdc()
+{
+  MainLoop::currentMainLoop().cancelExecutionTicket(frameTicket);
+  stopRenderThread();
+  pthread_cond_destroy(&frameSignal);
+  pthread_mutex_destroy(&frameAccess);
+}
+
+
+void LedChainVdc::stopRenderThread()
+{
+  if (renderThread) {
+    // wake up render thread and make it end
+    pthread_mutex_lock(&frameAccess);
+    stopRendering = true;
+    pthread_cond_signal(&frameSignal);
+    pthread_mutex_unlock(&frameAccess);
+    renderThread->terminate(); // waits for the thread to end
+    renderThread.reset();
+  }
 }
 
 
@@ -93,9 +126,14 @@ void LedChainVdc::initialize(StatusCB aCompletedCB, bool aFactoryReset)
   string databaseName = getPersistentDataDir();
   string_format_append(databaseName, "%s_%d.sqlite3", vdcClassIdentifier(), getInstanceNumber());
   err = db.connectAndInitialize(databaseName.c_str(), LEDCHAINDEVICES_SCHEMA_VERSION, LEDCHAINDEVICES_SCHEMA_MIN_VERSION, aFactoryReset);
-  // Initialize chain driver
-  ws281xcomm = WS281xCommPtr(new WS281xComm(ledType, numLedsInChain));
-  ws281xcomm->begin();
+  if (!renderThread) {
+    // Initialize chain driver (only once, render thread uses it from now on)
+    ws281xcomm = WS281xCommPtr(new WS281xComm(ledType, numLedsInChain));
+    ws281xcomm->begin();
+    // launch render thread
+    stopRendering = false;
+    renderThread = MainLoop::currentMainLoop().executeInThread(boost::bind(&LedChainVdc::renderThreadRoutine, this, _1), NULL);
+  }
   // trigger a full chain rendering
   triggerRenderingRange(0, numLedsInChain);
   // done
@@ -103,26 +141,37 @@ void LedChainVdc::initialize(StatusCB aCompletedCB, bool aFactoryReset)
 }
 
 
-#define MIN_RENDER_INTERVAL (5*MilliSecond)
-
 void LedChainVdc::triggerRenderingRange(uint16_t aFirst, uint16_t aNum)
 {
-  if (!renderTicket) {
+  if (!renderPending) {
     // no rendering pending, initialize range
     renderStart = aFirst;
     renderEnd = aFirst+aNum;
+    renderPending = true;
   }
   else {
     // enlarge range
     if (aFirst<renderStart) renderStart = aFirst;
     if (aFirst+aNum>renderEnd) renderEnd = aFirst+aNum;
   }
-  if (!renderTicket) {
-    renderTicket = MainLoop::currentMainLoop().executeOnce(boost::bind(&LedChainVdc::render, this), MIN_RENDER_INTERVAL);
+  if (!frameTicket) {
+    // schedule frame, but not earlier than one frame interval after the previous one
+    MLMicroSeconds now = MainLoop::now();
+    if (nextFrameTime==Never || nextFrameTime<now) nextFrameTime = now;
+    frameTicket = MainLoop::currentMainLoop().executeOnce(boost::bind(&LedChainVdc::frameTick, this), nextFrameTime-now);
   }
 }
 
 
+void LedChainVdc::frameTick()
+{
+  frameTicket = 0;
+  nextFrameTime = MainLoop::now()+LEDCHAIN_FRAME_INTERVAL;
+  // compose new frame
+  if (renderPending) render();
+}
+
+
 Brightness LedChainVdc::getMinBrightness()
 {
   // scale up according to scaled down maximum, and make it 0..100
@@ -137,38 +186,85 @@ bool LedChainVdc::hasWhite()
 }
 
 
-
-static inline void increase(uint8_t &aByte, uint8_t aAmount, uint8_t aMax = 255)
+/// saturating add of a segment's color component, weighted by per-LED opacity, into a plane of the compose buffer
+/// @note plain loop over contiguous arrays without branches or calls, which allows the compiler to vectorize it
+static inline void compositeComponent(uint8_t *aPlane, const uint16_t *aOpacity, uint8_t aColor, uint16_t aCount)
 {
-  uint16_t r = aByte+aAmount;
-  if (r>aMax)
-    aByte = aMax;
-  else
-    aByte = (uint8_t)r;
+  for (uint16_t k=0; k<aCount; k++) {
+    uint16_t v = aPlane[k] + ((aColor*aOpacity[k])>>8);
+    aPlane[k] = v>255 ? 255 : v;
+  }
 }
 
 
 void LedChainVdc::render()
 {
-  renderTicket = 0; // done
-  for (uint16_t i=renderStart; i<renderEnd; i++) {
-    // TODO: optimize asking only devices active in this range
-    // for now, just ask all
-    uint8_t r, g, b, w;
-    uint8_t rv=0, gv=0, bv=0, wv=0; // composed
-    for (LedChainDeviceList::iterator pos = sortedSegments.begin(); pos!=sortedSegments.end(); ++pos) {
-      double opacity = (*pos)->getLEDColor(i, r, g, b, w);
-      if (opacity>0) {
-        increase(rv, opacity*r);
-        increase(gv, opacity*g);
-        increase(bv, opacity*b);
-        increase(wv, opacity*w);
+  renderPending = false; // done
+  if (renderEnd>numLedsInChain) renderEnd = numLedsInChain;
+  pthread_mutex_lock(&frameAccess);
+  if (renderStart<renderEnd) {
+    uint8_t *planes[4];
+    for (int c=0; c<4; c++) {
+      planes[c] = &composeBuffer[c*numLedsInChain];
+      memset(planes[c]+renderStart, 0, renderEnd-renderStart);
+    }
+    // only visit segments overlapping the render range: skip those ending before it...
+    size_t idx = upper_bound(segmentReach.begin(), segmentReach.end(), (int)renderStart)-segmentReach.begin();
+    for (; idx<segmentIndex.size(); idx++) {
+      LedChainDevice *seg = segmentIndex[idx];
+      // ...and stop at the first one starting after it
+      if (seg->firstLED>=renderEnd) break;
+      uint8_t color[4] = { (uint8_t)seg->r, (uint8_t)seg->g, (uint8_t)seg->b, (uint8_t)seg->w };
+      if ((color[0] | color[1] | color[2] | color[3])==0) continue; // dark segment, does not contribute
+      uint16_t from = seg->firstLED>renderStart ? seg->firstLED : renderStart;
+      int to = seg->firstLED+seg->numLEDs;
+      if (to>renderEnd) to = renderEnd;
+      if (to<=from) continue; // ends before render range
+      const uint16_t *opacity = &seg->opacityRamp[from-seg->firstLED];
+      for (int c=0; c<4; c++) {
+        if (color[c]) compositeComponent(planes[c]+from, opacity, color[c], to-from);
       }
     }
-    ws281xcomm->setColorDimmed(i, rv, gv, bv, wv, maxOutValue); // not more than maximum brightness allowed
   }
-  // transfer to hardware
-  ws281xcomm->show();
+  // hand over to render thread
+  frameMaxOutValue = maxOutValue;
+  frameReady = true;
+  pthread_cond_signal(&frameSignal);
+  pthread_mutex_unlock(&frameAccess);
+}
+
+
+void LedChainVdc::renderThreadRoutine(ChildThreadWrapper &aThread)
+{
+  // front frame, owned by this thread
+  std::vector<uint8_t> frontBuffer(composeBuffer.size());
+  while (true) {
+    // sleep until a new frame is ready (or thread must end)
+    pthread_mutex_lock(&frameAccess);
+    while (!frameReady && !stopRendering) {
+      pthread_cond_wait(&frameSignal, &frameAccess);
+    }
+    if (stopRendering || aThread.shouldTerminate()) {
+      pthread_mutex_unlock(&frameAccess);
+      break;
+    }
+    MLMicroSeconds frameStart = MainLoop::now();
+    uint8_t maxOut = frameMaxOutValue;
+    memcpy(&frontBuffer[0], &composeBuffer[0], frontBuffer.size());
+    frameReady = false;
+    pthread_mutex_unlock(&frameAccess);
+    // transfer to LED chain
+    const uint8_t *planes[4];
+    for (int c=0; c<4; c++) planes[c] = &frontBuffer[c*numLedsInChain];
+    for (uint16_t i=0; i<numLedsInChain; i++) {
+      ws281xcomm->setColorDimmed(i, planes[0][i], planes[1][i], planes[2][i], planes[3][i], maxOut); // not more than maximum brightness allowed
+    }
+    // transfer to hardware (blocking until sent)
+    ws281xcomm->show();
+    // keep minimal interval to next frame
+    MLMicroSeconds remaining = frameStart+LEDCHAIN_FRAME_INTERVAL-MainLoop::now();
+    if (remaining>0) usleep((useconds_t)remaining);
+  }
 }
 
 
@@ -197,6 +293,20 @@ bool LedChainVdc::segmentCompare(LedChainDevicePtr aFirst, LedChainDevicePtr aSe
 }
 
 
+void LedChainVdc::updateSegmentIndex()
+{
+  segmentIndex.clear();
+  segmentReach.clear();
+  int reach = 0;
+  for (LedChainDeviceList::iterator pos = sortedSegments.begin(); pos!=sortedSegments.end(); ++pos) {
+    int end = (*pos)->firstLED+(*pos)->numLEDs;
+    if (end>reach) reach = end;
+    segmentIndex.push_back(pos->get());
+    segmentReach.push_back(reach);
+  }
+}
+
+
 LedChainDevicePtr LedChainVdc::addLedChainDevice(uint16_t aFirstLED, uint16_t aNumLEDs, string aDeviceConfig)
 {
   LedChainDevicePtr newDev;
@@ -208,6 +318,7 @@ LedChainDevicePtr LedChainVdc::addLedChainDevice(uint16_t aFirstLED, uint16_t aN
     // add to my list and sort
     sortedSegments.push_back(newDev);
     sortedSegments.sort(segmentCompare);
+    updateSegmentIndex();
     return boost::dynamic_pointer_cast<LedChainDevice>(newDev);
   }
   // none added
@@ -225,6 +336,7 @@ void LedChainVdc::removeDevice(DevicePtr aDevice, bool aForget)
     for (LedChainDeviceList::iterator pos = sortedSegments.begin(); pos!=sortedSegments.end(); ++pos) {
       if (*pos==aDevice) {
         sortedSegments.erase(pos);
+        updateSegmentIndex();
         triggerRenderingRange(0,numLedsInChain); // fully re-render to remove deleted light immediately
         break;
       }
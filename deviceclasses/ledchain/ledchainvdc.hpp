@@ -39,6 +39,10 @@ namespace p44 {
 
   class LedChainVdc;
   class LedChainDevice;
+
+  /// minimal interval between frames sent to the LED chain
+  /// @note a WS281x LED needs 30uS to transfer, so this allows for chains of ~600 LEDs
+  #define LEDCHAIN_FRAME_INTERVAL (20*MilliSecond)
   typedef boost::intrusive_ptr<LedChainDevice> LedChainDevicePtr;
 
 
@@ -69,13 +73,28 @@ namespace p44 {
     typedef std::list<LedChainDevicePtr> LedChainDeviceList;
 
     LedChainDeviceList sortedSegments; ///< list of devices, ordered by firstLED
-    uint16_t renderStart; ///< first LED needing rendering (valid if renderTicket!=0)
-    uint16_t renderEnd; ///< end of rendering range = first LED not needing rendering (valid if renderTicket!=0)
-    long renderTicket;
+    typedef std::vector<LedChainDevice *> SegmentIndex;
+    SegmentIndex segmentIndex; ///< interval index over sortedSegments (same order), for finding the segments overlapping a LED range
+    std::vector<int> segmentReach; ///< for each entry in segmentIndex: max end LED (first LED not covered) of this and all preceeding segments
+    std::vector<uint8_t> composeBuffer; ///< compositing buffer (back frame), one plane of numLedsInChain bytes per color component (R,G,B,W)
+    uint16_t renderStart; ///< first LED needing rendering (valid if renderPending)
+    uint16_t renderEnd; ///< end of rendering range = first LED not needing rendering (valid if renderPending)
+    bool renderPending; ///< set when LEDs need to be rendered in next frame
+    long frameTicket; ///< mainloop frame tick, scheduled while rendering is pending
+    MLMicroSeconds nextFrameTime; ///< when the next mainloop frame tick is due
+
+    // render thread
+    ChildThreadWrapperPtr renderThread;
+    pthread_mutex_t frameAccess; ///< protects composeBuffer, frameReady, frameMaxOutValue and stopRendering
+    pthread_cond_t frameSignal; ///< signalled when frameReady or stopRendering gets set
+    bool frameReady; ///< set when composeBuffer contains a new frame not yet picked up by the render thread
+    bool stopRendering; ///< set to make the render thread end
+    uint8_t frameMaxOutValue; ///< maxOutValue to be used for the frame in composeBuffer
 
   public:
   
     LedChainVdc(int aInstanceNumber, const string aChainSpec, VdcHost *aVdcHostP, int aTag);
+    virtual ~LedChainVdc();
 
     void initialize(StatusCB aCompletedCB, bool aFactoryReset) P44_OVERRIDE;
 
@@ -123,8 +142,12 @@ namespace p44 {
     static bool segmentCompare(LedChainDevicePtr aFirst, LedChainDevicePtr aSecond);
     LedChainDevicePtr addLedChainDevice(uint16_t aFirstLED, uint16_t aNumLEDs, string aDeviceConfig);
 
+    void updateSegmentIndex();
     void triggerRenderingRange(uint16_t aFirst, uint16_t aNum);
+    void frameTick();
     void render();
+    void renderThreadRoutine(ChildThreadWrapper &aThread);
+    void stopRenderThread();
 
   };
 
@@ -26,6 +26,7 @@
 #include "lightbehaviour.hpp"
 #include "colorlightbehaviour.hpp"
 #include "movinglightbehaviour.hpp"
+#include "transitionscheduler.hpp"
 
 
 using namespace p44;
@@ -73,7 +74,8 @@ OlaDevice::OlaDevice(OlaVdc *aVdcP, const string &aDeviceConfig) :
   greenChannel(dmxNone),
   blueChannel(dmxNone),
   amberChannel(dmxNone),
-  transitionTicket(0)
+  hPosChannel(dmxNone),
+  vPosChannel(dmxNone)
 {
   // evaluate config
   string config = aDeviceConfig;
@@ -179,21 +181,17 @@ void OlaDevice::setDMXChannel(DmxChannel aChannel, DmxValue aChannelValue)
 }
 
 
-#define TRANSITION_STEP_TIME (10*MilliSecond)
-
 void OlaDevice::applyChannelValues(SimpleCB aDoneCB, bool aForDimming)
 {
-  MLMicroSeconds transitionTime = 0;
+  TransitionScheduler &ts = TransitionScheduler::sharedTransitionScheduler();
   // abort previous transition
-  MainLoop::currentMainLoop().cancelExecutionTicket(transitionTicket);
+  ts.stopTransition(*this);
   // generic device, show changed channels
   if (olaType==ola_dimmer) {
     // single channel dimmer
     LightBehaviourPtr l = boost::dynamic_pointer_cast<LightBehaviour>(output);
     if (l && l->brightnessNeedsApplying()) {
-      transitionTime = l->transitionTimeToNewBrightness();
-      l->brightnessTransitionStep(); // init
-      applyChannelValueSteps(aForDimming, transitionTime==0 ? 1 : (double)TRANSITION_STEP_TIME/transitionTime);
+      ts.startTransition(DevicePtr(this), boost::bind(&OlaDevice::dimmerTransitionFrame, this, l, aForDimming, _1));
     }
     // consider applied
     l->brightnessApplied();
@@ -207,12 +205,8 @@ void OlaDevice::applyChannelValues(SimpleCB aDoneCB, bool aForDimming)
         // needs update
         // - derive (possibly new) color mode from changed channels
         cl->deriveColorMode();
-        // - calculate and start transition
-        //   TODO: depending to what channel has changed, take transition time from that channel. For now always using brightness transition time
-        transitionTime = cl->transitionTimeToNewBrightness();
-        cl->colorTransitionStep(); // init
-        if (ml) ml->positionTransitionStep(); // init
-        applyChannelValueSteps(aForDimming, transitionTime==0 ? 1 : (double)TRANSITION_STEP_TIME/transitionTime);
+        // - start transition, every channel using its own transition time
+        ts.startTransition(DevicePtr(this), boost::bind(&OlaDevice::colorTransitionFrame, this, cl, ml, aForDimming, _1));
       }
       // consider applied
       if (ml) ml->appliedPosition();
@@ -223,91 +217,73 @@ void OlaDevice::applyChannelValues(SimpleCB aDoneCB, bool aForDimming)
 }
 
 
-void OlaDevice::applyChannelValueSteps(bool aForDimming, double aStepSize)
+void OlaDevice::dimmerTransitionFrame(LightBehaviourPtr aLight, bool aForDimming, bool aFinal)
 {
-  // generic device, show changed channels
-  if (olaType==ola_dimmer) {
-    // single channel dimmer
-    LightBehaviourPtr l = boost::dynamic_pointer_cast<LightBehaviour>(output);
-    double w = l->brightnessForHardware()*255/100;
-    setDMXChannel(whiteChannel,(DmxValue)w);
-    // next step
-    if (l->brightnessTransitionStep(aStepSize)) {
-      ALOG(LOG_DEBUG, "transitional DMX512 value %d=%d", whiteChannel, (int)w);
-      // not yet complete, schedule next step
-      transitionTicket = MainLoop::currentMainLoop().executeOnce(
-        boost::bind(&OlaDevice::applyChannelValueSteps, this, aForDimming, aStepSize),
-        TRANSITION_STEP_TIME
-      );
-      return; // will be called later again
-    }
-    if (!aForDimming) {
-      ALOG(LOG_INFO, "final DMX512 channel %d=%d", whiteChannel, (int)w);
-    }
-    l->brightnessApplied(); // confirm having applied the new brightness
+  // single channel dimmer
+  double w = aLight->brightnessForHardware()*255/100;
+  setDMXChannel(whiteChannel,(DmxValue)w);
+  if (!aFinal) {
+    ALOG(LOG_DEBUG, "transitional DMX512 value %d=%d", whiteChannel, (int)w);
+    return; // more frames to come
   }
-  else if (olaType==ola_fullcolordimmer) {
-    // RGB, RGBW or RGBWA dimmer
-    RGBColorLightBehaviourPtr cl = boost::dynamic_pointer_cast<RGBColorLightBehaviour>(output);
-    MovingLightBehaviourPtr ml = boost::dynamic_pointer_cast<MovingLightBehaviour>(output);
-    // RGB lamp, get components
-    double r,g,b;
-    double w = 0;
-    double a = 0;
-    if (whiteChannel!=dmxNone) {
-      if (amberChannel!=dmxNone) {
-        // RGBW
-        cl->getRGBWA(r, g, b, w, a, 255);
-        setDMXChannel(amberChannel,(DmxValue)a);
-      }
-      else {
-        // RGBW
-        cl->getRGBW(r, g, b, w, 255);
-      }
-      setDMXChannel(whiteChannel,(DmxValue)w);
+  if (!aForDimming) {
+    ALOG(LOG_INFO, "final DMX512 channel %d=%d", whiteChannel, (int)w);
+  }
+  aLight->brightnessApplied(); // confirm having applied the new brightness
+}
+
+
+void OlaDevice::colorTransitionFrame(RGBColorLightBehaviourPtr aColorLight, MovingLightBehaviourPtr aMovingLight, bool aForDimming, bool aFinal)
+{
+  // RGB lamp, get components
+  double r,g,b;
+  double w = 0;
+  double a = 0;
+  if (whiteChannel!=dmxNone) {
+    if (amberChannel!=dmxNone) {
+      // RGBW
+      aColorLight->getRGBWA(r, g, b, w, a, 255);
+      setDMXChannel(amberChannel,(DmxValue)a);
     }
     else {
-      // RGB
-      cl->getRGB(r, g, b, 255); // get brightness per R,G,B channel
-    }
-    // There's always RGB
-    setDMXChannel(redChannel,(DmxValue)r);
-    setDMXChannel(greenChannel,(DmxValue)g);
-    setDMXChannel(blueChannel,(DmxValue)b);
-    // there might be position as well
-    double h = 0;
-    double v = 0;
-    if (ml) {
-      h = ml->horizontalPosition->getTransitionalValue()/100*255;
-      setDMXChannel(hPosChannel,(DmxValue)h);
-      v = ml->verticalPosition->getTransitionalValue()/100*255;
-      setDMXChannel(vPosChannel,(DmxValue)v);
-      // step position
-      ml->positionTransitionStep(aStepSize);
-    }
-    // next step
-    if (cl->colorTransitionStep(aStepSize)) {
-      ALOG(LOG_DEBUG,
-        "transitional DMX512 values R(%hd)=%d, G(%hd)=%d, B(%hd)=%d, W(%hd)=%d, A(%hd)=%d, H(%hd)=%d, V(%hd)=%d",
-        redChannel, (int)r, greenChannel, (int)g, blueChannel, (int)b,
-        whiteChannel, (int)w, amberChannel, (int)a,
-        hPosChannel, (int)h, vPosChannel, (int)v
-      );
-      // not yet complete, schedule next step
-      transitionTicket = MainLoop::currentMainLoop().executeOnce(
-        boost::bind(&OlaDevice::applyChannelValueSteps, this, aForDimming, aStepSize),
-        TRANSITION_STEP_TIME
-      );
-      return; // will be called later again
-    }
-    if (!aForDimming) {
-      ALOG(LOG_INFO,
-        "final DMX512 values R(%hd)=%d, G(%hd)=%d, B(%hd)=%d, W(%hd)=%d, A(%hd)=%d, H(%hd)=%d, V(%hd)=%d",
-        redChannel, (int)r, greenChannel, (int)g, blueChannel, (int)b,
-        whiteChannel, (int)w, amberChannel, (int)a,
-        hPosChannel, (int)h, vPosChannel, (int)v
-      );
+      // RGBW
+      aColorLight->getRGBW(r, g, b, w, 255);
     }
+    setDMXChannel(whiteChannel,(DmxValue)w);
+  }
+  else {
+    // RGB
+    aColorLight->getRGB(r, g, b, 255); // get brightness per R,G,B channel
+  }
+  // There's always RGB
+  setDMXChannel(redChannel,(DmxValue)r);
+  setDMXChannel(greenChannel,(DmxValue)g);
+  setDMXChannel(blueChannel,(DmxValue)b);
+  // there might be position as well
+  double h = 0;
+  double v = 0;
+  if (aMovingLight) {
+    h = aMovingLight->horizontalPosition->getTransitionalValue()/100*255;
+    setDMXChannel(hPosChannel,(DmxValue)h);
+    v = aMovingLight->verticalPosition->getTransitionalValue()/100*255;
+    setDMXChannel(vPosChannel,(DmxValue)v);
+  }
+  if (!aFinal) {
+    ALOG(LOG_DEBUG,
+      "transitional DMX512 values R(%hd)=%d, G(%hd)=%d, B(%hd)=%d, W(%hd)=%d, A(%hd)=%d, H(%hd)=%d, V(%hd)=%d",
+      redChannel, (int)r, greenChannel, (int)g, blueChannel, (int)b,
+      whiteChannel, (int)w, amberChannel, (int)a,
+      hPosChannel, (int)h, vPosChannel, (int)v
+    );
+    return; // more frames to come
+  }
+  if (!aForDimming) {
+    ALOG(LOG_INFO,
+      "final DMX512 values R(%hd)=%d, G(%hd)=%d, B(%hd)=%d, W(%hd)=%d, A(%hd)=%d, H(%hd)=%d, V(%hd)=%d",
+      redChannel, (int)r, greenChannel, (int)g, blueChannel, (int)b,
+      whiteChannel, (int)w, amberChannel, (int)a,
+      hPosChannel, (int)h, vPosChannel, (int)v
+    );
   }
 }
 
@@ -23,6 +23,9 @@
 #define __p44vdc__oladevice__
 
 #include "device.hpp"
+#include "lightbehaviour.hpp"
+#include "colorlightbehaviour.hpp"
+#include "movinglightbehaviour.hpp"
 
 #if ENABLE_OLA
 
@@ -59,8 +62,6 @@ namespace p44 {
     DmxChannel hPosChannel;
     DmxChannel vPosChannel;
 
-    long transitionTicket;
-
   public:
 
     OlaDevice(OlaVdc *aVdcP, const string &aDeviceConfig);
@@ -131,7 +132,7 @@ namespace p44 {
   protected:
 
     /// Set DMX channel value
-    /// @param aChannel the DMX channel number - 1..512
+    /// @param aChannel the DMX channel number - 1..512 in the first universe, 513..1024 in the second etc.
     /// @param aChannelValue the value to set for the channel, 0..255
     void setDMXChannel(DmxChannel aChannel, DmxValue aChannelValue);
 
@@ -139,7 +140,8 @@ namespace p44 {
 
   private:
 
-    virtual void applyChannelValueSteps(bool aForDimming, double aStepSize);
+    void dimmerTransitionFrame(LightBehaviourPtr aLight, bool aForDimming, bool aFinal);
+    void colorTransitionFrame(RGBColorLightBehaviourPtr aColorLight, MovingLightBehaviourPtr aMovingLight, bool aForDimming, bool aFinal);
 
   };
   typedef boost::intrusive_ptr<OlaDevice> OlaDevicePtr;
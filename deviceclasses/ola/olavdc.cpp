@@ -62,15 +62,20 @@ string OlaDevicePersistence::dbSchemaUpgradeSQL(int aFromVersion, int &aToVersio
 
 
 OlaVdc::OlaVdc(int aInstanceNumber, VdcHost *aVdcHostP, int aTag) :
-  Vdc(aInstanceNumber, aVdcHostP, aTag)
+  Vdc(aInstanceNumber, aVdcHostP, aTag),
+  publishTicket(0),
+  olaClientP(NULL)
 {
+  pthread_mutex_init(&olaBufferAccess, NULL);
 }
 
 
-#define DMX512_INTERFRAME_PAUSE (50*MilliSecond)
+#define DMX512_INTERFRAME_PAUSE (25*MilliSecond) // full rate while channels change
+#define DMX512_REFRESH_INTERVAL (1*Second) // keepalive refresh of all universes when idle
 #define DMX512_RETRY_INTERVAL (15*Second)
 #define OLA_SETUP_RETRY_INTERVAL (30*Second)
-#define DMX512_UNIVERSE 42
+#define DMX512_UNIVERSE 42 // first universe, channels above 512 go to DMX512_UNIVERSE+1 etc.
+#define DMX512_MAX_UNIVERSES 16
 
 void OlaVdc::initialize(StatusCB aCompletedCB, bool aFactoryReset)
 {
@@ -80,7 +85,6 @@ void OlaVdc::initialize(StatusCB aCompletedCB, bool aFactoryReset)
   string_format_append(databaseName, "%s_%d.sqlite3", vdcClassIdentifier(), getInstanceNumber());
   err = db.connectAndInitialize(databaseName.c_str(), OLADEVICES_SCHEMA_VERSION, OLADEVICES_SCHEMA_MIN_VERSION, aFactoryReset);
   // launch OLA thread
-  pthread_mutex_init(&olaBufferAccess, NULL);
   olaThread = MainLoop::currentMainLoop().executeInThread(boost::bind(&OlaVdc::olaThreadRoutine, this, _1), NULL);
   // done
   aCompletedCB(ErrorPtr());
@@ -91,12 +95,14 @@ void OlaVdc::olaThreadRoutine(ChildThreadWrapper &aThread)
 {
   // turn on OLA logging when loglevel is debugging, otherwise off
   ola::InitLogging(LOGENABLED(LOG_DEBUG) ? ola::OLA_LOG_WARN : ola::OLA_LOG_NONE, ola::OLA_LOG_STDERR);
-  dmxBufferP = new ola::DmxBuffer;
   ola::client::StreamingClient::Options options;
   options.auto_start = false; // do not start olad from client
   olaClientP = new ola::client::StreamingClient(options);
-  if (olaClientP && dmxBufferP) {
-    dmxBufferP->Blackout();
+  // thread's own copy of the universes, sent without holding the lock
+  std::vector<ola::DmxBuffer> universes;
+  UniverseFlags pendingSend;
+  MLMicroSeconds lastRefresh = Never;
+  if (olaClientP) {
     while (!aThread.shouldTerminate()) {
       if (!olaClientP->Setup()) {
         // cannot start yet, wait a little
@@ -104,11 +110,35 @@ void OlaVdc::olaThreadRoutine(ChildThreadWrapper &aThread)
       }
       else {
         while (!aThread.shouldTerminate()) {
+          // pick up universes published by the mainloop
           pthread_mutex_lock(&olaBufferAccess);
-          bool ok = olaClientP->SendDMX(DMX512_UNIVERSE, *dmxBufferP, ola::client::StreamingClient::SendArgs());
+          while (universes.size()<publishedChanges.size()) {
+            universes.push_back(ola::DmxBuffer());
+            universes.back().Blackout();
+            pendingSend.push_back(false);
+          }
+          for (size_t u=0; u<publishedChanges.size(); u++) {
+            if (publishedChanges[u]) {
+              universes[u].Set(&publishedValues[u*dmxChannelsPerUniverse], dmxChannelsPerUniverse);
+              publishedChanges[u] = false;
+              pendingSend[u] = true;
+            }
+          }
           pthread_mutex_unlock(&olaBufferAccess);
+          // send changed universes at full rate, all universes only once in a while as a keepalive
+          MLMicroSeconds now = MainLoop::now();
+          bool refresh = now>=lastRefresh+DMX512_REFRESH_INTERVAL;
+          bool ok = true;
+          for (size_t u=0; u<universes.size(); u++) {
+            if (pendingSend[u] || refresh) {
+              ok = olaClientP->SendDMX((unsigned int)(DMX512_UNIVERSE+u), universes[u], ola::client::StreamingClient::SendArgs());
+              if (!ok) break;
+              pendingSend[u] = false;
+            }
+          }
           if (ok) {
             // successful send
+            if (refresh) lastRefresh = now;
             usleep(DMX512_INTERFRAME_PAUSE); // sleep a little between frames.
           }
           else {
@@ -124,11 +154,40 @@ void OlaVdc::olaThreadRoutine(ChildThreadWrapper &aThread)
 
 void OlaVdc::setDMXChannel(DmxChannel aChannel, DmxValue aChannelValue)
 {
-  if (dmxBufferP && aChannel>=1 && aChannel<=512) {
-    pthread_mutex_lock(&olaBufferAccess);
-    dmxBufferP->SetChannel(aChannel-1, aChannelValue);
-    pthread_mutex_unlock(&olaBufferAccess);
+  if (aChannel<1 || aChannel>DMX512_MAX_UNIVERSES*dmxChannelsPerUniverse) return; // invalid channel
+  size_t idx = aChannel-1;
+  size_t universe = idx/dmxChannelsPerUniverse;
+  if (idx>=stagedValues.size()) {
+    // universe not yet in use, add it (and all universes below)
+    stagedValues.resize((universe+1)*dmxChannelsPerUniverse, 0);
+    stagedChanges.resize(universe+1, true);
+  }
+  else if (stagedValues[idx]==aChannelValue) {
+    return; // no change
+  }
+  stagedValues[idx] = aChannelValue;
+  stagedChanges[universe] = true;
+  // publish all changes of this mainloop cycle at once
+  if (!publishTicket) {
+    publishTicket = MainLoop::currentMainLoop().executeOnce(boost::bind(&OlaVdc::publishDMXChanges, this));
+  }
+}
+
+
+void OlaVdc::publishDMXChanges()
+{
+  publishTicket = 0;
+  pthread_mutex_lock(&olaBufferAccess);
+  publishedValues.resize(stagedValues.size(), 0);
+  publishedChanges.resize(stagedChanges.size(), false);
+  for (size_t u=0; u<stagedChanges.size(); u++) {
+    if (stagedChanges[u]) {
+      memcpy(&publishedValues[u*dmxChannelsPerUniverse], &stagedValues[u*dmxChannelsPerUniverse], dmxChannelsPerUniverse);
+      publishedChanges[u] = true;
+      stagedChanges[u] = false;
+    }
   }
+  pthread_mutex_unlock(&olaBufferAccess);
 }
 
 
@@ -40,6 +40,7 @@ namespace p44 {
   typedef uint16_t DmxChannel;
   typedef uint8_t DmxValue;
   const DmxChannel dmxNone = 0; // no channel
+  const DmxChannel dmxChannelsPerUniverse = 512; // channels above 512 are in consecutive universes
 
   class OlaVdc;
   class OlaDevice;
@@ -65,10 +66,20 @@ namespace p44 {
 
     OlaDevicePersistence db;
 
-    // OLA Thread
+    // DMX channel values, one block of dmxChannelsPerUniverse values per universe
+    typedef std::vector<DmxValue> DmxChannelValues;
+    typedef std::vector<bool> UniverseFlags;
+
+    // - mainloop side
+    DmxChannelValues stagedValues; ///< current channel values as set by the devices
+    UniverseFlags stagedChanges; ///< universes changed since last publishing to the OLA thread
+    long publishTicket; ///< deferred publishing of all channel changes made within the current mainloop cycle
+
+    // - OLA Thread
     ChildThreadWrapperPtr olaThread;
-    pthread_mutex_t olaBufferAccess;
-    ola::DmxBuffer *dmxBufferP;
+    pthread_mutex_t olaBufferAccess; ///< protects publishedValues and publishedChanges
+    DmxChannelValues publishedValues; ///< channel values published for sending
+    UniverseFlags publishedChanges; ///< universes changed since last picked up by the OLA thread
     ola::client::StreamingClient *olaClientP;
 
 
@@ -107,6 +118,7 @@ namespace p44 {
 
     void olaThreadRoutine(ChildThreadWrapper &aThread);
     void setDMXChannel(DmxChannel aChannel, DmxValue aChannelValue);
+    void publishDMXChanges();
 
   };
 
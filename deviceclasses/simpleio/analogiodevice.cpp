@@ -26,14 +26,14 @@
 #include "lightbehaviour.hpp"
 #include "colorlightbehaviour.hpp"
 #include "climatecontrolbehaviour.hpp"
+#include "transitionscheduler.hpp"
 
 using namespace p44;
 
 
 AnalogIODevice::AnalogIODevice(StaticVdc *aVdcP, const string &aDeviceConfig) :
   StaticDevice((Vdc *)aVdcP),
-  analogIOType(analogio_unknown),
-  transitionTicket(0)
+  analogIOType(analogio_unknown)
 {
   // Config is:
   //  <pin(s) specification>:[<behaviour mode>]
@@ -125,21 +125,17 @@ AnalogIODevice::AnalogIODevice(StaticVdc *aVdcP, const string &aDeviceConfig) :
 
 
 
-#define TRANSITION_STEP_TIME (10*MilliSecond)
-
 void AnalogIODevice::applyChannelValues(SimpleCB aDoneCB, bool aForDimming)
 {
-  MLMicroSeconds transitionTime = 0;
+  TransitionScheduler &ts = TransitionScheduler::sharedTransitionScheduler();
   // abort previous transition
-  MainLoop::currentMainLoop().cancelExecutionTicket(transitionTicket);
+  ts.stopTransition(*this);
   // generic device, show changed channels
   if (analogIOType==analogio_dimmer) {
     // single channel PWM dimmer
     LightBehaviourPtr l = boost::dynamic_pointer_cast<LightBehaviour>(output);
     if (l && l->brightnessNeedsApplying()) {
-      transitionTime = l->transitionTimeToNewBrightness();
-      l->brightnessTransitionStep(); // init
-      applyChannelValueSteps(aForDimming, transitionTime==0 ? 1 : (double)TRANSITION_STEP_TIME/transitionTime);
+      ts.startTransition(DevicePtr(this), boost::bind(&AnalogIODevice::dimmerTransitionFrame, this, l, aForDimming, _1));
     }
     // consider applied
     l->brightnessApplied();
@@ -152,11 +148,8 @@ void AnalogIODevice::applyChannelValues(SimpleCB aDoneCB, bool aForDimming)
         // needs update
         // - derive (possibly new) color mode from changed channels
         cl->deriveColorMode();
-        // - calculate and start transition
-        //   TODO: depending to what channel has changed, take transition time from that channel. For now always using brightness transition time
-        transitionTime = cl->transitionTimeToNewBrightness();
-        cl->colorTransitionStep(); // init
-        applyChannelValueSteps(aForDimming, transitionTime==0 ? 1 : (double)TRANSITION_STEP_TIME/transitionTime);
+        // - start transition, every channel using its own transition time
+        ts.startTransition(DevicePtr(this), boost::bind(&AnalogIODevice::colorTransitionFrame, this, cl, aForDimming, _1));
       } // if needs update
       // consider applied
       cl->appliedColorValues();
@@ -178,64 +171,49 @@ void AnalogIODevice::applyChannelValues(SimpleCB aDoneCB, bool aForDimming)
 
 
 
-void AnalogIODevice::applyChannelValueSteps(bool aForDimming, double aStepSize)
+void AnalogIODevice::dimmerTransitionFrame(LightBehaviourPtr aLight, bool aForDimming, bool aFinal)
 {
-  // generic device, show changed channels
-  if (analogIOType==analogio_dimmer) {
-    // single channel PWM dimmer
-    LightBehaviourPtr l = boost::dynamic_pointer_cast<LightBehaviour>(output);
-    double w = l->brightnessForHardware();
-    double pwm = l->brightnessToPWM(w, 100);
-    analogIO->setValue(pwm);
-    // next step
-    if (l->brightnessTransitionStep(aStepSize)) {
-      ALOG(LOG_DEBUG, "AnalogIO transitional PWM value: %.2f", w);
-      // not yet complete, schedule next step
-      transitionTicket = MainLoop::currentMainLoop().executeOnce(
-        boost::bind(&AnalogIODevice::applyChannelValueSteps, this, aForDimming, aStepSize),
-        TRANSITION_STEP_TIME
-      );
-      return; // will be called later again
-    }
-    if (!aForDimming) ALOG(LOG_INFO, "AnalogIO final PWM value: %.2f", w);
+  // single channel PWM dimmer
+  double w = aLight->brightnessForHardware();
+  double pwm = aLight->brightnessToPWM(w, 100);
+  analogIO->setValue(pwm);
+  if (!aFinal) {
+    ALOG(LOG_DEBUG, "AnalogIO transitional PWM value: %.2f", w);
+    return; // more frames to come
   }
-  else if (analogIOType==analogio_rgbdimmer) {
-    // three channel RGB PWM dimmer
-    RGBColorLightBehaviourPtr cl = boost::dynamic_pointer_cast<RGBColorLightBehaviour>(output);
-    // RGB lamp, get components
-    double r, g, b, pwm;
-    double w = 0;
-    if (analogIO4) {
-      // RGBW lamp
-      cl->getRGBW(r, g, b, w, 100); // get brightness for R,G,B,W channels
-      pwm = cl->brightnessToPWM(w, 100);
-      analogIO4->setValue(pwm);
-    }
-    else {
-      // RGB only
-      cl->getRGB(r, g, b, 100); // get brightness for R,G,B channels
-    }
-    // - red
-    pwm = cl->brightnessToPWM(r, 100);
-    analogIO->setValue(pwm);
-    // - green
-    pwm = cl->brightnessToPWM(g, 100);
-    analogIO2->setValue(pwm);
-    // - blue
-    pwm = cl->brightnessToPWM(b, 100);
-    analogIO3->setValue(pwm);
-    // next step
-    if (cl->colorTransitionStep(aStepSize)) {
-      ALOG(LOG_DEBUG, "AnalogIO transitional RGBW values: R=%.2f G=%.2f, B=%.2f, W=%.2f", r, g, b, w);
-      // not yet complete, schedule next step
-      transitionTicket = MainLoop::currentMainLoop().executeOnce(
-        boost::bind(&AnalogIODevice::applyChannelValueSteps, this, aForDimming, aStepSize),
-        TRANSITION_STEP_TIME
-      );
-      return; // will be called later again
-    }
-    if (!aForDimming) ALOG(LOG_INFO, "AnalogIO final RGBW values: R=%.2f G=%.2f, B=%.2f, W=%.2f", r, g, b, w);
+  if (!aForDimming) ALOG(LOG_INFO, "AnalogIO final PWM value: %.2f", w);
+}
+
+
+void AnalogIODevice::colorTransitionFrame(RGBColorLightBehaviourPtr aColorLight, bool aForDimming, bool aFinal)
+{
+  // RGB lamp, get components
+  double r, g, b, pwm;
+  double w = 0;
+  if (analogIO4) {
+    // RGBW lamp
+    aColorLight->getRGBW(r, g, b, w, 100); // get brightness for R,G,B,W channels
+    pwm = aColorLight->brightnessToPWM(w, 100);
+    analogIO4->setValue(pwm);
+  }
+  else {
+    // RGB only
+    aColorLight->getRGB(r, g, b, 100); // get brightness for R,G,B channels
+  }
+  // - red
+  pwm = aColorLight->brightnessToPWM(r, 100);
+  analogIO->setValue(pwm);
+  // - green
+  pwm = aColorLight->brightnessToPWM(g, 100);
+  analogIO2->setValue(pwm);
+  // - blue
+  pwm = aColorLight->brightnessToPWM(b, 100);
+  analogIO3->setValue(pwm);
+  if (!aFinal) {
+    ALOG(LOG_DEBUG, "AnalogIO transitional RGBW values: R=%.2f G=%.2f, B=%.2f, W=%.2f", r, g, b, w);
+    return; // more frames to come
   }
+  if (!aForDimming) ALOG(LOG_INFO, "AnalogIO final RGBW values: R=%.2f G=%.2f, B=%.2f, W=%.2f", r, g, b, w);
 }
 
 
@@ -23,6 +23,8 @@
 #define __p44vdc__analogiodevice__
 
 #include "device.hpp"
+#include "lightbehaviour.hpp"
+#include "colorlightbehaviour.hpp"
 
 #if ENABLE_STATIC
 
@@ -55,8 +57,6 @@ namespace p44 {
 
     AnalogIoType analogIOType;
 
-    long transitionTicket;
-
   public:
     AnalogIODevice(StaticVdc *aVdcP, const string &aDeviceConfig);
 
@@ -101,7 +101,8 @@ namespace p44 {
 
   private:
 
-    virtual void applyChannelValueSteps(bool aForDimming, double aStepSize);
+    void dimmerTransitionFrame(LightBehaviourPtr aLight, bool aForDimming, bool aFinal);
+    void colorTransitionFrame(RGBColorLightBehaviourPtr aColorLight, bool aForDimming, bool aFinal);
 
   };
 
@@ -56,7 +56,9 @@ Device::Device(Vdc *aVdcP) :
   applyInProgress(false),
   missedApplyAttempts(0),
   updateInProgress(false),
-  serializerWatchdogTicket(0)
+  serializerWatchdogTicket(0),
+  pushTicket(0),
+  indexed(false)
 {
 }
 
@@ -91,6 +93,7 @@ void Device::addToModelUIDHash(string &aHashedString)
 
 Device::~Device()
 {
+  MainLoop::currentMainLoop().cancelExecutionTicket(pushTicket);
   buttons.clear();
   binaryInputs.clear();
   sensors.clear();
@@ -1290,8 +1293,8 @@ void Device::saveScene(SceneNo aSceneNo)
   ALOG(LOG_NOTICE, "SaveScene(%d)", aSceneNo);
   SceneDeviceSettingsPtr scenes = boost::dynamic_pointer_cast<SceneDeviceSettings>(deviceSettings);
   if (scenes) {
-    // we have a device-wide scene table, get the scene object
-    DsScenePtr scene = scenes->getScene(aSceneNo);
+    // we have a device-wide scene table, get the scene object for modification
+    DsScenePtr scene = scenes->getScene(aSceneNo, true);
     if (scene) {
       // scene found, now capture to all of our outputs
       if (output) {
@@ -1319,7 +1322,7 @@ void Device::outputSceneValueSaved(DsScenePtr aScene)
         aScene->setDontCare(mustBeDontCare);
         // also update the off scene's dontCare
         SceneDeviceSettingsPtr scenes = boost::dynamic_pointer_cast<SceneDeviceSettings>(deviceSettings);
-        DsScenePtr offScene = scenes->getScene(offSceneForArea(area));
+        DsScenePtr offScene = scenes->getScene(offSceneForArea(area), true);
         if (offScene) {
           offScene->setDontCare(mustBeDontCare);
           // update scene in scene table and DB if dirty
@@ -1354,6 +1357,65 @@ bool Device::processControlValue(const string &aName, double aValue)
 
 
 
+// MARK: ===== coalesced property pushes
+
+
+// merge property query aFrom into aInto
+static void mergePropertyQuery(ApiValuePtr aInto, ApiValuePtr aFrom)
+{
+  aFrom->resetKeyIteration();
+  string key;
+  ApiValuePtr val;
+  while (aFrom->nextKeyValue(key, val)) {
+    ApiValuePtr existing = aInto->get(key);
+    if (existing && existing->isType(apivalue_object) && val->isType(apivalue_object)) {
+      // both are subqueries, merge them
+      mergePropertyQuery(existing, val);
+    }
+    else if (!existing || val->isNull()) {
+      // new element, or NULL (=all of it) supersedes more specific subquery
+      aInto->add(key, val);
+    }
+  }
+}
+
+
+bool Device::queuePropertyPush(ApiValuePtr aPropertyQuery, bool aImmediate)
+{
+  if (announced==Never || !getVdcHost().getSessionConnection()) {
+    // cannot push now, let pushNotification handle (and log) the situation
+    return pushNotification(aPropertyQuery, ApiValuePtr(), VDC_API_DOMAIN);
+  }
+  if (!pendingPushQuery) {
+    // first change to push, schedule sending
+    pendingPushQuery = aPropertyQuery;
+    pushTicket = MainLoop::currentMainLoop().executeOnce(boost::bind(&Device::flushPropertyPushes, this), getVdcHost().getPushCoalescingDelay());
+  }
+  else {
+    // add to already pending changes
+    mergePropertyQuery(pendingPushQuery, aPropertyQuery);
+  }
+  if (aImmediate) {
+    // send now, values must not be overwritten by a later event before they are reported
+    MainLoop::currentMainLoop().cancelExecutionTicket(pushTicket);
+    flushPropertyPushes();
+  }
+  return true;
+}
+
+
+void Device::flushPropertyPushes()
+{
+  pushTicket = 0;
+  ApiValuePtr query = pendingPushQuery;
+  pendingPushQuery.reset();
+  if (query) {
+    pushNotification(query, ApiValuePtr(), VDC_API_DOMAIN);
+  }
+}
+
+
+
 // MARK: ===== persistent device params
 
 
@@ -1684,7 +1746,7 @@ PropertyContainerPtr Device::getContainer(const PropertyDescriptorPtr &aProperty
   else if (aPropertyDescriptor->hasObjectKey(device_scenes_key)) {
     SceneDeviceSettingsPtr scenes = boost::dynamic_pointer_cast<SceneDeviceSettings>(deviceSettings);
     if (scenes) {
-      return scenes->getScene(aPropertyDescriptor->fieldKey());
+      return scenes->getScene(aPropertyDescriptor->fieldKey(), true); // might get written
     }
   }
   else if (aPropertyDescriptor->hasObjectKey(device_output_key)) {
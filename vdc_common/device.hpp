@@ -98,6 +98,13 @@ namespace p44 {
     bool updateInProgress; ///< set when updating channel values from hardware is in progress
     long serializerWatchdogTicket; ///< watchdog terminating non-responding hardware requests
 
+    // coalesced pushNotification of property changes
+    ApiValuePtr pendingPushQuery; ///< merged query for all property changes waiting to be pushed
+    long pushTicket; ///< flushes pending property pushes
+
+    // vdc host registry indexing state
+    bool indexed; ///< set while device is entered in the vdc host's output type index
+
   public:
     Device(Vdc *aVdcP);
     virtual ~Device();
@@ -191,6 +198,15 @@ namespace p44 {
     /// get reference to vDC host
     VdcHost &getVdcHost() const { return vdcP->getVdcHost(); };
 
+    /// queue a property change for being pushed
+    /// @param aPropertyQuery description of what property change should be pushed (same syntax as in getProperty API)
+    /// @param aImmediate if set, the change is sent right now (together with already pending changes). This is
+    ///   needed for events (like button clicks), where each occurrence must be reported with its own values.
+    /// @return true if push is queued, false otherwise (e.g. no vdSM connection, or device not yet announced)
+    /// @note all property changes queued within one mainloop cycle (or within the vdc host's push coalescing delay)
+    ///   are merged and sent as a single pushNotification. Values are read when the pushNotification is sent.
+    bool queuePropertyPush(ApiValuePtr aPropertyQuery, bool aImmediate = false);
+
     /// install specific or standard device settings
     /// @param aDeviceSettings specific device settings, if NULL, standard minimal settings will be used
     void installSettings(DeviceSettingsPtr aDeviceSettings = DeviceSettingsPtr());
@@ -204,6 +220,10 @@ namespace p44 {
     /// @return NULL if device has no scenes, scene device settings otherwise 
     SceneDeviceSettingsPtr getScenes() { return boost::dynamic_pointer_cast<SceneDeviceSettings>(deviceSettings); };
 
+    /// get zone
+    /// @return global dS zone ID this device is in, 0 if none assigned
+    int getZoneID() { return deviceSettings ? deviceSettings->zoneID : 0; };
+
     /// this will be called just before a device is added to the vdc, and thus needs to be fully constructed
     /// (settings, scenes, behaviours) and MUST have determined the henceforth invariable dSUID.
     /// After having received this call, the device must also be ready to load persistent settings.
@@ -496,6 +516,8 @@ namespace p44 {
 
     DsGroupMask behaviourGroups();
 
+    void flushPropertyPushes();
+
     void dimAutostopHandler(DsChannelType aChannel);
     void dimHandler(ChannelBehaviourPtr aChannel, double aIncrement, MLMicroSeconds aNow);
     void dimDoneHandler(ChannelBehaviourPtr aChannel, double aIncrement, MLMicroSeconds aNextDimAt);
@@ -35,6 +35,13 @@ DeviceSettings::DeviceSettings(Device &aDevice) :
 }
 
 
+void DeviceSettings::markDirty()
+{
+  inherited::markDirty();
+  device.getVdcHost().markForSave(device.getDsUid());
+}
+
+
 // SQLIte3 table name to store these parameters to
 const char *DeviceSettings::tableName()
 {
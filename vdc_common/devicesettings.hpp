@@ -65,6 +65,19 @@ namespace p44 {
     virtual void loadFromRow(sqlite3pp::query::iterator &aRow, int &aIndex, uint64_t *aCommonFlagsP);
     virtual void bindToStatement(sqlite3pp::statement &aStatement, int &aIndex, const char *aParentIdentifier, uint64_t aCommonFlags);
 
+    /// mark settings dirty, and register device for the next save batch
+    void markDirty();
+
+    /// set a persistent setting, and if changed, mark dirty and register device for the next save batch
+    /// @return true if value has changed
+    template<typename T> bool setPVar(T &aTargetVar, const T aNewValue)
+    {
+      if (aTargetVar==aNewValue) return false;
+      aTargetVar = aNewValue;
+      markDirty();
+      return true;
+    };
+
     /// @}
 
   };
@@ -39,7 +39,9 @@ using namespace p44;
 DsAddressable::DsAddressable(VdcHost *aVdcHostP) :
   vdcHostP(aVdcHostP),
   announced(Never),
-  announcing(Never)
+  announcing(Never),
+  announceQueued(false),
+  announceTicket(0)
 {
 }
 
@@ -166,6 +168,8 @@ ErrorPtr DsAddressable::handleMethod(VdcApiRequestPtr aRequest, const string &aM
       }
       respErr = accessProperty(preload ? access_write_preload : access_write, value, ApiValuePtr(), VDC_API_DOMAIN, PropertyDescriptorPtr());
       if (Error::isOK(respErr)) {
+        // property writes usually modify persistent settings, have them saved in next save batch
+        getVdcHost().markForSave(getDsUid());
         // send back OK if write was successful
         respErr = Error::ok();
       }
@@ -60,6 +60,8 @@ namespace p44 {
     /// announcement status
     MLMicroSeconds announced; ///< set when last announced to the vdSM
     MLMicroSeconds announcing; ///< set when announcement has been started (but not yet confirmed)
+    bool announceQueued; ///< set while waiting in the vdc host's pending announcement queue
+    long announceTicket; ///< times out in-flight announcement, or re-queues a timed out announcement for retry
 
   protected:
     VdcHost *vdcHostP;
@@ -66,7 +66,9 @@ bool DsBehaviour::pushBehaviourState()
     ApiValuePtr subQuery = query->newValue(apivalue_object);
     subQuery->add(string_format("%zu",index), subQuery->newValue(apivalue_null));
     query->add(string(getTypeName()).append("States"), subQuery);
-    return device.pushNotification(query, ApiValuePtr(), VDC_API_DOMAIN);
+    // merged with other state changes of the device in the same mainloop cycle, except for
+    // behaviours without a defined state (buttons): their events must each be pushed on their own
+    return device.queuePropertyPush(query, !hasDefinedState());
   }
   // could not push
   return false;
@@ -101,6 +103,13 @@ ErrorPtr DsBehaviour::forget()
 }
 
 
+void DsBehaviour::markDirty()
+{
+  inheritedParams::markDirty();
+  device.getVdcHost().markForSave(device.getDsUid());
+}
+
+
 // MARK: ===== property access
 
 
@@ -154,6 +154,20 @@ namespace p44 {
     /// forget any parameters stored in persistent DB
     ErrorPtr forget();
 
+    /// mark behaviour parameters dirty, and register device for the next save batch
+    void markDirty();
+
+    /// set a persistent parameter, and if changed, mark dirty and register device for the next save batch
+    /// @note hides PersistentParams::setPVar(), which only sets the dirty flag
+    /// @return true if value has changed
+    template<typename T> bool setPVar(T &aTargetVar, const T aNewValue)
+    {
+      if (aTargetVar==aNewValue) return false;
+      aTargetVar = aNewValue;
+      markDirty();
+      return true;
+    };
+
     /// @}
 
     /// get the index value
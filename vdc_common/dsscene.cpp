@@ -480,32 +480,51 @@ DsScenePtr SceneDeviceSettings::newUndoStateScene()
 
 
 
-DsScenePtr SceneDeviceSettings::getScene(SceneNo aSceneNo)
+DsScenePtr SceneDeviceSettings::getScene(SceneNo aSceneNo, bool aForUpdate)
 {
-  // see if we have a stored version different from the default
-  DsSceneMap::iterator pos = scenes.find(aSceneNo);
-  if (pos!=scenes.end()) {
-    // found scene params in map
-    return pos->second;
+  if (aSceneNo>=NUM_SCENE_SLOTS) {
+    // outside scene table, just return default values for this scene
+    return newDefaultScene(aSceneNo);
   }
-  else {
-    // just return default values for this scene
+  DsScenePtr scene = sceneSlots[aSceneNo];
+  if (customizedScenes.test(aSceneNo)) {
+    // stored version different from the default
+    return scene;
+  }
+  if (aForUpdate) {
+    // caller intends to modify: never hand out the cached default scene, but a private copy.
+    // It will replace the cached default in the table when posted with updateScene()
     return newDefaultScene(aSceneNo);
   }
+  if (!scene || scene->isDirty()) {
+    // no cached default yet, or cached default was modified without being posted via updateScene()
+    // -> (re)create default scene and cache it
+    scene = newDefaultScene(aSceneNo);
+    sceneSlots[aSceneNo] = scene;
+  }
+  return scene;
 }
 
 
 
 void SceneDeviceSettings::updateScene(DsScenePtr aScene)
 {
+  SceneNo sceneNo = aScene->sceneNo;
+  if (sceneNo>=NUM_SCENE_SLOTS) {
+    SALOG(device, LOG_ERR, "Cannot store scene %d: outside scene table", sceneNo);
+    return;
+  }
   if (aScene->rowid==0) {
-    // unstored so far, add to map of non-default scenes
-    scenes[aScene->sceneNo] = aScene;
+    // unstored so far, put into scene table as non-default scene (replacing cached default, if any)
+    sceneSlots[sceneNo] = aScene;
+    customizedScenes.set(sceneNo);
   }
   // anyway, mark scene dirty
   aScene->markDirty();
   // as we need the ROWID of the settings as parentID, make sure we get saved if we don't have one
   if (rowid==0) markDirty();
+  // have device saved in next save batch
+  device.getVdcHost().markForSave(device.getDsUid());
 }
 
 
@@ -553,8 +572,13 @@ ErrorPtr SceneDeviceSettings::loadChildren()
       int index = 0;
       uint64_t flags;
       scene->loadFromRow(row, index, &flags);
-      // - put scene into map of non-default scenes
-      scenes[scene->sceneNo] = scene;
+      if (scene->sceneNo>=NUM_SCENE_SLOTS) {
+        SALOG(device, LOG_ERR, "Ignoring stored scene %d: outside scene table", scene->sceneNo);
+        continue; // reuse object for next row
+      }
+      // - put scene into table as non-default scene
+      sceneSlots[scene->sceneNo] = scene;
+      customizedScenes.set(scene->sceneNo);
       // - fresh object for next row
       scene = newDefaultScene(0);
     }
@@ -573,10 +597,11 @@ ErrorPtr SceneDeviceSettings::saveChildren()
   if (rowid!=0) {
     // my own ROWID is the parent key for the children
     string parentID = parentIdForScenes();
-    // save all elements of the map (only dirty ones will be actually stored to DB
-    for (DsSceneMap::iterator pos = scenes.begin(); pos!=scenes.end(); ++pos) {
-      err = pos->second->saveToStore(parentID.c_str(), true); // multiple children of same parent allowed
-      if (!Error::isOK(err)) SALOG(device, LOG_ERR,"Error saving scene %d: %s", pos->second->sceneNo, err->description().c_str());
+    // save all non-default scenes (only dirty ones will be actually stored to DB
+    for (int i=0; i<NUM_SCENE_SLOTS; i++) {
+      if (!customizedScenes.test(i)) continue;
+      err = sceneSlots[i]->saveToStore(parentID.c_str(), true); // multiple children of same parent allowed
+      if (!Error::isOK(err)) SALOG(device, LOG_ERR,"Error saving scene %d: %s", i, err->description().c_str());
     }
   }
   return err;
@@ -586,8 +611,9 @@ ErrorPtr SceneDeviceSettings::saveChildren()
 ErrorPtr SceneDeviceSettings::deleteChildren()
 {
   ErrorPtr err;
-  for (DsSceneMap::iterator pos = scenes.begin(); pos!=scenes.end(); ++pos) {
-    err = pos->second->deleteFromStore();
+  for (int i=0; i<NUM_SCENE_SLOTS; i++) {
+    if (!customizedScenes.test(i)) continue;
+    err = sceneSlots[i]->deleteFromStore();
   }
   return err;
 }
@@ -657,13 +683,16 @@ void SceneDeviceSettings::loadScenesFromFiles()
             SALOG(device, LOG_ERR, "%s:%d - no or invalid scene number", fn.c_str(), lineNo);
             continue; // no valid scene number -> invalid line
           }
-          // check if this scene is already in the list (i.e. already has non-hardwired settings)
-          DsSceneMap::iterator pos = scenes.find(sceneNo);
+          if (sceneNo<0 || sceneNo>=NUM_SCENE_SLOTS) {
+            SALOG(device, LOG_ERR, "%s:%d - scene number %d outside scene table", fn.c_str(), lineNo, sceneNo);
+            continue;
+          }
+          // check if this scene is already customized (i.e. already has non-hardwired settings)
           DsScenePtr scene;
-          if (pos!=scenes.end()) {
+          if (customizedScenes.test(sceneNo)) {
             // this scene already has settings, only apply if this is an overridden
             if (!overridden) continue; // scene already configured by more specialized level -> dont apply
-            scene = pos->second;
+            scene = sceneSlots[sceneNo];
           }
           else {
             // no settings yet, create the scene object
@@ -674,7 +703,8 @@ void SceneDeviceSettings::loadScenesFromFiles()
           // these changes are NOT to be made persistent in DB!
           scene->markClean();
           // put scene into table
-          scenes[sceneNo] = scene;
+          sceneSlots[sceneNo] = scene;
+          customizedScenes.set(sceneNo);
           SALOG(device, LOG_INFO, "Customized scene %d %sfrom config file %s", sceneNo, overridden ? "(with override) " : "", fn.c_str());
         }
       }
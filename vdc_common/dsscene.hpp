@@ -28,6 +28,8 @@
 
 #include "devicesettings.hpp"
 
+#include <bitset>
+
 using namespace std;
 
 namespace p44 {
@@ -220,7 +222,9 @@ namespace p44 {
 
   };
   typedef boost::intrusive_ptr<DsScene> DsScenePtr;
-  typedef map<SceneNo, DsScenePtr> DsSceneMap;
+
+  /// number of slots in a device's scene table (dS scene numbers are 0..127)
+  #define NUM_SCENE_SLOTS 128
 
 
 
@@ -229,9 +233,10 @@ namespace p44 {
   ///   (such as light, colorlight) - so usually device makers don't need to implement subclasses of SceneDeviceSettings.
   /// @note The SceneDeviceSettings object manages the scene table in a way that tries
   ///   to minimize the number of actual DsScene objects in memory for efficiency reasons. So
-  ///   most DsScene objects are created on the fly via the newDefaultScene() factory method only when
-  ///   needed e.g. for calling a scene. Only scenes that were explicitly configured to differ from the
-  ///   standard scene values for the behaviour are actually persisted into the database.
+  ///   most DsScene objects are created via the newDefaultScene() factory method only when
+  ///   needed e.g. for calling a scene, and are then kept in the scene table for subsequent calls.
+  ///   Only scenes that were explicitly configured to differ from the standard scene values for the
+  ///   behaviour are actually persisted into the database.
   class SceneDeviceSettings : public DeviceSettings
   {
     typedef DeviceSettings inherited;
@@ -240,7 +245,8 @@ namespace p44 {
     friend class Device;
     friend class SceneChannels;
 
-    DsSceneMap scenes; ///< the user defined scenes (default scenes will be created on the fly)
+    DsScenePtr sceneSlots[NUM_SCENE_SLOTS]; ///< scene table, indexed by scene number. Slots are empty until first used
+    bitset<NUM_SCENE_SLOTS> customizedScenes; ///< set for slots containing user defined scenes, cleared for cached default scenes
 
   public:
     SceneDeviceSettings(Device &aDevice);
@@ -251,9 +257,12 @@ namespace p44 {
 
     /// get the parameters for the scene
     /// @param aSceneNo the scene to get current settings for.
-    /// @note the object returned may not be attached to a container (if it is a default scene
-    ///   created on the fly). Scene modifications must be posted using updateScene()
-    DsScenePtr getScene(SceneNo aSceneNo);
+    /// @param aForUpdate if set, a scene that still has default values is returned as a private copy
+    ///   which the caller may modify. If not set, the default scene cached in the scene table is returned,
+    ///   which must be treated as read-only.
+    /// @note Scene modifications must be posted using updateScene(), which makes the modified copy the
+    ///   scene table entry for that scene.
+    DsScenePtr getScene(SceneNo aSceneNo, bool aForUpdate = false);
 
     /// update scene (mark dirty, add to list of non-default scene objects)
     /// @param aScene the scene to save modified settings for.
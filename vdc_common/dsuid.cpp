@@ -44,6 +44,17 @@ void DsUid::internalInit()
   // init such that what we'd read out will be all-zero dSUID
   idBytes = dsuidBytes;
   memset(raw, 0, sizeof(raw));
+  updateHash();
+}
+
+
+void DsUid::updateHash()
+{
+  // FNV-1a over the ID bytes
+  hashValue = 2166136261u;
+  for (int i=0; i<idBytes; i++) {
+    hashValue = (hashValue ^ raw[i]) * 16777619u;
+  }
 }
 
 
@@ -91,6 +102,7 @@ void DsUid::setIdType(DsUidType aIdType)
         idBytes = 0; // no content
         break;
     }
+    updateHash();
   }
 }
 
@@ -100,6 +112,7 @@ void DsUid::setSubdeviceIndex(uint8_t aSubDeviceIndex)
   if (idBytes==dsuidBytes) {
     // is a dSUID, can set subdevice index
     raw[16] = aSubDeviceIndex;
+    updateHash();
   }
 }
 
@@ -138,6 +151,7 @@ void DsUid::setGTIN(uint64_t aGCP, uint64_t aItemRef, uint8_t aPartition)
   // - raw[10..11] contain more GTIN information
   raw[10] = (binaryGtin>>2) & 0xFF;
   raw[11] = (raw[11] & 0x3F) | ((binaryGtin & 0x03)<<6); // combine lowest 2 bits of GTIN with highest 6 of serial
+  updateHash();
 }
 
 
@@ -150,6 +164,7 @@ void DsUid::setSerial(uint64_t aSerial)
   raw[13] = (aSerial>>16)&0xFF;
   raw[14] = (aSerial>>8)&0xFF;
   raw[15] = aSerial&0xFF;
+  updateHash();
 }
 
 
@@ -223,6 +238,7 @@ void DsUid::setNameInSpace(const string &aName, const DsUid &aNameSpace)
   // - Set the two most significant bits (bits 6 and 7) of the clock_seq_hi_and_reserved to zero and one, respectively.
   // ...means: mark the UUID as RFC4122 type/variant
   raw[8] = (raw[8] & 0xC0) | (0x2<<6);
+  updateHash();
 }
 
 
@@ -235,6 +251,7 @@ bool DsUid::setAsBinary(const string &aBinary)
     idBytes = dsuidBytes;
     memcpy(raw, aBinary.c_str(), idBytes);
     detectSubType();
+    updateHash();
     return true;
   }
   return false;
@@ -317,10 +334,12 @@ bool DsUid::setAsString(const string &aString)
     detectSubType();
     if (byteIndex==uuidBytes)
       raw[16] = 0; // specified as pure UUID, set subdevice index == 0
+    updateHash();
   }
   else {
     // unknown format
     setIdType(idtype_undefined);
+    updateHash(); // raw might be partially overwritten
     return false;
   }
   return true;
@@ -347,7 +366,7 @@ string DsUid::getString() const
 
 bool DsUid::operator== (const DsUid &aDsUid) const
 {
-  if (idType!=aDsUid.idType) return false;
+  if (idType!=aDsUid.idType || hashValue!=aDsUid.hashValue) return false;
   return memcmp(raw, aDsUid.raw, idBytes)==0;
 }
 
@@ -84,9 +84,12 @@ namespace p44 {
     DsUidType idType; ///< the type of ID
     uint8_t idBytes; ///< the length of the ID in bytes
     RawID raw; ///< the raw dSUID
+    uint32_t hashValue; ///< hash over the raw dSUID, updated whenever raw changes
 
     void internalInit();
 
+    void updateHash();
+
     void setIdType(DsUidType aIdType);
 
     void detectSubType();
@@ -141,6 +144,9 @@ namespace p44 {
     bool operator== (const DsUid &aDsUid) const;
     bool operator< (const DsUid &aDsUid) const;
 
+    /// @return precomputed hash value of the dSUID, for use in hashed containers
+    size_t hash() const { return hashValue; };
+
     // test
     // @return true if empty (no value assigned)
     bool empty() const;
@@ -198,6 +204,12 @@ namespace p44 {
   };
   typedef boost::intrusive_ptr<DsUid> DsUidPtr;
 
+  /// hash functor for using DsUid as key in hashed containers
+  struct DsUidHash
+  {
+    size_t operator()(const DsUid &aDsUid) const { return aDsUid.hash(); };
+  };
+
 
 } // namespace p44
 
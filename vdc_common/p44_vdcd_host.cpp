@@ -371,12 +371,8 @@ ErrorPtr P44VdcHost::processVdcRequest(JsonCommPtr aJsonComm, JsonObjectPtr aReq
         // handle notification
         // dSUID param can be single dSUID or array of dSUIDs
         if (o->isType(apivalue_array)) {
-          // array of dSUIDs
-          for (int i=0; i<o->arrayLength(); i++) {
-            ApiValuePtr e = o->arrayGet(i);
-            dsuid.setAsBinary(e->binaryValue());
-            handleNotificationForDsUid(cmd, dsuid, params);
-          }
+          // array of dSUIDs, delivered in per-vdc batches
+          handleNotificationForDsUids(cmd, o, params);
         }
         else {
           // single dSUID
@@ -40,11 +40,46 @@ void protobufMessagePrint(FILE *aOutFile, const ProtobufCMessage *aMessageP, int
 // MARK: ===== PbufApiValue
 
 PbufApiValue::PbufApiValue() :
-  allocatedType(apivalue_null)
+  allocatedType(apivalue_null),
+  keyIterationIndex(0),
+  fieldIndexP(NULL)
 {
 }
 
 
+// max number of released nodes kept for reuse
+#define MAX_FREE_NODES 2048
+
+static void *freeNodes = NULL; ///< linked list of released nodes, first word of each node points to the next one
+static size_t numFreeNodes = 0;
+
+void *PbufApiValue::operator new(size_t aSize)
+{
+  if (aSize==sizeof(PbufApiValue) && freeNodes) {
+    // reuse a released node
+    void *node = freeNodes;
+    freeNodes = *((void **)node);
+    numFreeNodes--;
+    return node;
+  }
+  return ::operator new(aSize);
+}
+
+
+void PbufApiValue::operator delete(void *aPtr, size_t aSize)
+{
+  if (!aPtr) return;
+  if (aSize==sizeof(PbufApiValue) && numFreeNodes<MAX_FREE_NODES) {
+    // keep for reuse
+    *((void **)aPtr) = freeNodes;
+    freeNodes = aPtr;
+    numFreeNodes++;
+    return;
+  }
+  ::operator delete(aPtr);
+}
+
+
 PbufApiValue::~PbufApiValue()
 {
   clear();
@@ -72,7 +107,7 @@ void PbufApiValue::operator=(ApiValue &aApiValue)
         objectValue.stringP = new string(*(pavP->objectValue.stringP));
         break;
       case apivalue_object:
-        objectValue.objectMapP = new ApiValueFieldMap(*(pavP->objectValue.objectMapP));
+        objectValue.objectFieldsP = new ApiValueFieldVector(*(pavP->objectValue.objectFieldsP));
         break;
       case apivalue_array:
         objectValue.arrayVectorP = new ApiValueArray(*(pavP->objectValue.arrayVectorP));
@@ -99,7 +134,9 @@ void PbufApiValue::clear()
         if (objectValue.stringP) delete objectValue.stringP;
         break;
       case apivalue_object:
-        if (objectValue.objectMapP) delete objectValue.objectMapP;
+        if (objectValue.objectFieldsP) delete objectValue.objectFieldsP;
+        if (fieldIndexP) delete fieldIndexP;
+        fieldIndexP = NULL;
         break;
       case apivalue_array:
         if (objectValue.arrayVectorP) delete objectValue.arrayVectorP;
@@ -125,7 +162,7 @@ void PbufApiValue::allocate()
         objectValue.stringP = new string;
         break;
       case apivalue_object:
-        objectValue.objectMapP = new ApiValueFieldMap;
+        objectValue.objectFieldsP = new ApiValueFieldVector;
         break;
       case apivalue_array:
         objectValue.arrayVectorP = new ApiValueArray;
@@ -148,11 +185,41 @@ bool PbufApiValue::allocateIf(ApiValueType aIsType)
 
 
 
+// objects with more fields than this get a hash index (device lists, scene tables, full property reads)
+#define FIELD_INDEX_MIN_FIELDS 16
+
+ApiValueFieldVector::iterator PbufApiValue::findField(const string &aKey)
+{
+  // Note: only call for allocated objects
+  ApiValueFieldVector &fields = *objectValue.objectFieldsP;
+  if (fields.size()<=FIELD_INDEX_MIN_FIELDS) {
+    // small object, linear search is fastest
+    ApiValueFieldVector::iterator pos = fields.begin();
+    while (pos!=fields.end() && pos->first!=aKey) ++pos;
+    return pos;
+  }
+  if (!fieldIndexP) {
+    // object has grown large, index it
+    fieldIndexP = new ApiValueFieldIndex;
+    for (size_t i=0; i<fields.size(); i++) (*fieldIndexP)[fields[i].first] = i;
+  }
+  ApiValueFieldIndex::iterator ipos = fieldIndexP->find(aKey);
+  if (ipos==fieldIndexP->end()) return fields.end();
+  return fields.begin()+ipos->second;
+}
+
+
 void PbufApiValue::add(const string &aKey, ApiValuePtr aObj)
 {
   PbufApiValuePtr val = boost::dynamic_pointer_cast<PbufApiValue>(aObj);
   if (val && allocateIf(apivalue_object)) {
-    (*(objectValue.objectMapP))[aKey] = val;
+    ApiValueFieldVector::iterator pos = findField(aKey);
+    if (pos!=objectValue.objectFieldsP->end())
+      pos->second = val; // replace existing field
+    else {
+      objectValue.objectFieldsP->push_back(ApiValueField(aKey, val));
+      if (fieldIndexP) (*fieldIndexP)[aKey] = objectValue.objectFieldsP->size()-1;
+    }
   }
 }
 
@@ -160,8 +227,8 @@ void PbufApiValue::add(const string &aKey, ApiValuePtr aObj)
 ApiValuePtr PbufApiValue::get(const string &aKey)
 {
   if (allocatedType==apivalue_object) {
-    ApiValueFieldMap::iterator pos = objectValue.objectMapP->find(aKey);
-    if (pos!=objectValue.objectMapP->end())
+    ApiValueFieldVector::iterator pos = findField(aKey);
+    if (pos!=objectValue.objectFieldsP->end())
       return pos->second;
   }
   return ApiValuePtr();
@@ -171,7 +238,13 @@ ApiValuePtr PbufApiValue::get(const string &aKey)
 void PbufApiValue::del(const string &aKey)
 {
   if (allocatedType==apivalue_object) {
-    objectValue.objectMapP->erase(aKey);
+    ApiValueFieldVector::iterator pos = findField(aKey);
+    if (pos!=objectValue.objectFieldsP->end()) {
+      objectValue.objectFieldsP->erase(pos);
+      // positions have shifted, index will be rebuilt when needed
+      if (fieldIndexP) delete fieldIndexP;
+      fieldIndexP = NULL;
+    }
   }
 }
 
@@ -222,7 +295,7 @@ void PbufApiValue::arrayPut(int aAtIndex, ApiValuePtr aObj)
 size_t PbufApiValue::numObjectFields()
 {
   if (allocatedType==apivalue_object) {
-    return objectValue.objectMapP->size();
+    return objectValue.objectFieldsP->size();
   }
   return 0;
 }
@@ -231,7 +304,7 @@ size_t PbufApiValue::numObjectFields()
 bool PbufApiValue::resetKeyIteration()
 {
   if (allocatedType==apivalue_object) {
-    keyIterator = objectValue.objectMapP->begin();
+    keyIterationIndex = 0;
   }
   return false; // cannot be iterated
 }
@@ -240,10 +313,10 @@ bool PbufApiValue::resetKeyIteration()
 bool PbufApiValue::nextKeyValue(string &aKey, ApiValuePtr &aValue)
 {
   if (allocatedType==apivalue_object) {
-    if (keyIterator!=objectValue.objectMapP->end()) {
-      aKey = keyIterator->first;
-      aValue = keyIterator->second;
-      keyIterator++;
+    if (keyIterationIndex<objectValue.objectFieldsP->size()) {
+      ApiValueField &field = (*objectValue.objectFieldsP)[keyIterationIndex++];
+      aKey = field.first;
+      aValue = field.second;
       return true;
     }
   }
@@ -1067,8 +1140,11 @@ ErrorPtr VdcPbufApiRequest::sendError(uint32_t aErrorCode, string aErrorMessage,
 
 
 VdcPbufApiConnection::VdcPbufApiConnection() :
+  transmitStart(0),
+  flushTicket(0),
   closeWhenSent(false),
-  expectedMsgBytes(0),
+  receivedStart(0),
+  receivedEnd(0),
   requestIdCounter(0)
 {
   socketComm = SocketCommPtr(new SocketComm(MainLoop::currentMainLoop()));
@@ -1077,67 +1153,54 @@ VdcPbufApiConnection::VdcPbufApiConnection() :
 }
 
 
-// max message size accepted - everything bigger must be an error
-#define MAX_DATA_SIZE 16384
-
-
 void VdcPbufApiConnection::gotData(ErrorPtr aError)
 {
   // got data
-  if (Error::isOK(aError)) {
+  while (Error::isOK(aError)) {
     // no error
     size_t dataSz = socketComm->numBytesReady();
     DBGFOCUSLOG("gotData: numBytesReady()=%d", dataSz);
-    // read data we've got so far
-    if (dataSz>0) {
-      // temporary buffer
-      uint8_t *buf = new uint8_t[dataSz];
-      size_t receivedBytes = socketComm->receiveBytes(dataSz, buf, aError);
-      DBGFOCUSLOG("gotData: receiveBytes(%d)=%d", dataSz, receivedBytes);
-      DBGFOCUSLOG("gotData: before appending: receivedMessage.size()=%d", receivedMessage.size());
-      if (Error::isOK(aError)) {
-        // append to receive buffer
-        receivedMessage.append((const char *)buf, receivedBytes);
-        DBGFOCUSLOG("gotData: after appending: receivedMessage.size()=%d", receivedMessage.size());
-        // single message extraction
-        while(true) {
-          DBGFOCUSLOG("gotData: processing loop beginning, expectedMsgBytes=%d", expectedMsgBytes);
-          if(expectedMsgBytes==0 && receivedMessage.size()>=2) {
-            // got 2-byte length header, decode it
-            const uint8_t *sz = (const uint8_t *)receivedMessage.c_str();
-            expectedMsgBytes =
-              (sz[0]<<8) +
-              sz[1];
-            receivedMessage.erase(0,2);
-            FOCUSLOG("gotData: parsed new header, now expectedMsgBytes=%d", expectedMsgBytes);
-            DBGFOCUSLOG("gotData: after removing header: receivedMessage.size()=%d", receivedMessage.size());
-            if (expectedMsgBytes>MAX_DATA_SIZE) {
-              aError = Error::err<VdcApiError>(413, "message exceeds maximum length of 16kB");
-              break;
-            }
-          }
-          // check for complete message
-          if (expectedMsgBytes && (receivedMessage.size()>=expectedMsgBytes)) {
-            FOCUSLOG("gotData: receivedMessage.size()=%d >= expectedMsgBytes=%d -> process", receivedMessage.size(), expectedMsgBytes);
-            // process message
-            aError = processMessage((uint8_t *)receivedMessage.c_str(),expectedMsgBytes);
-            // erase processed message
-            receivedMessage.erase(0,expectedMsgBytes);
-            DBGFOCUSLOG("gotData: after removing message: receivedMessage.size()=%d", receivedMessage.size());
-            expectedMsgBytes = 0; // reset to unknown
-            // repeat evaluation with remaining bytes (could be another message)
-          }
-          else {
-            // no complete message yet, done for now
-            break;
-          }
-        }
-        DBGFOCUSLOG("gotData: end of processing loop: receivedMessage.size()=%d", receivedMessage.size());
+    if (dataSz==0) break; // no (more) data ready
+    if (receivedEnd>=receiveBufferSize) {
+      // no room at end of buffer, move incomplete frame to beginning
+      // Note: at most one incomplete frame can remain here, and the buffer can hold two max sized frames, so this happens rarely
+      memmove(receiveBuffer, receiveBuffer+receivedStart, receivedEnd-receivedStart);
+      receivedEnd -= receivedStart;
+      receivedStart = 0;
+      DBGFOCUSLOG("gotData: compacted receive buffer, now %d bytes pending", receivedEnd);
+    }
+    // read directly into buffer
+    if (dataSz>receiveBufferSize-receivedEnd) dataSz = receiveBufferSize-receivedEnd;
+    size_t receivedBytes = socketComm->receiveBytes(dataSz, receiveBuffer+receivedEnd, aError);
+    DBGFOCUSLOG("gotData: receiveBytes(%d)=%d", dataSz, receivedBytes);
+    if (!Error::isOK(aError) || receivedBytes==0) break;
+    receivedEnd += receivedBytes;
+    // extract and process complete frames in place
+    while (receivedEnd-receivedStart>=2) {
+      // got 2-byte length header, decode it
+      const uint8_t *frame = receiveBuffer+receivedStart;
+      size_t msgBytes = (frame[0]<<8) + frame[1];
+      FOCUSLOG("gotData: frame header at offset %d, message size=%d", receivedStart, msgBytes);
+      if (msgBytes>maxMessageSize) {
+        aError = Error::err<VdcApiError>(413, "message exceeds maximum length of 16kB");
+        break;
+      }
+      if (receivedEnd-receivedStart<msgBytes+2) {
+        // no complete message yet, done for now
+        break;
       }
-      // forget buffer
-      delete[] buf; buf = NULL;
-    } // some data seems to be ready
-  } // no connection error
+      // consume the frame, then process it in place (buffer content stays valid until next receive)
+      receivedStart += msgBytes+2;
+      aError = processMessage(frame+2, msgBytes);
+      if (!Error::isOK(aError)) break;
+    }
+    if (receivedStart==receivedEnd) {
+      // everything processed, restart at beginning of buffer
+      receivedStart = 0;
+      receivedEnd = 0;
+    }
+    DBGFOCUSLOG("gotData: end of processing loop: %d bytes pending", receivedEnd-receivedStart);
+  }
   if (!Error::isOK(aError)) {
     // error occurred
     // pbuf API cannot resynchronize, close connection
@@ -1147,6 +1210,9 @@ void VdcPbufApiConnection::gotData(ErrorPtr aError)
 }
 
 
+#define TRANSMIT_MAX_PENDING (1024*1024) // max unsent bytes, peer not reading at all beyond that
+#define TRANSMIT_COMPACT_MIN (16*1024) // min number of sent bytes at the beginning of the transmit buffer worth reclaiming
+
 ErrorPtr VdcPbufApiConnection::sendMessage(const Vdcapi__Message *aVdcApiMessage)
 {
   ErrorPtr err;
@@ -1157,70 +1223,85 @@ ErrorPtr VdcPbufApiConnection::sendMessage(const Vdcapi__Message *aVdcApiMessage
   #endif
   // generate the binary message
   size_t packedSize = vdcapi__message__get_packed_size(aVdcApiMessage);
-  uint8_t *packedMsg = new uint8_t[packedSize+2]; // leave room for header
+  if (transmitBuffer.size()-transmitStart+packedSize+2>TRANSMIT_MAX_PENDING) {
+    // peer does not read, do not buffer forever
+    LOG(LOG_WARNING, "protobuf connection: more than %d bytes pending to be sent - closing", TRANSMIT_MAX_PENDING);
+    transmitBuffer.clear();
+    transmitStart = 0;
+    MainLoop::currentMainLoop().cancelExecutionTicket(flushTicket);
+    socketComm->setTransmitHandler(NULL);
+    closeConnection();
+    return Error::err<VdcApiError>(503, "peer not reading, connection closed");
+  }
+  // - append frame directly to the transmit buffer (which keeps its storage between sends)
+  size_t frameStart = transmitBuffer.size();
+  transmitBuffer.resize(frameStart+packedSize+2);
+  uint8_t *frame = &transmitBuffer[frameStart];
   // - add the header
-  packedMsg[0] = (packedSize>>8) & 0xFF;
-  packedMsg[1] = packedSize & 0xFF;
+  frame[0] = (packedSize>>8) & 0xFF;
+  frame[1] = packedSize & 0xFF;
   // - add the message data
-  vdcapi__message__pack(aVdcApiMessage, packedMsg+2);
-  // - adjust the total message length
-  packedSize += 2;
+  vdcapi__message__pack(aVdcApiMessage, frame+2);
   // send the message
-  if (transmitBuffer.size()>0) {
-    // other messages are already waiting, append entire message
-    transmitBuffer.append((const char *)packedMsg, packedSize);
+  if (frameStart==0) {
+    // buffer was empty: send everything queued up to the end of this mainloop cycle in one go
+    // Note: if buffer was not empty, either a flush is already scheduled or the transmit handler is waiting for the socket
+    flushTicket = MainLoop::currentMainLoop().executeOnce(boost::bind(&VdcPbufApiConnection::flushTransmitBuffer, VdcPbufApiConnectionPtr(this)));
   }
-  else {
-    // nothing in buffer yet, start new send
-    size_t sentBytes = socketComm->transmitBytes(packedSize, packedMsg, err);
-    if (Error::isOK(err)) {
-      // check if all could be sent
-      if (sentBytes<packedSize) {
-        // Not everything (or maybe nothing, transmitBytes() can return 0) was sent
-        // - enable callback for ready-for-send
-        socketComm->setTransmitHandler(boost::bind(&VdcPbufApiConnection::canSendData, this, _1));
-        // buffer the rest, canSendData handler will take care of writing it out
-        transmitBuffer.assign((char *)packedMsg+sentBytes, packedSize-sentBytes);
-      }
-			else {
-				// all sent
-				// - disable transmit handler
-        socketComm->setTransmitHandler(NULL);
-			}
-    }
-  }
-  // return the buffer
-  delete[] packedMsg;
   // done
   return err;
 }
 
 
-void VdcPbufApiConnection::canSendData(ErrorPtr aError)
+void VdcPbufApiConnection::flushTransmitBuffer()
 {
-  size_t bytesToSend = transmitBuffer.size();
-  if (bytesToSend>0 && Error::isOK(aError)) {
-    // send data from transmit buffer
-    size_t sentBytes = socketComm->transmitBytes(bytesToSend, (const uint8_t *)transmitBuffer.c_str(), aError);
-    if (Error::isOK(aError)) {
-      if (sentBytes==bytesToSend) {
-        // all sent
-        transmitBuffer.erase();
-				// - disable transmit handler
-        socketComm->setTransmitHandler(NULL);
-      }
-      else {
-        // partially sent, remove sent bytes
-        transmitBuffer.erase(0, sentBytes);
-      }
-      // check for closing connection when no data pending to be sent any more
-      if (closeWhenSent && transmitBuffer.size()==0) {
-        closeWhenSent = false; // done
-        LOG(LOG_NOTICE, "vDC API request demands ending connection now");
-        closeConnection();
+  flushTicket = 0;
+  size_t bytesToSend = transmitBuffer.size()-transmitStart;
+  if (bytesToSend>0) {
+    ErrorPtr err;
+    size_t sentBytes = socketComm->transmitBytes(bytesToSend, &transmitBuffer[transmitStart], err);
+    if (!Error::isOK(err)) {
+      // cannot send, pbuf API cannot resynchronize
+      LOG(LOG_WARNING, "Error sending on protobuf connection - closing: %s", err->description().c_str());
+      transmitBuffer.clear();
+      transmitStart = 0;
+      socketComm->setTransmitHandler(NULL);
+      closeConnection();
+      return;
+    }
+    transmitStart += sentBytes;
+    if (transmitStart<transmitBuffer.size()) {
+      // Not everything (or maybe nothing, transmitBytes() can return 0) was sent
+      // - reclaim space of the sent part, as new frames might keep getting appended before buffer is ever empty
+      if (transmitStart>=TRANSMIT_COMPACT_MIN || transmitStart>=transmitBuffer.size()/2) {
+        transmitBuffer.erase(transmitBuffer.begin(), transmitBuffer.begin()+transmitStart);
+        transmitStart = 0;
       }
+      // - enable callback for ready-for-send, canSendData handler will take care of writing out the rest
+      socketComm->setTransmitHandler(boost::bind(&VdcPbufApiConnection::canSendData, this, _1));
+      return;
     }
   }
+  // all sent, reuse buffer from start
+  transmitBuffer.clear(); // keeps allocated storage
+  transmitStart = 0;
+  // - disable transmit handler
+  socketComm->setTransmitHandler(NULL);
+  // check for closing connection when no data pending to be sent any more
+  if (closeWhenSent) {
+    closeWhenSent = false; // done
+    LOG(LOG_NOTICE, "vDC API request demands ending connection now");
+    closeConnection();
+  }
+}
+
+
+void VdcPbufApiConnection::canSendData(ErrorPtr aError)
+{
+  if (Error::isOK(aError)) {
+    // send remaining data from transmit buffer
+    flushTransmitBuffer();
+  }
 }
 
 
@@ -29,6 +29,8 @@
 #include "vdcapi.pb-c.h"
 #include "messages.pb-c.h"
 
+#include <boost/unordered_map.hpp>
+
 using namespace std;
 
 namespace p44 {
@@ -47,7 +49,9 @@ namespace p44 {
 
   typedef boost::intrusive_ptr<PbufApiValue> PbufApiValuePtr;
 
-  typedef map<string, PbufApiValuePtr> ApiValueFieldMap;
+  typedef pair<string, PbufApiValuePtr> ApiValueField;
+  typedef vector<ApiValueField> ApiValueFieldVector; ///< object fields, flat in insertion order (most API objects have few fields)
+  typedef boost::unordered_map<string, size_t> ApiValueFieldIndex; ///< key to position in ApiValueFieldVector, for objects with many fields
   typedef vector<PbufApiValuePtr> ApiValueArray;
 
   /// Protocol buffer specific implementation of ApiValue
@@ -64,17 +68,27 @@ namespace p44 {
       int64_t int64Val;
       double doubleVal;
       string *stringP; // for strings and binary values
-      ApiValueFieldMap *objectMapP;
+      ApiValueFieldVector *objectFieldsP;
       ApiValueArray *arrayVectorP;
     } objectValue;
 
-    ApiValueFieldMap::iterator keyIterator;
+    size_t keyIterationIndex;
+    ApiValueFieldIndex *fieldIndexP; ///< hash index into objectFieldsP, only created for objects with many fields (containers)
 
   public:
 
     PbufApiValue();
     virtual ~PbufApiValue();
 
+    /// @name node recycling
+    /// @note for every API request and response, a tree of PbufApiValue nodes is built and torn down again.
+    ///   Released nodes are kept in a free list and reused, so steady-state API traffic does not need
+    ///   heap allocations for the nodes themselves. Not thread safe, API values are used from the mainloop thread only.
+    /// @{
+    static void *operator new(size_t aSize);
+    static void operator delete(void *aPtr, size_t aSize);
+    /// @}
+
     virtual ApiValuePtr newValue(ApiValueType aObjectType);
 
     virtual void clear();
@@ -155,6 +169,7 @@ namespace p44 {
     void putValueIntoPropVal(Vdcapi__PropertyValue &aPropVal);
 
     size_t numObjectFields();
+    ApiValueFieldVector::iterator findField(const string &aKey);
 
   };
 
@@ -227,11 +242,17 @@ namespace p44 {
     SocketCommPtr socketComm;
 
     // receiving
-    uint32_t expectedMsgBytes; ///< number of bytes expected of next message
-    string receivedMessage; ///< accumulated message bytes, including 4-byte length header
+    static const size_t maxMessageSize = 16384; ///< max message size accepted - everything bigger must be an error
+    static const size_t receiveBufferSize = 2*(maxMessageSize+2); ///< receive buffer, large enough for at least one complete max sized frame
+    uint8_t receiveBuffer[receiveBufferSize]; ///< received bytes, messages are parsed and processed in place
+    size_t receivedStart; ///< offset of first not yet processed byte in receiveBuffer (start of a frame's 2-byte length header)
+    size_t receivedEnd; ///< offset of first free byte in receiveBuffer
 
     // sending
-    string transmitBuffer; ///< binary buffer for data to be sent
+    typedef std::vector<uint8_t> TransmitBuffer;
+    TransmitBuffer transmitBuffer; ///< packed frames waiting to be sent. Messages are packed directly into it, storage is reused
+    size_t transmitStart; ///< offset of first unsent byte in transmitBuffer
+    long flushTicket; ///< deferred sending of all frames queued within the current mainloop cycle
     bool closeWhenSent;
 
     // pending requests
@@ -263,6 +284,7 @@ namespace p44 {
 
     void gotData(ErrorPtr aError);
     void canSendData(ErrorPtr aError);
+    void flushTransmitBuffer();
 
     ErrorPtr processMessage(const uint8_t *aPackedMessageP, size_t aPackedMessageSize);
     ErrorPtr sendMessage(const Vdcapi__Message *aVdcApiMessage);
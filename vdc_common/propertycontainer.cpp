@@ -31,6 +31,9 @@
 // needed to implement reading from CSV
 #include "jsonvdcapi.hpp"
 
+#include <typeinfo>
+#include <boost/unordered_map.hpp>
+
 using namespace p44;
 
 
@@ -43,7 +46,9 @@ ErrorPtr PropertyContainer::accessProperty(PropertyAccessMode aMode, ApiValuePtr
   FOCUSLOG("\naccessProperty: entered with query = %s", aQueryObject->description().c_str());
   // make sure we always have a parent - in case none provided, the parent is "root".
   if (!aParentDescriptor) {
-    aParentDescriptor = PropertyDescriptorPtr(new RootPropertyDescriptor());
+    // - root descriptor is immutable and can be shared among all accesses
+    static PropertyDescriptorPtr rootDescriptor = PropertyDescriptorPtr(new RootPropertyDescriptor());
+    aParentDescriptor = rootDescriptor;
   }
   FOCUSLOG("- parentDescriptor '%s' (%s, %s), fieldKey=%zu, objectKey=%ld",
     aParentDescriptor->name(),
@@ -245,11 +250,108 @@ bool PropertyContainer::getNextPropIndex(string aPropMatch, int &aStartIndex)
 
 
 
+// MARK: ===== property name index
+
+namespace {
+
+  /// identifies a property level: the C++ class of the container and the (grand)parent descriptors that
+  /// numProps() and getDescriptorByIndex() implementations use to select the properties of that level
+  struct PropLevelKey {
+    const std::type_info *containerType;
+    int domain;
+    intptr_t parentObjectKey;
+    size_t parentFieldKey;
+    bool parentIsRoot;
+    intptr_t grandParentObjectKey;
+    size_t grandParentFieldKey;
+
+    bool operator<(const PropLevelKey &aOther) const
+    {
+      if (containerType!=aOther.containerType) return containerType<aOther.containerType;
+      if (domain!=aOther.domain) return domain<aOther.domain;
+      if (parentObjectKey!=aOther.parentObjectKey) return parentObjectKey<aOther.parentObjectKey;
+      if (parentFieldKey!=aOther.parentFieldKey) return parentFieldKey<aOther.parentFieldKey;
+      if (parentIsRoot!=aOther.parentIsRoot) return parentIsRoot<aOther.parentIsRoot;
+      if (grandParentObjectKey!=aOther.grandParentObjectKey) return grandParentObjectKey<aOther.grandParentObjectKey;
+      return grandParentFieldKey<aOther.grandParentFieldKey;
+    }
+  };
+
+  /// property name to index map for one property level
+  struct PropNameIndex {
+    int numProps; ///< number of properties when index was built
+    bool variable; ///< set when instances of the same class have different property counts at this level -> not indexed
+    boost::unordered_map<string, int> indices; ///< property name -> index, -1 for names occurring more than once
+
+    PropNameIndex() : numProps(-1), variable(false) {};
+  };
+
+  typedef map<PropLevelKey, PropNameIndex> PropNameIndexMap;
+
+  PropNameIndexMap propNameIndices;
+
+}
+
+
+// look up the index of a named property via the per-level name index
+// - returns -1 if name is not in index or is not unique
+// - returned index is a hint only, caller must verify the name of the descriptor at that index
+int PropertyContainer::indexedPropIndex(const string &aName, int aNumProps, int aDomain, PropertyDescriptorPtr aParentDescriptor)
+{
+  PropLevelKey key;
+  key.containerType = &typeid(*this);
+  key.domain = aDomain;
+  key.parentObjectKey = aParentDescriptor->objectKey();
+  key.parentFieldKey = aParentDescriptor->fieldKey();
+  key.parentIsRoot = aParentDescriptor->isRootOfObject();
+  PropertyDescriptorPtr gp = aParentDescriptor->parentDescriptor;
+  key.grandParentObjectKey = gp ? gp->objectKey() : 0;
+  key.grandParentFieldKey = gp ? gp->fieldKey() : 0;
+  PropNameIndex &nameIndex = propNameIndices[key];
+  if (nameIndex.variable) return -1; // level not suitable for indexing
+  if (nameIndex.numProps!=aNumProps) {
+    if (nameIndex.numProps>=0) {
+      // property count differs between instances (e.g. devices with different numbers of buttons or channels),
+      // rebuilding the index on every alternating access would be more expensive than the linear search
+      nameIndex.variable = true;
+      nameIndex.indices.clear();
+      return -1;
+    }
+    // build index for this level
+    nameIndex.numProps = aNumProps;
+    nameIndex.indices.clear();
+    for (int i=0; i<aNumProps; i++) {
+      PropertyDescriptorPtr propDesc = getDescriptorByIndex(i, aDomain, aParentDescriptor);
+      if (!propDesc) continue;
+      pair<boost::unordered_map<string, int>::iterator, bool> ins = nameIndex.indices.insert(make_pair(string(propDesc->name()), i));
+      if (!ins.second) ins.first->second = -1; // duplicate name, cannot be looked up directly
+    }
+  }
+  boost::unordered_map<string, int>::iterator pos = nameIndex.indices.find(aName);
+  if (pos==nameIndex.indices.end()) return -1;
+  return pos->second;
+}
+
+
+
 // default implementation based on numProps/getDescriptorByIndex
 // Derived classes with array-like container may directly override this method for more efficient access
 PropertyDescriptorPtr PropertyContainer::getDescriptorByName(string aPropMatch, int &aStartIndex, int aDomain, PropertyAccessMode aMode, PropertyDescriptorPtr aParentDescriptor)
 {
   int n = numProps(aDomain, aParentDescriptor);
+  if (aStartIndex==0 && isNamedPropSpec(aPropMatch) && aPropMatch[aPropMatch.size()-1]!='*') {
+    // plain name, try direct lookup via name index first
+    int i = indexedPropIndex(aPropMatch, n, aDomain, aParentDescriptor);
+    if (i>=0) {
+      PropertyDescriptorPtr propDesc = getDescriptorByIndex(i, aDomain, aParentDescriptor);
+      if (propDesc && aPropMatch==propDesc->name()) {
+        // found, and name is unique at this level -> no further matches
+        aStartIndex = PROPINDEX_NONE;
+        return propDesc;
+      }
+    }
+    // not in index (or index does not apply to this instance): search the regular way
+  }
   if (aStartIndex<n && aStartIndex!=PROPINDEX_NONE) {
     // aPropMatch syntax
     // - simple name to match a specific property
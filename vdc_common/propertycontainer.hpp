@@ -299,6 +299,10 @@ namespace p44 {
 
     /// @}
 
+  private:
+
+    int indexedPropIndex(const string &aName, int aNumProps, int aDomain, PropertyDescriptorPtr aParentDescriptor);
+
   };
   
 } // namespace p44
@@ -0,0 +1,123 @@
+//
+//  Copyright (c) 2016 plan44.ch / Lukas Zeller, Zurich, Switzerland
+//
+//  Author: Lukas Zeller <luz@plan44.ch>
+//
+//  This file is part of p44vdc.
+//
+//  p44vdc is free software: you can redistribute it and/or modify
+//  it under the terms of the GNU General Public License as published by
+//  the Free Software Foundation, either version 3 of the License, or
+//  (at your option) any later version.
+//
+//  p44vdc is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//
+//  You should have received a copy of the GNU General Public License
+//  along with p44vdc. If not, see <http://www.gnu.org/licenses/>.
+//
+
+#include "transitionscheduler.hpp"
+
+using namespace p44;
+
+
+static TransitionScheduler *sharedTransitionSchedulerP = NULL;
+
+TransitionScheduler &TransitionScheduler::sharedTransitionScheduler()
+{
+  if (!sharedTransitionSchedulerP) {
+    sharedTransitionSchedulerP = new TransitionScheduler();
+  }
+  return *sharedTransitionSchedulerP;
+}
+
+
+TransitionScheduler::TransitionScheduler() :
+  frameTicket(0)
+{
+}
+
+
+void TransitionScheduler::startTransition(DevicePtr aDevice, TransitionFrameCB aFrameCB)
+{
+  stopTransition(*aDevice);
+  // init transitions of all channels with new values
+  for (int i=0; i<aDevice->numChannels(); i++) {
+    ChannelBehaviourPtr ch = aDevice->getChannelByIndex(i, true);
+    if (ch) ch->transitionStep(); // init
+  }
+  // first frame right now
+  bool more = stepChannels(*aDevice);
+  aFrameCB(!more);
+  if (more) {
+    // continue stepping in frame ticks
+    Transition t;
+    t.device = aDevice;
+    t.frameCB = aFrameCB;
+    transitions.push_back(t);
+    if (!frameTicket) {
+      frameTicket = MainLoop::currentMainLoop().executeOnce(boost::bind(&TransitionScheduler::frameTick, this), TRANSITION_STEP_TIME);
+    }
+  }
+}
+
+
+void TransitionScheduler::stopTransition(Device &aDevice)
+{
+  for (TransitionVector::iterator pos = transitions.begin(); pos!=transitions.end(); ++pos) {
+    if (pos->device.get()==&aDevice) {
+      transitions.erase(pos);
+      break;
+    }
+  }
+}
+
+
+bool TransitionScheduler::inTransition(Device &aDevice)
+{
+  for (TransitionVector::iterator pos = transitions.begin(); pos!=transitions.end(); ++pos) {
+    if (pos->device.get()==&aDevice) return true;
+  }
+  return false;
+}
+
+
+bool TransitionScheduler::stepChannels(Device &aDevice)
+{
+  bool more = false;
+  for (int i=0; i<aDevice.numChannels(); i++) {
+    ChannelBehaviourPtr ch = aDevice.getChannelByIndex(i);
+    if (ch && ch->inTransition()) {
+      // each channel steps according to its own transition time
+      MLMicroSeconds tt = ch->transitionTimeToNewValue();
+      ch->transitionStep(tt<=0 ? 1 : (double)TRANSITION_STEP_TIME/tt);
+      if (ch->inTransition()) more = true;
+    }
+  }
+  return more;
+}
+
+
+void TransitionScheduler::frameTick()
+{
+  frameTicket = 0;
+  // step all channels first...
+  TransitionVector frame;
+  frame.swap(transitions);
+  vector<bool> final(frame.size());
+  for (size_t i=0; i<frame.size(); i++) {
+    final[i] = !stepChannels(*frame[i].device);
+    if (!final[i]) transitions.push_back(frame[i]); // keep for next frame
+  }
+  // ...then deliver the frame to all devices
+  // Note: callbacks might start or stop transitions, which only affects the transitions list, not this frame
+  for (size_t i=0; i<frame.size(); i++) {
+    frame[i].frameCB(final[i]);
+  }
+  if (!transitions.empty() && !frameTicket) {
+    frameTicket = MainLoop::currentMainLoop().executeOnce(boost::bind(&TransitionScheduler::frameTick, this), TRANSITION_STEP_TIME);
+  }
+}
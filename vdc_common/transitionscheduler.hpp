@@ -0,0 +1,91 @@
+//
+//  Copyright (c) 2016 plan44.ch / Lukas Zeller, Zurich, Switzerland
+//
+//  Author: Lukas Zeller <luz@plan44.ch>
+//
+//  This file is part of p44vdc.
+//
+//  p44vdc is free software: you can redistribute it and/or modify
+//  it under the terms of the GNU General Public License as published by
+//  the Free Software Foundation, either version 3 of the License, or
+//  (at your option) any later version.
+//
+//  p44vdc is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//
+//  You should have received a copy of the GNU General Public License
+//  along with p44vdc. If not, see <http://www.gnu.org/licenses/>.
+//
+
+#ifndef __p44vdc__transitionscheduler__
+#define __p44vdc__transitionscheduler__
+
+#include "p44vdc_common.hpp"
+
+#include "device.hpp"
+
+using namespace std;
+
+namespace p44 {
+
+  /// interval between transition steps
+  #define TRANSITION_STEP_TIME (10*MilliSecond)
+
+  /// callback for delivering a transition frame to a device
+  /// @param aFinal set for the last frame of the transition (all channels have reached their target values)
+  /// @note when this is called, getTransitionalValue() of the device's channels return the values to be
+  ///   applied to the hardware for this frame
+  typedef boost::function<void (bool aFinal)> TransitionFrameCB;
+
+
+  /// Central scheduler for software-implemented output transitions (fading).
+  /// @note All devices with transitions in progress are stepped from a single mainloop timer. Every channel
+  ///   advances according to its own transition time (ChannelBehaviour::transitionTimeToNewValue()).
+  ///   After all channels of all devices have been stepped, the devices get their frame callbacks
+  ///   in one batch.
+  class TransitionScheduler
+  {
+    struct Transition {
+      DevicePtr device; ///< keeps the device alive as long as the transition is running
+      TransitionFrameCB frameCB;
+    };
+    typedef std::vector<Transition> TransitionVector;
+
+    TransitionVector transitions; ///< transitions in progress
+    long frameTicket;
+
+    TransitionScheduler();
+
+  public:
+
+    /// get shared transition scheduler
+    static TransitionScheduler &sharedTransitionScheduler();
+
+    /// start transition of all channels of a device pending to be applied
+    /// @param aDevice the device. All of the device's channels that need applying will start a new transition,
+    ///   channels still in transition from an earlier start will continue their transition.
+    /// @param aFrameCB called for every transition step, first time immediately from within this call.
+    /// @note must be called before the device confirms having applied the channels (channelValueApplied())
+    /// @note starting a transition for a device that has one already in progress replaces the frame callback
+    void startTransition(DevicePtr aDevice, TransitionFrameCB aFrameCB);
+
+    /// stop transition of a device
+    /// @param aDevice the device to stop transition for. Channels remain at their current transitional values.
+    void stopTransition(Device &aDevice);
+
+    /// @param aDevice the device to check
+    /// @return true if a transition is in progress for this device
+    bool inTransition(Device &aDevice);
+
+  private:
+
+    bool stepChannels(Device &aDevice);
+    void frameTick();
+
+  };
+
+} // namespace p44
+
+#endif /* defined(__p44vdc__transitionscheduler__) */
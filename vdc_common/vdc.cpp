@@ -115,6 +115,15 @@ ErrorPtr Vdc::handleMethod(VdcApiRequestPtr aRequest, const string &aMethod, Api
 }
 
 
+void Vdc::handleNotificationForDevices(const string &aMethod, DeviceVector &aDevices, ApiValuePtr aParams)
+{
+  // base class: no batch optimization, deliver to each device separately
+  for (DeviceVector::iterator pos = aDevices.begin(); pos!=aDevices.end(); ++pos) {
+    (*pos)->handleNotification(aMethod, aParams);
+  }
+}
+
+
 void Vdc::performPair(VdcApiRequestPtr aRequest, Tristate aEstablish, bool aDisableProximityCheck, MLMicroSeconds aTimeout)
 {
   // anyway - first stop any device-wide learn that might still be running on this or other vdcs
@@ -313,6 +322,13 @@ ErrorPtr Vdc::forget()
 }
 
 
+void Vdc::markDirty()
+{
+  inheritedParams::markDirty();
+  getVdcHost().markForSave(getDsUid());
+}
+
+
 void Vdc::loadSettingsFromFiles()
 {
   string dir = getVdcHost().getPersistentDataDir();
@@ -151,6 +151,15 @@ namespace p44 {
     /// vdc level methods
     virtual ErrorPtr handleMethod(VdcApiRequestPtr aRequest, const string &aMethod, ApiValuePtr aParams) P44_OVERRIDE;
 
+    /// called by VdcHost to deliver a notification addressed to multiple devices of this vDC at once
+    /// @param aMethod the notification
+    /// @param aDevices the devices of this vDC the notification is addressed to
+    /// @param aParams the parameters object
+    /// @note base class just calls handleNotification() on every device in aDevices. vDCs which can address
+    ///   multiple devices with a single hardware command (broadcast, group addressing) can override this to
+    ///   handle some or all devices at once, and pass the remaining devices on to the base class implementation.
+    virtual void handleNotificationForDevices(const string &aMethod, DeviceVector &aDevices, ApiValuePtr aParams);
+
 
     /// @}
 
@@ -242,6 +251,19 @@ namespace p44 {
     /// forget any parameters stored in persistent DB
     ErrorPtr forget();
 
+    /// mark vdc settings dirty, and register vdc for the next save batch
+    void markDirty();
+
+    /// set a persistent vdc setting, and if changed, mark dirty and register vdc for the next save batch
+    /// @return true if value has changed
+    template<typename T> bool setPVar(T &aTargetVar, const T aNewValue)
+    {
+      if (aTargetVar==aNewValue) return false;
+      aTargetVar = aNewValue;
+      markDirty();
+      return true;
+    };
+
     // load additional settings from files
     void loadSettingsFromFiles();
 
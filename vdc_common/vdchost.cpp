@@ -52,6 +52,9 @@ using namespace p44;
 // how long until a not acknowledged registrations is considered timed out (and next device can be attempted)
 #define ANNOUNCE_TIMEOUT (30*Second)
 
+// default number of announcements that may be sent without waiting for the vdSM's response
+#define DEFAULT_ANNOUNCE_WINDOW 4
+
 // how long until a not acknowledged announcement for a device is retried again for the same device
 #define ANNOUNCE_RETRY_TIMEOUT (300*Second)
 
@@ -73,11 +76,18 @@ VdcHost::VdcHost() :
   collecting(false),
   lastActivity(0),
   lastPeriodicRun(0),
+  lastDirtyScan(0),
   learningMode(false),
   announcementTicket(0),
+  announceWindow(DEFAULT_ANNOUNCE_WINDOW),
+  announcesInFlight(0),
+  announceRetriesPending(0),
+  announceStarted(Never),
+  lastAnnounceDuration(Never),
   periodicTaskTicket(0),
   localDimDirection(0), // undefined
   mainloopStatsInterval(DEFAULT_MAINLOOP_STATS_INTERVAL),
+  pushCoalescingDelay(0),
   mainLoopStatsCounter(0),
   productName(DEFAULT_PRODUCT_NAME)
 {
@@ -130,6 +140,7 @@ void VdcHost::setIdMode(DsUidPtr aExternalDsUid)
 void VdcHost::addVdc(VdcPtr aVdcPtr)
 {
   vdcs[aVdcPtr->getDsUid()] = aVdcPtr;
+  queueForAnnouncement(aVdcPtr);
 }
 
 
@@ -327,7 +338,8 @@ class VdcCollector
   bool clear;
   VdcMap::iterator nextVdc;
   VdcHost *deviceContainerP;
-  DsDeviceMap::iterator nextDevice;
+  DeviceVector devicesToInit;
+  DeviceVector::iterator nextDevice;
 public:
   static void collectDevices(VdcHost *aVdcHostP, StatusCB aCallback, bool aIncremental, bool aExhaustive, bool aClearSettings)
   {
@@ -377,16 +389,20 @@ private:
   void collectedAllVdcs(ErrorPtr aError)
   {
     // now have each of them initialized
-    nextDevice = deviceContainerP->dSDevices.begin();
+    // - iterate over a snapshot, as adding devices to the hashed device map might invalidate iterators
+    for (DsDeviceMap::iterator pos = deviceContainerP->dSDevices.begin(); pos!=deviceContainerP->dSDevices.end(); ++pos) {
+      devicesToInit.push_back(pos->second);
+    }
+    nextDevice = devicesToInit.begin();
     initializeNextDevice(ErrorPtr());
   }
 
 
   void initializeNextDevice(ErrorPtr aError)
   {
-    if (!aError && nextDevice!=deviceContainerP->dSDevices.end())
+    if (!aError && nextDevice!=devicesToInit.end())
       // TODO: now never doing factory reset init, maybe parametrize later
-      nextDevice->second->initializeDevice(boost::bind(&VdcCollector::deviceInitialized, this, _1), false);
+      (*nextDevice)->initializeDevice(boost::bind(&VdcCollector::deviceInitialized, this, _1), false);
     else
       completed(aError);
   }
@@ -394,7 +410,8 @@ private:
 
   void deviceInitialized(ErrorPtr aError)
   {
-    LOG(LOG_NOTICE, "--- initialized device: %s",nextDevice->second->description().c_str());
+    LOG(LOG_NOTICE, "--- initialized device: %s",(*nextDevice)->description().c_str());
+    deviceContainerP->queueForAnnouncement(*nextDevice);
     // check next
     ++nextDevice;
     initializeNextDevice(aError);
@@ -425,7 +442,8 @@ void VdcHost::collectDevices(StatusCB aCompletedCB, bool aIncremental, bool aExh
         resetAnnouncing();
         activeSessionConnection.reset(); // forget connection
       }
-      dSDevices.clear(); // forget existing ones
+      clearDeviceIndices();
+      dSDevices.clear(); // forget existing ones (stale entries in announcement queue will be skipped)
     }
     VdcCollector::collectDevices(this, aCompletedCB, aIncremental, aExhaustive, aClearSettings);
   }
@@ -455,6 +473,10 @@ bool VdcHost::addDevice(DevicePtr aDevice)
   LOG(LOG_NOTICE, "--- added device: %s (not yet initialized)",aDevice->shortDesc().c_str());
   // load the device's persistent params
   aDevice->load();
+  // settings changed before device got registered (e.g. when learned in) need saving, too
+  if (aDevice->isDirty()) markForSave(aDevice->getDsUid());
+  // enter into secondary indices (zone and groups are known now that settings are loaded)
+  indexDevice(aDevice);
   // if not collecting, initialize device right away.
   // Otherwise, initialisation will be done when collecting is complete
   if (!collecting) {
@@ -467,6 +489,7 @@ void VdcHost::deviceInitialized(DevicePtr aDevice)
 {
   LOG(LOG_NOTICE, "--- initialized device: %s",aDevice->description().c_str());
   // trigger announcing when initialized (no problem when called while already announcing)
+  queueForAnnouncement(aDevice);
   startAnnouncing();
 }
 
@@ -484,13 +507,62 @@ void VdcHost::removeDevice(DevicePtr aDevice, bool aForget)
     // save, as we don't want to forget the settings associated with the device
     aDevice->save();
   }
-  // remove from container-wide map of devices
+  // remove from container-wide map of devices and indices
+  unindexDevice(aDevice);
   dSDevices.erase(aDevice->getDsUid());
   LOG(LOG_NOTICE, "--- removed device: %s", aDevice->shortDesc().c_str());
 }
 
 
 
+// MARK: ===== secondary device index
+
+bool DeviceDsUidLess::operator()(const DevicePtr &aA, const DevicePtr &aB) const
+{
+  return aA->getDsUid() < aB->getDsUid();
+}
+
+
+template<typename K> static void removeFromIndex(map<K, DeviceSet> &aIndex, const K &aKey, DevicePtr aDevice)
+{
+  typename map<K, DeviceSet>::iterator pos = aIndex.find(aKey);
+  if (pos!=aIndex.end()) {
+    pos->second.erase(aDevice);
+    if (pos->second.empty()) aIndex.erase(pos); // no empty buckets
+  }
+}
+
+
+void VdcHost::indexDevice(DevicePtr aDevice)
+{
+  if (aDevice->indexed) return; // already indexed
+  if (aDevice->output) {
+    outputTypeIndex[aDevice->output->behaviourTypeIdentifier()].insert(aDevice);
+  }
+  aDevice->indexed = true;
+}
+
+
+void VdcHost::unindexDevice(DevicePtr aDevice)
+{
+  if (!aDevice->indexed) return; // not indexed
+  if (aDevice->output) {
+    removeFromIndex(outputTypeIndex, string(aDevice->output->behaviourTypeIdentifier()), aDevice);
+  }
+  aDevice->indexed = false;
+}
+
+
+void VdcHost::clearDeviceIndices()
+{
+  for (DsDeviceMap::iterator pos = dSDevices.begin(); pos!=dSDevices.end(); ++pos) {
+    pos->second->indexed = false;
+  }
+  outputTypeIndex.clear();
+}
+
+
+
 void VdcHost::startLearning(LearnCB aLearnHandler, bool aDisableProximityCheck)
 {
   // enable learning in all class containers
@@ -582,6 +654,7 @@ bool VdcHost::signalDeviceUserAction(Device &aDevice, bool aRegular)
 
 #define PERIODIC_TASK_INTERVAL (5*Second)
 #define PERIODIC_TASK_FORCE_INTERVAL (1*Minute)
+#define DIRTY_SCAN_INTERVAL PERIODIC_TASK_FORCE_INTERVAL // safety net scan for changes that were not registered for saving
 
 #define ACTIVITY_PAUSE_INTERVAL (1*Second)
 
@@ -598,17 +671,12 @@ void VdcHost::periodicTask(MLMicroSeconds aCycleStartTime)
     if (!collecting) {
       // check again for devices that need to be announced
       startAnnouncing();
-      // do a save run as well
-      // - myself
-      save();
-      // - device containers
-      for (VdcMap::iterator pos = vdcs.begin(); pos!=vdcs.end(); ++pos) {
-        pos->second->save();
-      }
-      // - devices
-      for (DsDeviceMap::iterator pos = dSDevices.begin(); pos!=dSDevices.end(); ++pos) {
-        pos->second->save();
+      // save entities that have reported changes since last run (nothing to do when idle)
+      if (aCycleStartTime>lastDirtyScan+DIRTY_SCAN_INTERVAL) {
+        lastDirtyScan = aCycleStartTime;
+        scanForDirtyEntities();
       }
+      saveDirtyEntities();
     }
   }
   if (mainloopStatsInterval>0) {
@@ -686,16 +754,20 @@ void VdcHost::handleClickLocally(ButtonBehaviour &aButtonBehaviour, DsClickType
     }
     signalActivity(); // local activity
     // some action to perform on every light device
-    for (DsDeviceMap::iterator pos = dSDevices.begin(); pos!=dSDevices.end(); ++pos) {
-      DevicePtr dev = pos->second;
-      if (scene==STOP_S) {
-        // stop dimming
-        dev->dimChannelForArea(channeltype, dimmode_stop, 0, 0);
-      }
-      else {
-        // call scene or start dimming
-        LightBehaviourPtr l = boost::dynamic_pointer_cast<LightBehaviour>(dev->output);
-        if (l) {
+    // - devices are indexed by output type, all devices in a type bucket share the same output behaviour class
+    for (DeviceTypeIndex::iterator tpos = outputTypeIndex.begin(); tpos!=outputTypeIndex.end(); ++tpos) {
+      if (tpos->second.empty()) continue;
+      bool isLight = boost::dynamic_pointer_cast<LightBehaviour>((*tpos->second.begin())->output)!=NULL;
+      if (!isLight && scene!=STOP_S) continue; // only lights are switched or dimmed
+      for (DeviceSet::iterator pos = tpos->second.begin(); pos!=tpos->second.end(); ++pos) {
+        DevicePtr dev = *pos;
+        if (scene==STOP_S) {
+          // stop dimming
+          dev->dimChannelForArea(channeltype, dimmode_stop, 0, 0);
+        }
+        else {
+          // call scene or start dimming
+          LightBehaviourPtr l = boost::static_pointer_cast<LightBehaviour>(dev->output);
           // - figure out direction if not already known
           if (localDimDirection==0 && l->brightness->getLastSync()!=Never) {
             // get initial direction from current value of first encountered light with synchronized brightness value
@@ -808,11 +880,7 @@ void VdcHost::vdcApiRequestHandler(VdcApiConnectionPtr aApiConnection, VdcApiReq
         // can be single dSUID or array of dSUIDs
         if (o->isType(apivalue_array)) {
           // array of dSUIDs
-          for (int i=0; i<o->arrayLength(); i++) {
-            ApiValuePtr e = o->arrayGet(i);
-            dsuid.setAsBinary(e->binaryValue());
-            handleNotificationForDsUid(aMethod, dsuid, aParams);
-          }
+          handleNotificationForDsUids(aMethod, o, aParams);
         }
         else {
           // single dSUID
@@ -873,6 +941,7 @@ ErrorPtr VdcHost::helloHandler(VdcApiRequestPtr aRequest, ApiValuePtr aParams)
           connectedVdsm = vdsmDsUid;
           // - remember the session's connection
           activeSessionConnection = aRequest->connection();
+          announceStarted = MainLoop::now();
           // - create answer
           ApiValuePtr result = activeSessionConnection->newApiValue();
           result->setType(apivalue_object);
@@ -1002,6 +1071,38 @@ void VdcHost::handleNotificationForDsUid(const string &aMethod, const DsUid &aDs
 }
 
 
+void VdcHost::handleNotificationForDsUids(const string &aMethod, ApiValuePtr aDsUids, ApiValuePtr aParams)
+{
+  // group the addressed devices by their vdc, so vdcs get a chance to deliver the notification
+  // to all of their addressed devices at once (e.g. using a bus level broadcast or group command)
+  typedef map<Vdc *, DeviceVector> VdcDeviceBatchMap;
+  VdcDeviceBatchMap batches;
+  DsUid dsuid;
+  for (int i=0; i<aDsUids->arrayLength(); i++) {
+    ApiValuePtr e = aDsUids->arrayGet(i);
+    dsuid.setAsBinary(e->binaryValue());
+    DsAddressablePtr addressable = addressableForParams(dsuid, aParams);
+    if (!addressable) {
+      LOG(LOG_WARNING, "Target entity %s not found for notification '%s'", dsuid.getString().c_str(), aMethod.c_str());
+      continue;
+    }
+    DevicePtr dev = boost::dynamic_pointer_cast<Device>(addressable);
+    if (dev) {
+      // device: collect into batch of its vdc
+      batches[dev->vdcP].push_back(dev);
+    }
+    else {
+      // non-device addressables (vdcs, vdc host) are always notified individually
+      addressable->handleNotification(aMethod, aParams);
+    }
+  }
+  // now deliver the batches
+  for (VdcDeviceBatchMap::iterator pos = batches.begin(); pos!=batches.end(); ++pos) {
+    pos->first->handleNotificationForDevices(aMethod, pos->second, aParams);
+  }
+}
+
+
 
 // MARK: ===== vDC level methods and notifications
 
@@ -1035,21 +1136,47 @@ void VdcHost::resetAnnouncing()
 {
   // end pending announcement
   MainLoop::currentMainLoop().cancelExecutionTicket(announcementTicket);
-  // end all device sessions
-  for (DsDeviceMap::iterator pos = dSDevices.begin(); pos!=dSDevices.end(); ++pos) {
-    DevicePtr dev = pos->second;
-    dev->announced = Never;
-    dev->announcing = Never;
-  }
-  // end all vdc sessions
+  // forget queue
+  pendingAnnouncements.clear();
+  deferredAnnouncements.clear();
+  announcesInFlight = 0;
+  announceRetriesPending = 0;
+  announceStarted = Never;
+  // end all vdc sessions, re-queue vdcs first
   for (VdcMap::iterator pos = vdcs.begin(); pos!=vdcs.end(); ++pos) {
     VdcPtr vdc = pos->second;
+    MainLoop::currentMainLoop().cancelExecutionTicket(vdc->announceTicket);
     vdc->announced = Never;
     vdc->announcing = Never;
+    vdc->announceQueued = false;
+    queueForAnnouncement(vdc);
+  }
+  // end all device sessions, re-queue devices
+  for (DsDeviceMap::iterator pos = dSDevices.begin(); pos!=dSDevices.end(); ++pos) {
+    DevicePtr dev = pos->second;
+    MainLoop::currentMainLoop().cancelExecutionTicket(dev->announceTicket);
+    dev->announced = Never;
+    dev->announcing = Never;
+    dev->announceQueued = false;
+    queueForAnnouncement(dev);
   }
 }
 
 
+/// put entity into the queue of entities to be announced (if not already queued or announced)
+void VdcHost::queueForAnnouncement(DsAddressablePtr aAddressable)
+{
+  if (
+    aAddressable->isPublicDS() && // only public ones
+    !aAddressable->announceQueued &&
+    aAddressable->announced==Never &&
+    aAddressable->announcing==Never // not in flight
+  ) {
+    aAddressable->announceQueued = true;
+    pendingAnnouncements.push_back(aAddressable);
+  }
+}
+
 
 /// start announcing all not-yet announced entities to the vdSM
 void VdcHost::startAnnouncing()
@@ -1063,80 +1190,153 @@ void VdcHost::startAnnouncing()
 void VdcHost::announceNext()
 {
   if (collecting) return; // prevent announcements during collect.
-  // cancel re-announcing
+  // cancel re-triggering
   MainLoop::currentMainLoop().cancelExecutionTicket(announcementTicket);
-  // announce vdcs first
-  for (VdcMap::iterator pos = vdcs.begin(); pos!=vdcs.end(); ++pos) {
-    VdcPtr vdc = pos->second;
-    if (
-      vdc->isPublicDS() && // only public ones
-      vdc->announced==Never &&
-      (vdc->announcing==Never || MainLoop::now()>vdc->announcing+ANNOUNCE_RETRY_TIMEOUT) &&
-      (!vdc->invisibleWhenEmpty() || vdc->getNumberOfDevices()>0)
-    ) {
-      // mark device as being in process of getting announced
-      vdc->announcing = MainLoop::now();
-      // call announcevdc method (need to construct here, because dSUID must be sent as vdcdSUID)
-      ApiValuePtr params = getSessionConnection()->newApiValue();
-      params->setType(apivalue_object);
-      params->add("dSUID", params->newBinary(vdc->getDsUid().getBinary()));
-      if (!sendApiRequest("announcevdc", params, boost::bind(&VdcHost::announceResultHandler, this, vdc, _2, _3, _4))) {
-        LOG(LOG_ERR, "Could not send vdc announcement message for %s %s", vdc->entityType(), vdc->shortDesc().c_str());
-        vdc->announcing = Never; // not registering
+  if (!activeSessionConnection) return; // no session, nothing to announce to
+  // fill the window of in-flight announcements from the queue
+  while (announcesInFlight<announceWindow && !pendingAnnouncements.empty()) {
+    DsAddressablePtr a = pendingAnnouncements.front();
+    pendingAnnouncements.pop_front();
+    a->announceQueued = false;
+    if (a->announced!=Never || a->announcing!=Never) continue; // already announced or in flight
+    VdcPtr vdc = boost::dynamic_pointer_cast<Vdc>(a);
+    if (vdc) {
+      if (vdc->invisibleWhenEmpty() && vdc->getNumberOfDevices()==0) {
+        continue; // will get re-queued when a device is queued for it
       }
-      else {
-        LOG(LOG_NOTICE, "Sent vdc announcement for %s %s", vdc->entityType(), vdc->shortDesc().c_str());
-      }
-      // schedule a retry
-      announcementTicket = MainLoop::currentMainLoop().executeOnce(boost::bind(&VdcHost::announceNext, this), ANNOUNCE_TIMEOUT);
-      // done for now, continues after ANNOUNCE_TIMEOUT or when registration acknowledged
-      return;
     }
-  }
-  // check all devices for unnannounced ones and announce those
-  for (DsDeviceMap::iterator pos = dSDevices.begin(); pos!=dSDevices.end(); ++pos) {
-    DevicePtr dev = pos->second;
-    if (
-      dev->isPublicDS() && // only public ones
-      (dev->vdcP->announced!=Never) && // class container must have already completed an announcement
-      dev->announced==Never &&
-      (dev->announcing==Never || MainLoop::now()>dev->announcing+ANNOUNCE_RETRY_TIMEOUT)
-    ) {
-      // mark device as being in process of getting announced
-      dev->announcing = MainLoop::now();
-      // call announce method
-      ApiValuePtr params = getSessionConnection()->newApiValue();
-      params->setType(apivalue_object);
-      // include link to vdc for device announcements
-      params->add("vdc_dSUID", params->newBinary(dev->vdcP->getDsUid().getBinary()));
-      if (!dev->sendRequest("announcedevice", params, boost::bind(&VdcHost::announceResultHandler, this, dev, _2, _3, _4))) {
-        LOG(LOG_ERR, "Could not send device announcement message for %s %s", dev->entityType(), dev->shortDesc().c_str());
-        dev->announcing = Never; // not registering
+    else {
+      DevicePtr dev = boost::dynamic_pointer_cast<Device>(a);
+      if (!dev) continue;
+      DsDeviceMap::iterator pos = dSDevices.find(dev->getDsUid());
+      if (pos==dSDevices.end() || pos->second!=dev) {
+        continue; // device is no longer registered
       }
-      else {
-        LOG(LOG_NOTICE, "Sent device announcement for %s %s", dev->entityType(), dev->shortDesc().c_str());
+      if (dev->vdcP->announced==Never) {
+        // class container must have already completed an announcement
+        a->announceQueued = true;
+        deferredAnnouncements.push_back(a);
+        queueForAnnouncement(VdcPtr(dev->vdcP));
+        continue;
       }
-      // schedule a retry
-      announcementTicket = MainLoop::currentMainLoop().executeOnce(boost::bind(&VdcHost::announceNext, this), ANNOUNCE_TIMEOUT);
-      // done for now, continues after ANNOUNCE_TIMEOUT or when registration acknowledged
-      return;
     }
+    if (!sendAnnouncement(a)) {
+      // could not send now, keep queued and retry later (periodic task calls startAnnouncing())
+      queueForAnnouncement(a);
+      break;
+    }
+  }
+  checkAnnounceComplete();
+}
+
+
+bool VdcHost::sendAnnouncement(DsAddressablePtr aAddressable)
+{
+  bool sent;
+  // mark entity as being in process of getting announced
+  aAddressable->announcing = MainLoop::now();
+  ApiValuePtr params = getSessionConnection()->newApiValue();
+  params->setType(apivalue_object);
+  VdcPtr vdc = boost::dynamic_pointer_cast<Vdc>(aAddressable);
+  if (vdc) {
+    // call announcevdc method (need to construct here, because dSUID must be sent as vdcdSUID)
+    params->add("dSUID", params->newBinary(vdc->getDsUid().getBinary()));
+    sent = sendApiRequest("announcevdc", params, boost::bind(&VdcHost::announceResultHandler, this, aAddressable, _2, _3, _4));
   }
+  else {
+    // call announce method, include link to vdc for device announcements
+    DevicePtr dev = boost::dynamic_pointer_cast<Device>(aAddressable);
+    params->add("vdc_dSUID", params->newBinary(dev->vdcP->getDsUid().getBinary()));
+    sent = dev->sendRequest("announcedevice", params, boost::bind(&VdcHost::announceResultHandler, this, aAddressable, _2, _3, _4));
+  }
+  if (!sent) {
+    LOG(LOG_ERR, "Could not send announcement message for %s %s", aAddressable->entityType(), aAddressable->shortDesc().c_str());
+    aAddressable->announcing = Never; // not registering
+    return false;
+  }
+  LOG(LOG_NOTICE, "Sent announcement for %s %s", aAddressable->entityType(), aAddressable->shortDesc().c_str());
+  announcesInFlight++;
+  // per-entity timeout, frees the window slot when vdSM does not respond
+  aAddressable->announceTicket = MainLoop::currentMainLoop().executeOnce(boost::bind(&VdcHost::announceTimeout, this, aAddressable), ANNOUNCE_TIMEOUT);
+  return true;
+}
+
+
+void VdcHost::announceTimeout(DsAddressablePtr aAddressable)
+{
+  aAddressable->announceTicket = 0;
+  if (aAddressable->announcing==Never) return; // not in flight any more
+  LOG(LOG_WARNING, "Announcement for %s %s timed out -> will retry later", aAddressable->entityType(), aAddressable->shortDesc().c_str());
+  aAddressable->announcing = Never;
+  announcesInFlight--;
+  // retry after a while
+  announceRetriesPending++;
+  aAddressable->announceTicket = MainLoop::currentMainLoop().executeOnce(boost::bind(&VdcHost::announceRetry, this, aAddressable), ANNOUNCE_RETRY_TIMEOUT-ANNOUNCE_TIMEOUT);
+  // slot is free again, continue with next
+  announceNext();
+}
+
+
+void VdcHost::announceRetry(DsAddressablePtr aAddressable)
+{
+  aAddressable->announceTicket = 0;
+  announceRetriesPending--;
+  queueForAnnouncement(aAddressable);
+  startAnnouncing();
 }
 
 
 void VdcHost::announceResultHandler(DsAddressablePtr aAddressable, VdcApiRequestPtr aRequest, ErrorPtr &aError, ApiValuePtr aResultOrErrorData)
 {
+  bool inFlight = aAddressable->announcing!=Never;
+  if (inFlight) {
+    // response within timeout
+    announcesInFlight--;
+    MainLoop::currentMainLoop().cancelExecutionTicket(aAddressable->announceTicket);
+  }
   if (Error::isOK(aError)) {
     // set device announced successfully
     LOG(LOG_NOTICE, "Announcement for %s %s acknowledged by vdSM", aAddressable->entityType(), aAddressable->shortDesc().c_str());
+    if (!inFlight && aAddressable->announceTicket) {
+      // late response, cancel retry
+      MainLoop::currentMainLoop().cancelExecutionTicket(aAddressable->announceTicket);
+      announceRetriesPending--;
+    }
     aAddressable->announced = MainLoop::now();
     aAddressable->announcing = Never; // not announcing any more
+    if (boost::dynamic_pointer_cast<Vdc>(aAddressable)) {
+      // vdc is announced now, devices waiting for it can be announced
+      for (DsAddressableList::iterator pos = deferredAnnouncements.begin(); pos!=deferredAnnouncements.end(); ++pos) {
+        (*pos)->announceQueued = false;
+        queueForAnnouncement(*pos);
+      }
+      deferredAnnouncements.clear();
+    }
+  }
+  else if (inFlight) {
+    // rejected, retry after a while
+    aAddressable->announcing = Never;
+    announceRetriesPending++;
+    aAddressable->announceTicket = MainLoop::currentMainLoop().executeOnce(boost::bind(&VdcHost::announceRetry, this, aAddressable), ANNOUNCE_RETRY_TIMEOUT);
   }
-  // cancel retry timer
-  MainLoop::currentMainLoop().cancelExecutionTicket(announcementTicket);
   // try next announcement, after a pause
-  announcementTicket = MainLoop::currentMainLoop().executeOnce(boost::bind(&VdcHost::announceNext, this), ANNOUNCE_PAUSE);
+  if (announcementTicket==0) {
+    announcementTicket = MainLoop::currentMainLoop().executeOnce(boost::bind(&VdcHost::announceNext, this), ANNOUNCE_PAUSE);
+  }
+}
+
+
+void VdcHost::checkAnnounceComplete()
+{
+  if (
+    announceStarted!=Never &&
+    announcesInFlight==0 && announceRetriesPending==0 &&
+    pendingAnnouncements.empty() && deferredAnnouncements.empty()
+  ) {
+    lastAnnounceDuration = MainLoop::now()-announceStarted;
+    announceStarted = Never;
+    LOG(LOG_NOTICE, "All entities announced to vdSM in %.3f seconds", (double)lastAnnounceDuration/Second);
+  }
 }
 
 
@@ -1165,6 +1365,8 @@ enum {
   vdcs_key,
   valueSources_key,
   webui_url_key,
+  announceWindow_key,
+  lastAnnounceDuration_key,
   numDeviceContainerProperties
 };
 
@@ -1185,7 +1387,9 @@ PropertyDescriptorPtr VdcHost::getDescriptorByIndex(int aPropIndex, int aDomain,
   static const PropertyDescription properties[numDeviceContainerProperties] = {
     { "x-p44-vdcs", apivalue_object+propflag_container, vdcs_key, OKEY(vdc_container_key) },
     { "x-p44-valueSources", apivalue_null, valueSources_key, OKEY(devicecontainer_key) },
-    { "configURL", apivalue_string, webui_url_key, OKEY(devicecontainer_key) }
+    { "configURL", apivalue_string, webui_url_key, OKEY(devicecontainer_key) },
+    { "x-p44-announceWindow", apivalue_uint64, announceWindow_key, OKEY(devicecontainer_key) },
+    { "x-p44-lastAnnounceDuration", apivalue_double, lastAnnounceDuration_key, OKEY(devicecontainer_key) }
   };
   int n = inherited::numProps(aDomain, aParentDescriptor);
   if (aPropIndex<n)
@@ -1243,6 +1447,20 @@ bool VdcHost::accessField(PropertyAccessMode aMode, ApiValuePtr aPropValue, Prop
         case webui_url_key:
           aPropValue->setStringValue(webuiURLString());
           return true;
+        case announceWindow_key:
+          aPropValue->setUint32Value(announceWindow);
+          return true;
+        case lastAnnounceDuration_key:
+          if (lastAnnounceDuration==Never) return false;
+          aPropValue->setDoubleValue((double)lastAnnounceDuration/Second);
+          return true;
+      }
+    }
+    else {
+      switch (aPropertyDescriptor->fieldKey()) {
+        case announceWindow_key:
+          setAnnounceWindow(aPropValue->int32Value());
+          return true;
       }
     }
   }
@@ -1365,6 +1583,69 @@ ErrorPtr VdcHost::save()
 }
 
 
+void VdcHost::markDirty()
+{
+  inheritedParams::markDirty();
+  markForSave(dSUID);
+}
+
+
+void VdcHost::markForSave(const DsUid &aDsUid)
+{
+  if (aDsUid.empty()) return; // not yet identified entity, will be checked when added
+  pendingSaves.insert(aDsUid);
+}
+
+
+void VdcHost::scanForDirtyEntities()
+{
+  if (isDirty()) markForSave(dSUID);
+  for (VdcMap::iterator pos = vdcs.begin(); pos!=vdcs.end(); ++pos) {
+    if (pos->second->isDirty()) markForSave(pos->first);
+  }
+  for (DsDeviceMap::iterator pos = dSDevices.begin(); pos!=dSDevices.end(); ++pos) {
+    if (pos->second->isDirty()) markForSave(pos->first);
+  }
+}
+
+
+void VdcHost::saveDirtyEntities()
+{
+  if (pendingSaves.empty()) return; // nothing to save
+  // take the current set, saving might register entities again
+  DsUidSet toSave;
+  toSave.swap(pendingSaves);
+  // write all changes in a single transaction, so a burst of changes costs only one DB commit
+  bool inTransaction = dsParamStore.execute("BEGIN TRANSACTION")==SQLITE_OK;
+  if (!inTransaction) {
+    LOG(LOG_WARNING, "Could not start DB transaction, saving %zu entities individually", toSave.size());
+  }
+  for (DsUidSet::iterator pos = toSave.begin(); pos!=toSave.end(); ++pos) {
+    if (*pos==dSUID) {
+      // vdc host itself
+      save();
+      continue;
+    }
+    DsDeviceMap::iterator dpos = dSDevices.find(*pos);
+    if (dpos!=dSDevices.end()) {
+      dpos->second->save();
+      continue;
+    }
+    VdcMap::iterator vpos = vdcs.find(*pos);
+    if (vpos!=vdcs.end()) {
+      vpos->second->save();
+    }
+    // entities no longer present are skipped (removed devices are saved or forgotten at removal)
+  }
+  if (inTransaction) {
+    if (dsParamStore.execute("COMMIT")!=SQLITE_OK) {
+      LOG(LOG_ERR, "Committing DB transaction failed: %s", dsParamStore.error_msg());
+    }
+  }
+  LOG(LOG_DEBUG, "Saved %zu entities with unsaved changes", toSave.size());
+}
+
+
 ErrorPtr VdcHost::forget()
 {
   // delete the vdc settings
@@ -33,6 +33,9 @@
 
 #include "vdcapi.hpp"
 
+#include <set>
+#include <boost/unordered_map.hpp>
+
 
 using namespace std;
 
@@ -78,7 +81,13 @@ namespace p44 {
   class VdcHost;
   typedef boost::intrusive_ptr<VdcHost> VdcHostPtr;
   typedef map<DsUid, VdcPtr> VdcMap;
-  typedef map<DsUid, DevicePtr> DsDeviceMap;
+  typedef boost::unordered_map<DsUid, DevicePtr, DsUidHash> DsDeviceMap;
+  /// orders devices by dSUID, to get reproducible iteration order
+  struct DeviceDsUidLess { bool operator()(const DevicePtr &aA, const DevicePtr &aB) const; };
+  typedef set<DevicePtr, DeviceDsUidLess> DeviceSet;
+  typedef map<string, DeviceSet> DeviceTypeIndex;
+  typedef list<DsAddressablePtr> DsAddressableList;
+  typedef set<DsUid> DsUidSet;
 
 
   /// container for all devices hosted by this application
@@ -101,6 +110,7 @@ namespace p44 {
     uint64_t mac; ///< MAC address as found at startup
 
     DsDeviceMap dSDevices; ///< available devices by API-exposed ID (dSUID or derived dsid)
+    DeviceTypeIndex outputTypeIndex; ///< devices with outputs by output behaviour type identifier
     DsParamStore dsParamStore; ///< the database for storing dS device parameters
 
     string iconDir; ///< the directory where to load icons from
@@ -113,9 +123,18 @@ namespace p44 {
 
     bool collecting;
     long announcementTicket;
+    int announceWindow; ///< max number of announcements sent to vdSM without having received a response yet
+    int announcesInFlight; ///< number of announcements currently waiting for a response
+    int announceRetriesPending; ///< number of timed out announcements waiting to be retried
+    DsAddressableList pendingAnnouncements; ///< entities waiting to be announced
+    DsAddressableList deferredAnnouncements; ///< devices waiting for their vdc to get announced first
+    MLMicroSeconds announceStarted; ///< when current announcement run has started, Never if none is running
+    MLMicroSeconds lastAnnounceDuration; ///< how long the last announcement run took until all entities were announced
+    DsUidSet pendingSaves; ///< dSUIDs of entities (vdc host, vdcs, devices) with unsaved persistent changes
     long periodicTaskTicket;
     MLMicroSeconds lastActivity;
     MLMicroSeconds lastPeriodicRun;
+    MLMicroSeconds lastDirtyScan; ///< when all entities were last checked for changes not registered via markForSave()
 
     int8_t localDimDirection;
 
@@ -131,6 +150,7 @@ namespace p44 {
 
     // mainloop statistics
     int mainloopStatsInterval; ///< 0=none, N=every PERIODIC_TASK_INTERVAL*N seconds
+    MLMicroSeconds pushCoalescingDelay; ///< max delay for merging behaviour state pushes of a device into one pushNotification
     int mainLoopStatsCounter;
 
     // active vDC API session
@@ -205,6 +225,22 @@ namespace p44 {
     /// @param aInterval 0=none, N=every PERIODIC_TASK_INTERVAL*N seconds
     void setMainloopStatsInterval(int aInterval) { mainloopStatsInterval = aInterval; };
 
+    /// Set how long behaviour state pushes of a device are collected before sending them as one pushNotification
+    /// @param aDelay max delay. 0 (default) means merging only state changes that occur within the same mainloop cycle.
+    /// @note state values are read when the merged pushNotification is sent, so for a longer delay only the latest
+    ///   state within that delay will be reported
+    void setPushCoalescingDelay(MLMicroSeconds aDelay) { pushCoalescingDelay = aDelay; };
+
+    /// @return max delay for merging behaviour state pushes
+    MLMicroSeconds getPushCoalescingDelay() { return pushCoalescingDelay; };
+
+    /// Set how many announcements can be sent to the vdSM without waiting for responses
+    /// @param aAnnounceWindow max number of announcements in flight (at least 1)
+    void setAnnounceWindow(int aAnnounceWindow) { announceWindow = aAnnounceWindow>0 ? aAnnounceWindow : 1; };
+
+    /// @return how long the most recent announcement run took until all entities were announced, Never if none completed yet
+    MLMicroSeconds getLastAnnounceDuration() { return lastAnnounceDuration; };
+
     /// @return URL for Web-UI (for access from local LAN)
     virtual string webuiURLString() { return ""; /* none by default */ }
 
@@ -383,6 +419,33 @@ namespace p44 {
     // load additional settings from file
     void loadSettingsFromFiles();
 
+    /// mark vdc host settings dirty, and register vdc host for the next save batch
+    void markDirty();
+
+    /// set a persistent vdc host setting, and if changed, mark dirty and register vdc host for the next save batch
+    /// @return true if value has changed
+    template<typename T> bool setPVar(T &aTargetVar, const T aNewValue)
+    {
+      if (aTargetVar==aNewValue) return false;
+      aTargetVar = aNewValue;
+      markDirty();
+      return true;
+    };
+
+    /// register an entity as having unsaved persistent changes
+    /// @param aDsUid the dSUID of the vdc host, a vdc or a device
+    /// @note all registered entities are saved in a single DB transaction by the next periodic save.
+    ///   dSUIDs no longer known at that time (e.g. removed devices) are silently skipped.
+    void markForSave(const DsUid &aDsUid);
+
+    /// immediately save all entities registered with markForSave() in a single DB transaction
+    void saveDirtyEntities();
+
+    /// register all entities that are dirty but were not registered with markForSave()
+    /// @note safety net for changes made via PersistentParams::markDirty()/setPVar() directly (e.g. on scenes
+    ///   or from p44utils), which cannot register the entity. Checks all entities, so only called at low frequency.
+    void scanForDirtyEntities();
+
     /// @}
 
 
@@ -427,6 +490,7 @@ namespace p44 {
     // method and notification dispatching
     ErrorPtr handleMethodForDsUid(const string &aMethod, VdcApiRequestPtr aRequest, const DsUid &aDsUid, ApiValuePtr aParams);
     void handleNotificationForDsUid(const string &aMethod, const DsUid &aDsUid, ApiValuePtr aParams);
+    void handleNotificationForDsUids(const string &aMethod, ApiValuePtr aDsUids, ApiValuePtr aParams);
     DsAddressablePtr addressableForParams(const DsUid &aDsUid, ApiValuePtr aParams);
 
   private:
@@ -451,11 +515,20 @@ namespace p44 {
     void removeResultHandler(DevicePtr aDevice, VdcApiRequestPtr aForRequest, bool aDisconnected);
     void deviceInitialized(DevicePtr aDevice);
 
+    // secondary device index
+    void indexDevice(DevicePtr aDevice);
+    void unindexDevice(DevicePtr aDevice);
+    void clearDeviceIndices();
     // announcing dSUID addressable entities within the device container (vdc host)
     void resetAnnouncing();
+    void queueForAnnouncement(DsAddressablePtr aAddressable);
     void startAnnouncing();
     void announceNext();
+    bool sendAnnouncement(DsAddressablePtr aAddressable);
     void announceResultHandler(DsAddressablePtr aAddressable, VdcApiRequestPtr aRequest, ErrorPtr &aError, ApiValuePtr aResultOrErrorData);
+    void announceTimeout(DsAddressablePtr aAddressable);
+    void announceRetry(DsAddressablePtr aAddressable);
+    void checkAnnounceComplete();
 
     // activity monitor
     void signalActivity();